@@ -378,6 +378,14 @@ typedef enum {
   OP_HALT_P,
   OP_BOUNDS_P,
 #endif
+  /* jump tables for dense switches; these are numbered after the packed
+   * instructions, also when those are not supported (SWITCH.TBL and
+   * SWITCH.TBL.OVL are patched instructions)
+   */
+  OP_SWITCH_TBL=175,
+  OP_JUMPTBL,
+  OP_SWITCH_TBL_OVL,
+  OP_JUMPTBL_OVL,
   /* ----- */
   OP_NUM_OPCODES
 } OPCODE;
@@ -622,6 +630,16 @@ int AMXAPI amx_Callback(AMX *amx, cell index, cell *result, const cell *params)
 
 #if defined AMX_INIT
 
+/* check whether the instruction at "addr" has the given opcode; instructions
+ * before "cip" have already been relocated
+ */
+static int is_opcode(AMX *amx,cell addr,cell cip,cell opcode,const cell *opcode_list)
+{
+  if (opcode_list!=NULL && addr<cip)
+    opcode=opcode_list[opcode];
+  return *(cell *)(amx->code+(int)addr)==opcode;
+}
+
 static int VerifyPcode(AMX *amx)
 {
   AMX_HEADER *hdr;
@@ -972,11 +990,15 @@ static int VerifyPcode(AMX *amx)
 #endif
       break;
 
+    case OP_SWITCH:     /* a switch on a jump table runs as SWITCH.TBL */
+      tgt=*(cell*)(amx->code+(int)cip)+cip-sizeof(cell);
+      if (tgt>=0 && tgt<amx->codesize && is_opcode(amx,tgt,cip,OP_JUMPTBL,opcode_list))
+        *(cell*)(amx->code+(int)cip-sizeof(cell))=(opcode_list!=NULL) ? opcode_list[OP_SWITCH_TBL] : OP_SWITCH_TBL;
+      /* drop through */
     case OP_CALL:       /* opcodes that need relocation (JIT only), or conversion to position-independent code */
     case OP_JUMP:
     case OP_JZER:
     case OP_JNZ:
-    case OP_SWITCH:
 #if !defined AMX_NO_MACRO_INSTR
     case OP_JEQ:
     case OP_JNEQ:
@@ -1006,6 +1028,8 @@ static int VerifyPcode(AMX *amx)
         amx->flags &= ~AMX_FLAG_VERIFY;
         return AMX_ERR_BOUNDS;
       } /* if */
+      if (tgt<amx->codesize && is_opcode(amx,tgt,cip,OP_JUMPTBL_OVL,opcode_list))
+        *(cell*)(amx->code+(int)cip-sizeof(cell))=(opcode_list!=NULL) ? opcode_list[OP_SWITCH_TBL_OVL] : OP_SWITCH_TBL_OVL;
       /* drop through */
     case OP_CALL_OVL:
       cip+=sizeof(cell);
@@ -1027,6 +1051,18 @@ static int VerifyPcode(AMX *amx)
         return AMX_ERR_OVERLAY;       /* no overlay callback */
       break;
     } /* case */
+    case OP_JUMPTBL_OVL: {
+      cell num;
+      DBGPARAM(num);    /* number of entries follows the opcode */
+      if (num<0 || cip+(num+2)*(cell)sizeof(cell)>amx->codesize) {
+        amx->flags &= ~AMX_FLAG_VERIFY;
+        return AMX_ERR_BOUNDS;
+      } /* if */
+      cip+=(num + 2)*sizeof(cell);
+      if (amx->overlay==NULL)
+        return AMX_ERR_OVERLAY;       /* no overlay callback */
+      break;
+    } /* case */
 #endif
 
     case OP_SYSREQ:
@@ -1060,6 +1096,33 @@ static int VerifyPcode(AMX *amx)
       break;
     } /* case */
 
+    case OP_JUMPTBL: {
+      cell num,offs;
+      int i;
+      DBGPARAM(num);    /* number of entries follows the opcode */
+      if (num<0 || cip+(num+2)*(cell)sizeof(cell)>amx->codesize) {
+        amx->flags &= ~AMX_FLAG_VERIFY;
+        return AMX_ERR_BOUNDS;
+      } /* if */
+      /* the "none-matched" address comes first, then the lowest case value
+       * and the addresses for all values in the range
+       */
+      for (i=0; i<=num; i++) {
+        offs=(i==0) ? cip : cip+(i+1)*sizeof(cell);
+        tgt=*(cell*)(amx->code+(int)offs)+offs-sizeof(cell);
+        if (tgt<0 || tgt>amx->codesize) {
+          amx->flags &= ~AMX_FLAG_VERIFY;
+          return AMX_ERR_BOUNDS;
+        } /* if */
+        #if defined AMX_JIT
+          RELOC_ABS(amx->code, offs);
+          reloc_count++;
+        #endif
+      } /* for */
+      cip+=(num + 2)*sizeof(cell);
+      break;
+    } /* case */
+
     default:
       amx->flags &= ~AMX_FLAG_VERIFY;
       return AMX_ERR_INVINSTR;
@@ -2708,10 +2771,29 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
       assert(*JUMPREL(cip)==OP_CASETBL);
       cip=JUMPREL(cptr+1);      /* preset to "none-matched" case */
       i=(int)*cptr;             /* number of records in the case table */
-      for (cptr+=2; i>0 && *cptr!=pri; i--,cptr+=2)
-        /* nothing */;
-      if (i>0)
-        cip=JUMPREL(cptr+1);    /* case found */
+      /* the records are sorted on the case value, so use a binary search */
+      for (cptr+=2; i>0; i>>=1) {
+        cell *mid=cptr+2*(i>>1);
+        if (*mid==pri) {
+          cip=JUMPREL(mid+1);   /* case found */
+          break;
+        } /* if */
+        if (*mid<pri) {
+          cptr=mid+2;           /* continue with the records above "mid" */
+          i--;
+        } /* if */
+      } /* for */
+      break;
+    } /* case */
+    case OP_SWITCH_TBL: {
+      cell *cptr=JUMPREL(cip)+1;/* +1, to skip the "jumptbl" opcode */
+      assert(*JUMPREL(cip)==OP_JUMPTBL);
+      offs=(cell)((ucell)pri-(ucell)*(cptr+2)); /* index in the jump table */
+      if ((ucell)offs<(ucell)*cptr)
+        cptr+=offs+3;           /* case found */
+      else
+        cptr+=1;                /* "none-matched" case */
+      cip=JUMPREL(cptr);
       break;
     } /* case */
     case OP_SWAP_PRI:
@@ -2822,10 +2904,31 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
       assert(*JUMPREL(cip)==OP_CASETBL_OVL);
       amx->ovl_index=*(cptr+1);   /* preset to "none-matched" case */
       i=(int)*cptr;               /* number of records in the case table */
-      for (cptr+=2; i>0 && *cptr!=pri; i--,cptr+=2)
-        /* nothing */;
-      if (i>0)
-        amx->ovl_index=*(cptr+1); /* case found */
+      for (cptr+=2; i>0; i>>=1) { /* binary search, see OP_SWITCH */
+        cell *mid=cptr+2*(i>>1);
+        if (*mid==pri) {
+          amx->ovl_index=*(mid+1);/* case found */
+          break;
+        } /* if */
+        if (*mid<pri) {
+          cptr=mid+2;
+          i--;
+        } /* if */
+      } /* for */
+      assert(amx->overlay!=NULL);
+      if ((i=amx->overlay(amx,amx->ovl_index))!=AMX_ERR_NONE)
+        ABORT(amx,i);
+      cip=(cell*)amx->code;
+      break;
+    } /* case */
+    case OP_SWITCH_TBL_OVL: {
+      cell *cptr=JUMPREL(cip)+1;  /* +1, to skip the "jumptbl.ovl" opcode */
+      assert(*JUMPREL(cip)==OP_JUMPTBL_OVL);
+      offs=(cell)((ucell)pri-(ucell)*(cptr+2)); /* index in the jump table */
+      if ((ucell)offs<(ucell)*cptr)
+        amx->ovl_index=*(cptr+offs+3); /* case found */
+      else
+        amx->ovl_index=*(cptr+1);      /* "none-matched" case */
       assert(amx->overlay!=NULL);
       if ((i=amx->overlay(amx,amx->ovl_index))!=AMX_ERR_NONE)
         ABORT(amx,i);
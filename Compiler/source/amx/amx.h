@@ -163,6 +163,7 @@ extern  "C" {
  *   9 macro opcodes
  *  10 position-independent code, overlays, packed instructions
  *  11 relocating instructions for the native interface, reorganized instruction set
+ *  12 jump tables for dense switches (JUMPTBL and JUMPTBL.OVL)
  * MIN_FILE_VERSION is the lowest file version number that the current AMX
  * implementation supports. If the AMX file header gets new fields, this number
  * often needs to be incremented. MIN_AMX_VERSION is the lowest AMX version that
@@ -171,9 +172,9 @@ extern  "C" {
  * The file version supported by the JIT may run behind MIN_AMX_VERSION. So
  * there is an extra constant for it: MAX_FILE_VER_JIT.
  */
-#define CUR_FILE_VERSION 11     /* current file version; also the current AMX version */
+#define CUR_FILE_VERSION 12     /* current file version; also the current AMX version */
 #define MIN_FILE_VERSION 11     /* lowest supported file format version for the current AMX version */
-#define MIN_AMX_VERSION  11     /* minimum AMX version needed to support the current file format */
+#define MIN_AMX_VERSION  12     /* minimum AMX version needed to support the current file format */
 #define MAX_FILE_VER_JIT 11     /* file version supported by the JIT */
 #define MIN_AMX_VER_JIT  11     /* AMX version supported by the JIT */
 
@@ -262,6 +263,21 @@ typedef struct tagOVERLAYINFO {
   int32_t size;             /* size in bytes */
 } PACKED AMX_OVERLAYINFO;
 
+/* Groups of overlays that are stored next to each other, so that a host can
+ * load a group with a single read. The table is optional; it ends just in
+ * front of the code block, with the AMX_OVLGROUPS trailer.
+ */
+typedef struct tagOVLGROUP {
+  int32_t offset;           /* offset relative to the start of the code block */
+  int32_t size;             /* size in bytes of all overlays in the group */
+} PACKED AMX_OVLGROUP;
+
+typedef struct tagOVLGROUPS {
+  int32_t count;            /* number of AMX_OVLGROUP entries before the trailer */
+  uint32_t magic;           /* AMX_OVLGROUP_MAGIC */
+} PACKED AMX_OVLGROUPS;
+#define AMX_OVLGROUP_MAGIC  0x53505247  /* "GRPS" */
+
 /* The AMX structure is the internal structure for many functions. Not all
  * fields are valid at all times; many fields are cached in local variables.
  */
@@ -340,6 +356,21 @@ typedef struct tagAMX_HEADER {
   #define AMX_MAGIC     AMX_MAGIC_64
 #endif
 
+/* Program metadata (name, icon, version), appended after all other blocks
+ * of the file. The block ends with the magic value, so that a launcher can
+ * find it with a single read at a fixed offset from the end of the file.
+ */
+typedef struct tagAMX_METADATA {
+  char name[32];            /* program name, zero-terminated */
+  uint32_t icon[32];        /* icon bitmap, one 32-pixel row per entry */
+  int32_t icon_rows;        /* number of rows in the icon, 0 if none */
+  int32_t version;          /* value of the constant "program_version", or 0 */
+  int32_t memory;           /* bytes of RAM needed to run the program */
+  int32_t size;             /* size of this structure */
+  uint32_t magic;           /* AMX_META_MAGIC */
+} PACKED AMX_METADATA;
+#define AMX_META_MAGIC  0x4154454d  /* "META" */
+
 enum {
   AMX_ERR_NONE,
   /* reserve the first 15 error codes for exit codes of the abstract machine */
@@ -983,26 +983,54 @@ OP_SYSREQ:
 
 OP_SWITCH:
         push    ecx
+        push    edx
         mov     ebp,esi         ; EBP = CIP
         add     ebp,[esi+4]     ; EBP = offset of the casetable
         add     ebp,4           ; skip the "OP_CASETBL" opcode
         mov     ecx,[ebp]       ; ECX = number of records
-        mov     esi,ebp         ; ESI = address of first record
+        mov     esi,ebp
         add     esi,[ebp+4]     ; preset ESI to "none-matched" case
-    op_switch_loop:
+        add     ebp,8           ; EBP = address of first record
+    op_switch_loop:             ; records are sorted, binary search
         or      ecx, ecx        ; number of records == 0?
         jz      short op_switch_end ; yes, no more records, exit loop
-        add     ebp,8           ; skip previous record
-        dec     ecx             ; already decrement cases to do
-        cmp     eax,[ebp]       ; PRI == case label?
-        jne     short op_switch_loop ; no, continue loop
-        mov     esi,ebp         ; yes, get jump address and exit loop
+        mov     edx,ecx
+        shr     edx,1           ; EDX = index of the middle record
+        cmp     eax,[ebp+8*edx] ; PRI == case label?
+        je      short op_switch_found
+        jl      short op_switch_below
+        lea     ebp,[ebp+8*edx+8] ; PRI above case label, continue above the middle
+        dec     ecx
+    op_switch_below:
+        shr     ecx,1           ; halve the number of records
+        jmp     short op_switch_loop
+    op_switch_found:
+        lea     ebp,[ebp+8*edx]
+        mov     esi,ebp         ; get jump address and exit loop
         add     esi,[ebp+4]
     op_switch_end:
+        pop     edx
         pop     ecx
         NEXT
 
 
+OP_SWITCH_TBL:
+        push    edx
+        mov     ebp,esi         ; EBP = CIP
+        add     ebp,[esi+4]     ; EBP = offset of the jump table
+        add     ebp,4           ; skip the "OP_JUMPTBL" opcode
+        mov     edx,eax
+        sub     edx,[ebp+8]     ; EDX = PRI - lowest case label = index
+        cmp     edx,[ebp]       ; index below number of entries (unsigned)?
+        jae     short op_switch_tbl_default ; no, use "none-matched" case
+        lea     ebp,[ebp+4*edx+8] ; EBP = address of entry - 4
+    op_switch_tbl_default:
+        mov     esi,ebp
+        add     esi,[ebp+4]     ; get jump address
+        pop     edx
+        NEXT
+
+
 OP_SWAP_PRI:
         mov     ebp,[edi+ecx]
         add     esi,4
@@ -1059,6 +1087,8 @@ OP_BREAK:
 
 OP_CASETBL:
 OP_CASETBL_OVL:
+OP_JUMPTBL:
+OP_JUMPTBL_OVL:
         mov     eax,AMX_ERR_INVINSTR
         jmp     _return
 
@@ -1213,16 +1243,25 @@ OP_SWITCH_OVL:
         add     ebp,4           ; skip the "OP_ICASETBL" opcode
         mov     ecx,[ebp]       ; ECX = number of records
         mov     edx,[ebp+4]     ; preset EDX to "none-matched" case
-    op_iswitch_loop:
+        add     ebp,8           ; EBP = address of first record
+    op_iswitch_loop:            ; binary search, see OP_SWITCH
         or      ecx, ecx        ; number of records == 0?
         jz      short op_iswitch_end ; yes, no more records, exit loop
-        add     ebp,8           ; skip previous record
-        dec     ecx             ; already decrement cases to do
-        cmp     eax,[ebp]       ; PRI == icase label?
-        jne     short op_iswitch_loop ; no, continue loop
-        mov     edx,[ebp+4]     ; yes, get jump address and exit loop
+        mov     esi,ecx
+        shr     esi,1           ; ESI = index of the middle record
+        cmp     eax,[ebp+8*esi] ; PRI == icase label?
+        je      short op_iswitch_found
+        jl      short op_iswitch_below
+        lea     ebp,[ebp+8*esi+8]
+        dec     ecx
+    op_iswitch_below:
+        shr     ecx,1
+        jmp     short op_iswitch_loop
+    op_iswitch_found:
+        mov     edx,[ebp+8*esi+4] ; get overlay index and exit loop
     op_iswitch_end:
         pop     ecx
+    op_iswitch_load:
         ;load overlay
         mov     eax,amx
         mov     [eax+_ovl_index],edx
@@ -1236,6 +1275,19 @@ OP_SWITCH_OVL:
         mov     code,esi        ; save new code base in local variable
         NEXT
 
+
+OP_SWITCH_TBL_OVL:
+        mov     ebp,esi         ; EBP = CIP
+        add     ebp,[esi+4]     ; EBP = offset of the jump table
+        add     ebp,4           ; skip the "OP_JUMPTBL_OVL" opcode
+        mov     edx,[ebp+4]     ; preset EDX to "none-matched" case
+        mov     esi,eax
+        sub     esi,[ebp+8]     ; ESI = PRI - lowest case label = index
+        cmp     esi,[ebp]       ; index below number of entries (unsigned)?
+        jae     op_iswitch_load ; no, load the "none-matched" overlay
+        mov     edx,[ebp+4*esi+12] ; get overlay index
+        jmp     op_iswitch_load
+
 %endif  ; AMX_NO_OVERLAY
 
 
@@ -2428,4 +2480,12 @@ opcodelist:
         DD      OP_HALT_P
         DD      OP_BOUNDS_P
 %endif  ; AMX_NO_PACKED_OPC
+        ; jump tables (numbered after the packed instructions)
+        times 175-($-opcodelist)/4 DD 0
+        DD      OP_SWITCH_TBL
+        DD      OP_JUMPTBL
+%ifndef AMX_NO_OVERLAY
+        DD      OP_SWITCH_TBL_OVL
+        DD      OP_JUMPTBL_OVL
+%endif  ; AMX_NO_OVERLAY
 opcodelist_end:
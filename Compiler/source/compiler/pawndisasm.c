@@ -45,6 +45,8 @@ cell do_jump(FILE *ftxt,const cell *params,cell opcode,cell cip);
 cell do_switch(FILE *ftxt,const cell *params,cell opcode,cell cip);
 cell casetbl(FILE *ftxt,const cell *params,cell opcode,cell cip);
 cell casetbl_ovl(FILE *ftxt,const cell *params,cell opcode,cell cip);
+cell jumptbl(FILE *ftxt,const cell *params,cell opcode,cell cip);
+cell jumptbl_ovl(FILE *ftxt,const cell *params,cell opcode,cell cip);
 
 
 typedef struct {
@@ -229,6 +231,10 @@ static OPCODE opcodelist[] = {
   {172, "fill.p",      parm1_p },
   {173, "halt.p",      parm1_p },
   {174, "bounds.p",    parm1_p },
+/*{175, "switch.tbl",  do_switch }, not generated by the compiler */
+  {176, "jumptbl",     jumptbl },
+/*{177, "switch.tbl.ovl", do_switch }, not generated by the compiler */
+  {178, "jumptbl.ovl", jumptbl_ovl },
 };
 
 void print_opcode(FILE *ftxt,cell opcode,cell cip)
@@ -403,6 +409,42 @@ cell casetbl_ovl(FILE *ftxt,const cell *params,cell opcode,cell cip)
   return 2*num+1;
 }
 
+cell jumptbl(FILE *ftxt,const cell *params,cell opcode,cell cip)
+{
+  cell num;
+  int idx;
+
+  print_opcode(ftxt,opcode,cip);
+  num=params[0];
+  print_param(ftxt,params[0],0);
+  print_param(ftxt,params[1]+cip+pc_cellsize,0);
+  print_param(ftxt,params[2],1);
+  for (idx=0; idx<num; idx++) {
+    fprintf(ftxt,"                  ");
+    print_param(ftxt,params[2]+idx,0);
+    print_param(ftxt,params[idx+3]+cip+(idx+3)*pc_cellsize,1);
+  } /* for */
+  return num+4;
+}
+
+cell jumptbl_ovl(FILE *ftxt,const cell *params,cell opcode,cell cip)
+{
+  cell num;
+  int idx;
+
+  print_opcode(ftxt,opcode,cip);
+  num=params[0];
+  print_param(ftxt,params[0],0);
+  print_param(ftxt,params[1],0);
+  print_param(ftxt,params[2],1);
+  for (idx=0; idx<num; idx++) {
+    fprintf(ftxt,"                  ");
+    print_param(ftxt,params[2]+idx,0);
+    print_param(ftxt,params[idx+3],1);
+  } /* for */
+  return num+4;
+}
+
 static void addchars(char *str,int64_t value,int pos)
 {
   int v,i;
@@ -57,6 +57,7 @@
 #define sCOMP_STACK   32    /* maximum nesting of #if .. #endif sections */
 #define sDEF_LITMAX   500   /* initial size of the literal pool, in "cells" */
 #define sDEF_AMXSTACK 4096  /* default stack size for AMX files */
+#define sDEF_OVLGROUP 2048  /* default size limit of an overlay group (bytes) */
 #define PREPROC_TERM  '\x7f'/* termination character for preprocessor expressions (the "DEL" code) */
 #define sDEF_PREFIX   "default.inc" /* default prefix filename */
 
@@ -124,6 +125,7 @@ typedef struct s_statelist {
 typedef struct s_symbol {
   struct s_symbol *next;
   struct s_symbol *parent;  /* hierarchical types (multi-dimensional arrays) */
+  struct s_symbol *hashnext;/* next symbol in the same hash bucket */
 
   char name[sNAMEMAX+1];
   uint32_t hash;        /* value derived from name, for quicker searching */
@@ -133,6 +135,7 @@ typedef struct s_symbol {
                          * starts (for a function, the start is in "addr" and the
                          * end is in "codeaddr") */
   int index;            /* overlay index number or index for native function */
+  int ovlgroup;         /* function: overlay group (see gen_ovlinfo()), 0 if none */
 
   char vclass;          /* sLOCAL if "addr" refers to a local symbol */
   char ident;           /* see below for possible values */
@@ -142,7 +145,7 @@ typedef struct s_symbol {
   int tag;              /* tagname id */
 
   union {
-    int declared;       /* label: how many local variables are declared */
+    int locals;         /* label: how many local variables are declared */
     constvalue *lib;    /* native function: library it is part of */
     long stacksize;     /* normal/public function: stack requirements */
     int enumlist;       /* enumerated constants: unique sequence number */
@@ -166,6 +169,8 @@ typedef struct s_symbol {
   int numrefers;        /* number of entries in the referrer list */
 
   char *documentation;  /* optional documentation string */
+  char *inlinecode;     /* function: body for inline expansion (or NULL) */
+  cell inlinesize;      /* function: size of the body for inline expansion */
 } symbol;
 
 
@@ -562,6 +567,8 @@ SC_FUNC int compare_consttable(constvalue *table1, constvalue *table2);
 SC_FUNC symbol *add_constant(const char *name,cell val,int vclass,int tag);
 SC_FUNC void exporttag(int tag);
 SC_FUNC void sc_attachdocumentation(symbol *sym,int onlylastblock);
+SC_FUNC void loopvar_write(symbol *sym);
+SC_FUNC int loopvar_inbounds(symbol *sym,cell high);
 
 /* function prototypes in SC2.C */
 #define PUSHSTK_P(v)  { stkitem s_; s_.pv=(v); pushstk(s_); }
@@ -593,6 +600,7 @@ SC_FUNC int alphanum(unsigned char c);
 SC_FUNC int ishex(char c);
 SC_FUNC void delete_symbol(symbol *root,symbol *sym);
 SC_FUNC void delete_symbols(symbol *root,int level,int del_labels,int delete_functions);
+SC_FUNC void rename_symbol(symbol *root,symbol *sym,const char *name);
 SC_FUNC int refer_symbol(symbol *entry,symbol *bywhom);
 SC_FUNC void markusage(symbol *sym,int usage);
 SC_FUNC uint32_t namehash(const char *name);
@@ -610,10 +618,15 @@ SC_FUNC char *itoh(ucell val);
 /* function prototypes in SC3.C */
 SC_FUNC int check_userop(void (*oper)(void),int tag1,int tag2,int numparam,
                          value *lval,int *resulttag);
+SC_FUNC int fold_userop(void (*oper)(void),int tag1,int tag2,cell val1,cell val2,
+                        cell *result,int *resulttag);
 SC_FUNC int matchtag(int formaltag,int actualtag,int allowcoerce);
 SC_FUNC int expression(cell *val,int *tag,symbol **symptr,int chkfuncresult);
 SC_FUNC int sc_getstateid(constvalue **automaton,constvalue **state,char *statename);
 SC_FUNC cell array_totalsize(symbol *sym);
+SC_FUNC int getexprform(symbol **sym,cell *value,int *index);
+SC_FUNC void resetexprform(void);
+SC_FUNC int purenative_find(const char *name);
 
 /* function prototypes in SC4.C */
 SC_FUNC void writeleader(symbol *root,int *lbl_nostate,int *lbl_ignorestate);
@@ -646,6 +659,7 @@ SC_FUNC void popreg(regid reg);
 SC_FUNC void swap1(void);
 SC_FUNC void ffswitch(int label,int iswitch);
 SC_FUNC void ffcase(cell value,int label,int newtable,int icase);
+SC_FUNC void ffcasetbl(constvalue *caselist,int deflabel,int icase);
 SC_FUNC void ffcall(symbol *sym,const char *label,int numargs);
 SC_FUNC void ffret(int remparams);
 SC_FUNC void ffabort(int reason);
@@ -717,7 +731,9 @@ SC_FUNC symbol *find_closestsymbol(const char *name,int symboltype);
 
 /* function prototypes in SC6.C */
 SC_FUNC ucell getparamvalue(const char *s,const char **n);
-SC_FUNC int assemble(FILE *fout,FILE *fin);
+SC_FUNC int asmcode_write(const char *str);
+SC_FUNC void asmcode_cleanup(void);
+SC_FUNC int assemble(FILE *fout);
 
 /* function prototypes in SC7.C */
 SC_FUNC ucell hex2ucell(const char *s,const char **n);
@@ -729,8 +745,12 @@ SC_FUNC void stgout(int index);
 SC_FUNC void stgdel(int index,cell code_index);
 SC_FUNC int stgget(int *index,cell *code_index);
 SC_FUNC void stgset(int onoff);
+SC_FUNC void inline_start(void);
+SC_FUNC void inline_finish(symbol *sym);
+SC_FUNC int inline_expand(symbol *sym,int index,cell code_index,int nargs);
 SC_FUNC int phopt_init(void);
 SC_FUNC int phopt_cleanup(void);
+SC_FUNC long phopt_time(void);
 
 /* function prototypes in SCLIST.C */
 SC_FUNC char* duplicatestring(const char* sourcestring);
@@ -807,84 +827,190 @@ SC_FUNC int state_conflict_id(int listid1,int listid2);
 SC_FUNC statelist *append_statelist(statelist *root,int id,int label,cell address);
 SC_FUNC void delete_statelisttable(statelist *root);
 
-/* external variables (defined in scvars.c) */
+/* compiler state (defined in scvars.c)
+ *
+ * All variables that are shared amongst the compiler files, plus the staging
+ * buffer and the label table, are gathered in a context. The macros below map
+ * the variable names onto the fields of the active context, "pc_ctx".
+ */
 #if !defined SC_SKIP_VDECL
-SC_VDECL symbol loctab;       /* local symbol table */
-SC_VDECL symbol glbtab;       /* global symbol table */
-SC_VDECL cell *litq;          /* the literal queue */
-SC_VDECL unsigned char *srcline;/* the line read from the input file */
-SC_VDECL const unsigned char *lptr;/* points to the current position in "srcline" */
-SC_VDECL constvalue tagname_tab;/* tagname table */
-SC_VDECL constvalue libname_tab;/* library table (#pragma library "..." syntax) */
-SC_VDECL constvalue *curlibrary;/* current library */
-SC_VDECL int pc_addlibtable;  /* is the library table added to the AMX file? */
-SC_VDECL constvalue ntvindex_tab;/* native function index table */
-SC_VDECL symbol *curfunc;     /* pointer to current function */
-SC_VDECL char *inpfname;      /* name of the file currently read from */
-SC_VDECL char outfname[];     /* intermediate (assembler) file name */
-SC_VDECL char binfname[];     /* binary file name */
-SC_VDECL char errfname[];     /* error file name */
-SC_VDECL char sc_ctrlchar;    /* the control character (or escape character) */
-SC_VDECL char sc_ctrlchar_org;/* the default control character */
-SC_VDECL int litidx;          /* index to literal table */
-SC_VDECL int litmax;          /* current size of the literal table */
-SC_VDECL int stgidx;          /* index to the staging buffer */
-SC_VDECL int sc_labnum;       /* number of (internal) labels */
-SC_VDECL int staging;         /* true if staging output */
-SC_VDECL cell declared;       /* number of local cells declared */
-SC_VDECL cell glb_declared;   /* number of global cells declared */
-SC_VDECL cell code_idx;       /* number of bytes with generated code */
-SC_VDECL int ntv_funcid;      /* incremental number of native function */
-SC_VDECL int errnum;          /* number of errors */
-SC_VDECL int warnnum;         /* number of warnings */
-SC_VDECL int sc_debug;        /* debug/optimization options (bit field) */
-SC_VDECL int sc_asmfile;      /* create .ASM file? */
-SC_VDECL int sc_listing;      /* create .LST file? */
-SC_VDECL int sc_needsemicolon;/* semicolon required to terminate expressions? */
-SC_VDECL int sc_dataalign;    /* data alignment value */
-SC_VDECL int sc_alignnext;    /* must frame of the next function be aligned? */
-SC_VDECL int pc_docexpr;      /* must expression be attached to documentation comment? */
-SC_VDECL int curseg;          /* 1 if currently parsing CODE, 2 if parsing DATA */
-SC_VDECL cell pc_stksize;     /* stack size */
-SC_VDECL cell pc_amxlimit;    /* abstract machine size limit (code + data, or only code) */
-SC_VDECL cell pc_amxram;      /* abstract machine data size limit */
-SC_VDECL int freading;        /* is there an input file ready for reading? */
-SC_VDECL int fline;           /* the line number in the current file */
-SC_VDECL short fnumber;       /* number of files in the input file table */
-SC_VDECL short fcurrent;      /* current file being processed */
-SC_VDECL short sc_intest;     /* true if inside a test */
-SC_VDECL int pc_sideeffect;   /* true if an expression causes a side-effect */
-SC_VDECL int pc_stmtindent;   /* current indent of the statement */
-SC_VDECL int indent_nowarn;   /* skip warning "217 loose indentation" */
-SC_VDECL int pc_tabsize;      /* number of spaces that a TAB represents */
-SC_VDECL int pc_matchedtabsize;/* if no tabsize explicitly set, try to detect the tab size */
-SC_VDECL short sc_allowtags;  /* allow/detect tagnames in lex() */
-SC_VDECL int sc_status;       /* read/write status */
-SC_VDECL int sc_rationaltag;  /* tag for rational numbers */
-SC_VDECL int rational_digits; /* number of fractional digits */
-SC_VDECL int sc_allowproccall;/* allow/detect tagnames in lex() */
-SC_VDECL short sc_is_utf8;    /* is this source file in UTF-8 encoding */
-SC_VDECL char *pc_deprecate;  /* if non-NULL, mark next declaration as deprecated */
-SC_VDECL int sc_curstates;    /* ID of the current state list */
-SC_VDECL int pc_optimize;     /* (peephole) optimization level */
-SC_VDECL int pc_memflags;     /* special flags for the stack/heap usage */
-SC_VDECL int pc_overlays;     /* generate overlay table + instructions? (abstract machine overay size limit) */
-SC_VDECL int pc_ovl0size[][2];/* size (in bytes) of the first (special) overlays */
-SC_VDECL int pc_cellsize;     /* size (in bytes) of a cell */
-SC_VDECL uint64_t pc_cryptkey;/* key for encryption of the generated script */
-
-SC_VDECL constvalue sc_automaton_tab; /* automaton table */
-SC_VDECL constvalue sc_state_tab;     /* state table */
-
-SC_VDECL FILE *inpf;          /* file read from (source or include) */
-SC_VDECL FILE *inpf_org;      /* main source file */
-SC_VDECL FILE *outf;          /* file written to */
-
-SC_VDECL jmp_buf errbuf;      /* target of longjmp() on a fatal error */
+typedef struct s_pccontext {
+  symbol loctab;        /* local symbol table */
+  symbol glbtab;        /* global symbol table */
+  cell *litq;           /* the literal queue */
+  unsigned char *srcline; /* the line read from the input file */
+  const unsigned char *lptr; /* points to the current position in "srcline" */
+  constvalue tagname_tab; /* tagname table */
+  constvalue libname_tab; /* library table (#pragma library "..." syntax) */
+  constvalue *curlibrary; /* current library */
+  int pc_addlibtable;   /* is the library table added to the AMX file? */
+  constvalue ntvindex_tab; /* native function index table */
+  constvalue purenative_tab; /* natives evaluated at compile time (#pragma pure) */
+  symbol *curfunc;      /* pointer to current function */
+  char *inpfname;       /* name of the file currently read from */
+  char outfname[_MAX_PATH]; /* intermediate (assembler) file name */
+  char binfname[_MAX_PATH]; /* binary file name */
+  char errfname[_MAX_PATH]; /* error file name */
+  char sc_ctrlchar;     /* the control character (or escape character) */
+  char sc_ctrlchar_org; /* the default control character */
+  int litidx;           /* index to literal table */
+  int litmax;           /* current size of the literal table */
+  int stgidx;           /* index to the staging buffer */
+  int sc_labnum;        /* number of (internal) labels */
+  int staging;          /* true if staging output */
+  cell declared;        /* number of local cells declared */
+  cell glb_declared;    /* number of global cells declared */
+  cell code_idx;        /* number of bytes with generated code */
+  int ntv_funcid;       /* incremental number of native function */
+  int errnum;           /* number of errors */
+  int warnnum;          /* number of warnings */
+  int sc_debug;         /* debug/optimization options (bit field) */
+  int sc_asmfile;       /* create .ASM file? */
+  int sc_listing;       /* create .LST file? */
+  int sc_needsemicolon; /* semicolon required to terminate expressions? */
+  int sc_dataalign;     /* data alignment value */
+  int sc_alignnext;     /* must frame of the next function be aligned? */
+  int pc_docexpr;       /* must expression be attached to documentation comment? */
+  int curseg;           /* 1 if currently parsing CODE, 2 if parsing DATA */
+  cell pc_stksize;      /* stack size */
+  cell pc_amxlimit;     /* abstract machine size limit (code + data, or only code) */
+  cell pc_amxram;       /* abstract machine data size limit */
+  int freading;         /* is there an input file ready for reading? */
+  int fline;            /* the line number in the current file */
+  short pc_filecount;   /* number of files in the input file table */
+  short fcurrent;       /* current file being processed */
+  short sc_intest;      /* true if inside a test */
+  int pc_sideeffect;    /* true if an expression causes a side-effect */
+  int pc_stmtindent;    /* current indent of the statement */
+  int indent_nowarn;    /* skip warning "217 loose indentation" */
+  int pc_tabsize;       /* number of spaces that a TAB represents */
+  int pc_matchedtabsize; /* if no tabsize explicitly set, try to detect the tab size */
+  short sc_allowtags;   /* allow/detect tagnames in lex() */
+  int sc_status;        /* read/write status */
+  int sc_rationaltag;   /* tag for rational numbers */
+  int rational_digits;  /* number of fractional digits */
+  int sc_allowproccall; /* allow/detect tagnames in lex() */
+  short sc_is_utf8;     /* is this source file in UTF-8 encoding */
+  char *pc_deprecate;   /* if non-NULL, mark next declaration as deprecated */
+  int sc_curstates;     /* ID of the current state list */
+  int pc_optimize;      /* (peephole) optimization level */
+  int pc_inline;        /* max. size (in cells) of functions to expand inline, -1 = default */
+  int pc_keepbounds;    /* keep bounds checks on array indices that are loop counters */
+  int pc_memflags;      /* special flags for the stack/heap usage */
+  int pc_overlays;      /* generate overlay table + instructions? (abstract machine overay size limit) */
+  int pc_ovl0size[ovlFIRST][2]; /* size (in bytes) of the first (special) overlays */
+  int pc_ovlgroups;     /* number of overlay groups in the output file */
+  long pc_ovlgroupsize; /* size (in bytes) of the largest overlay group */
+  int pc_cellsize;      /* size (in bytes) of a cell */
+  uint64_t pc_cryptkey; /* key for encryption of the generated script */
+
+  constvalue sc_automaton_tab; /* automaton table */
+  constvalue sc_state_tab; /* state table */
+
+  FILE *inpf;           /* file read from (source or include) */
+  FILE *inpf_org;       /* main source file */
+  FILE *outf;           /* file written to */
+
+  jmp_buf errbuf;       /* target of longjmp() on a fatal error */
+
+#if !defined PAWN_LIGHT
+  int sc_makereport;    /* generate a cross-reference report */
+#endif
 
+  /* code generator and assembler state (sc6.c, sc7.c) */
+  char *stgbuf;         /* the staging buffer */
+  int stgmax;           /* current size of the staging buffer */
+  char *stgpipe;        /* the stage pipe, a second staging buffer */
+  int pipemax;          /* current size of the stage pipe */
+  int pipeidx;          /* index to the stage pipe */
+  cell *lbltab;         /* label table */
+} pccontext;
+
+SC_VDECL pccontext *pc_ctx;   /* the active compiler context */
+
+#define loctab            (pc_ctx->loctab)
+#define glbtab            (pc_ctx->glbtab)
+#define litq              (pc_ctx->litq)
+#define srcline           (pc_ctx->srcline)
+#define lptr              (pc_ctx->lptr)
+#define tagname_tab       (pc_ctx->tagname_tab)
+#define libname_tab       (pc_ctx->libname_tab)
+#define curlibrary        (pc_ctx->curlibrary)
+#define pc_addlibtable    (pc_ctx->pc_addlibtable)
+#define ntvindex_tab      (pc_ctx->ntvindex_tab)
+#define purenative_tab    (pc_ctx->purenative_tab)
+#define curfunc           (pc_ctx->curfunc)
+#define inpfname          (pc_ctx->inpfname)
+#define outfname          (pc_ctx->outfname)
+#define binfname          (pc_ctx->binfname)
+#define errfname          (pc_ctx->errfname)
+#define sc_ctrlchar       (pc_ctx->sc_ctrlchar)
+#define sc_ctrlchar_org   (pc_ctx->sc_ctrlchar_org)
+#define litidx            (pc_ctx->litidx)
+#define litmax            (pc_ctx->litmax)
+#define stgidx            (pc_ctx->stgidx)
+#define sc_labnum         (pc_ctx->sc_labnum)
+#define staging           (pc_ctx->staging)
+#define declared          (pc_ctx->declared)
+#define glb_declared      (pc_ctx->glb_declared)
+#define code_idx          (pc_ctx->code_idx)
+#define ntv_funcid        (pc_ctx->ntv_funcid)
+#define errnum            (pc_ctx->errnum)
+#define warnnum           (pc_ctx->warnnum)
+#define sc_debug          (pc_ctx->sc_debug)
+#define sc_asmfile        (pc_ctx->sc_asmfile)
+#define sc_listing        (pc_ctx->sc_listing)
+#define sc_needsemicolon  (pc_ctx->sc_needsemicolon)
+#define sc_dataalign      (pc_ctx->sc_dataalign)
+#define sc_alignnext      (pc_ctx->sc_alignnext)
+#define pc_docexpr        (pc_ctx->pc_docexpr)
+#define curseg            (pc_ctx->curseg)
+#define pc_stksize        (pc_ctx->pc_stksize)
+#define pc_amxlimit       (pc_ctx->pc_amxlimit)
+#define pc_amxram         (pc_ctx->pc_amxram)
+#define freading          (pc_ctx->freading)
+#define fline             (pc_ctx->fline)
+#define pc_filecount      (pc_ctx->pc_filecount)
+#define fcurrent          (pc_ctx->fcurrent)
+#define sc_intest         (pc_ctx->sc_intest)
+#define pc_sideeffect     (pc_ctx->pc_sideeffect)
+#define pc_stmtindent     (pc_ctx->pc_stmtindent)
+#define indent_nowarn     (pc_ctx->indent_nowarn)
+#define pc_tabsize        (pc_ctx->pc_tabsize)
+#define pc_matchedtabsize (pc_ctx->pc_matchedtabsize)
+#define sc_allowtags      (pc_ctx->sc_allowtags)
+#define sc_status         (pc_ctx->sc_status)
+#define sc_rationaltag    (pc_ctx->sc_rationaltag)
+#define rational_digits   (pc_ctx->rational_digits)
+#define sc_allowproccall  (pc_ctx->sc_allowproccall)
+#define sc_is_utf8        (pc_ctx->sc_is_utf8)
+#define pc_deprecate      (pc_ctx->pc_deprecate)
+#define sc_curstates      (pc_ctx->sc_curstates)
+#define pc_optimize       (pc_ctx->pc_optimize)
+#define pc_inline         (pc_ctx->pc_inline)
+#define pc_keepbounds     (pc_ctx->pc_keepbounds)
+#define pc_memflags       (pc_ctx->pc_memflags)
+#define pc_overlays       (pc_ctx->pc_overlays)
+#define pc_ovl0size       (pc_ctx->pc_ovl0size)
+#define pc_ovlgroups      (pc_ctx->pc_ovlgroups)
+#define pc_ovlgroupsize   (pc_ctx->pc_ovlgroupsize)
+#define pc_cellsize       (pc_ctx->pc_cellsize)
+#define pc_cryptkey       (pc_ctx->pc_cryptkey)
+#define sc_automaton_tab  (pc_ctx->sc_automaton_tab)
+#define sc_state_tab      (pc_ctx->sc_state_tab)
+#define inpf              (pc_ctx->inpf)
+#define inpf_org          (pc_ctx->inpf_org)
+#define outf              (pc_ctx->outf)
+#define errbuf            (pc_ctx->errbuf)
 #if !defined PAWN_LIGHT
-  SC_VDECL int sc_makereport; /* generate a cross-reference report */
+  #define sc_makereport   (pc_ctx->sc_makereport)
 #endif
+#define stgbuf            (pc_ctx->stgbuf)
+#define stgmax            (pc_ctx->stgmax)
+#define stgpipe           (pc_ctx->stgpipe)
+#define pipemax           (pc_ctx->pipemax)
+#define pipeidx           (pc_ctx->pipeidx)
+#define lbltab            (pc_ctx->lbltab)
 
 #endif /* SC_SKIP_VDECL */
 
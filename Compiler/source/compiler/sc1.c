@@ -32,6 +32,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #if defined __WIN32__ || defined _WIN32 || defined __MSDOS__
   #include <conio.h>
@@ -113,6 +116,7 @@ static void doarg(char *name,int ident,int offset,int tags[],int numtags,
 static void make_report(symbol *root,FILE *log,char *sourcefile);
 static void reduce_referrers(symbol *root);
 static void gen_ovlinfo(symbol *root);
+static void group_overlays(symbol *root,int numoverlays);
 static long max_stacksize(symbol *root,int *recursion);
 static long max_overlaysize(symbol *root,char **funcname);
 static int checkundefined(symbol *root);
@@ -132,6 +136,8 @@ static int doif(void);
 static int dowhile(void);
 static int dodo(void);
 static int dofor(void);
+static int looprange(cell init,int testop,cell limit,int stepop,cell step,
+                     cell *low,cell *high);
 static void doswitch(void);
 static void dogoto(void);
 static void dolabel(void);
@@ -157,6 +163,16 @@ static int undefined_vars=FALSE;/* if TRUE, undefined symbols were found */
 static int pc_enumsequence=0;   /* sequence number of enumerated constant lists, for reporting these lists */
 static int wq[wqTABSZ];         /* "while queue", internal stack for nested loops */
 static int *wqptr;              /* pointer to next entry */
+static struct {                 /* counters of the active "for" loops with a known range */
+  symbol *sym;
+  cell low,high;                /* range of the counter in the loop body */
+  int safe;                     /* counter is not altered in the body (known from the first pass) */
+  int altered;                  /* counter is altered in the body (in the current pass) */
+} loopvars[wqTABSZ/wqSIZE];
+static int loopvar_count=0;     /* number of entries in loopvars[] */
+static constvalue looprange_tab = { NULL, "", 0, 0}; /* "for" loops, value is TRUE if the counter is not altered in the body */
+static long bounds_removed=0;   /* number of bounds checks dropped for loop counters */
+static char ovlprofile[_MAX_PATH];/* overlay switch counts from a previous run (option -P) */
 #if !defined PAWN_LIGHT
   static char sc_rootpath[_MAX_PATH]; /* base path of the installation */
   static char sc_binpath[_MAX_PATH];  /* path for the binaries, often sc_rootpath + /bin */
@@ -229,6 +245,82 @@ static char *prefix[3]={ "error", "fatal error", "warning" };
   return 0;
 }
 
+/* Source files are read into memory the first time that they are opened
+ * and kept until the end of the compilation, because the compiler reads the
+ * main file and every include file again on each pass. An entry is reloaded
+ * if the modification time of the file has changed.
+ */
+typedef struct s_srccache {
+  struct s_srccache *next;
+  char *name;
+  time_t mtime;
+  char *text;
+  size_t size;
+} srccache;
+
+typedef struct s_srcfile {
+  FILE *fp;             /* for files opened for writing */
+  srccache *src;        /* for files opened for reading */
+  size_t pos;
+  int eof;
+} srcfile;
+
+static srccache *srccache_list=NULL;
+
+static srccache *srccache_load(const char *filename)
+{
+  struct stat st;
+  srccache *src;
+  FILE *fp;
+
+  if (stat(filename,&st)!=0 || (st.st_mode & S_IFMT)==S_IFDIR)
+    return NULL;
+  for (src=srccache_list; src!=NULL; src=src->next)
+    if (strcmp(src->name,filename)==0)
+      break;
+  if (src!=NULL && src->mtime==st.st_mtime)
+    return src;
+
+  if ((fp=fopen(filename,"r"))==NULL)
+    return NULL;
+  if (src==NULL) {
+    if ((src=(srccache*)malloc(sizeof(srccache)))==NULL
+        || (src->name=duplicatestring(filename))==NULL) {
+      free(src);
+      fclose(fp);
+      return NULL;
+    } /* if */
+    src->text=NULL;
+    src->next=srccache_list;
+    srccache_list=src;
+  } /* if */
+  /* the file size is an upper limit, text mode reads may return fewer bytes */
+  free(src->text);
+  src->size=0;
+  src->mtime=st.st_mtime;
+  if ((src->text=(char*)malloc((size_t)st.st_size+1))!=NULL)
+    src->size=fread(src->text,1,(size_t)st.st_size,fp);
+  fclose(fp);
+  if (src->text==NULL) {
+    src->mtime=0;       /* force a reload on the next attempt */
+    return NULL;
+  } /* if */
+  return src;
+}
+
+static void srccache_clear(void)
+{
+  srccache *src;
+
+  while (srccache_list!=NULL) {
+    src=srccache_list;
+    srccache_list=src->next;
+    free(src->name);
+    free(src->text);
+    free(src);
+  } /* while */
+}
+
 /* pc_opensrc()
  * Opens a source file (or include file) for reading. The "file" does not have
  * to be a physical file, one might compile from memory.
@@ -243,7 +335,18 @@ static char *prefix[3]={ "error", "fatal error", "warning" };
  */
 void *pc_opensrc(char *filename)
 {
-  return fopen(filename,"r");
+  srccache *src;
+  srcfile *file;
+
+  if ((src=srccache_load(filename))==NULL)
+    return NULL;
+  if ((file=(srcfile*)malloc(sizeof(srcfile)))==NULL)
+    return NULL;
+  file->fp=NULL;
+  file->src=src;
+  file->pos=0;
+  file->eof=FALSE;
+  return file;
 }
 
 /* pc_createsrc()
@@ -260,7 +363,18 @@ void *pc_opensrc(char *filename)
  */
 void *pc_createsrc(char *filename)
 {
-  return fopen(filename,"w");
+  srcfile *file;
+
+  if ((file=(srcfile*)malloc(sizeof(srcfile)))==NULL)
+    return NULL;
+  if ((file->fp=fopen(filename,"w"))==NULL) {
+    free(file);
+    return NULL;
+  } /* if */
+  file->src=NULL;
+  file->pos=0;
+  file->eof=FALSE;
+  return file;
 }
 
 /* pc_closesrc()
@@ -269,8 +383,12 @@ void *pc_createsrc(char *filename)
  */
 void pc_closesrc(void *handle)
 {
-  assert(handle!=NULL);
-  fclose((FILE*)handle);
+  srcfile *file=(srcfile*)handle;
+
+  assert(file!=NULL);
+  if (file->fp!=NULL)
+    fclose(file->fp);
+  free(file);
 }
 
 /* pc_readsrc()
@@ -279,7 +397,32 @@ void pc_closesrc(void *handle)
  */
 char *pc_readsrc(void *handle,unsigned char *target,int maxchars)
 {
-  return fgets((char*)target,maxchars,(FILE*)handle);
+  srcfile *file=(srcfile*)handle;
+  const char *text,*eol;
+  size_t count,avail;
+
+  assert(file!=NULL && file->src!=NULL);
+  assert(maxchars>0);
+  /* same as fgets(): stop after a newline or when the buffer is full, flag
+   * the end of the file only after an attempt to read beyond it
+   */
+  text=file->src->text+file->pos;
+  avail=file->src->size-file->pos;
+  count=(size_t)maxchars-1;
+  if (count>avail) {
+    count=avail;
+    file->eof=TRUE;
+  } /* if */
+  if ((eol=(const char*)memchr(text,'\n',count))!=NULL) {
+    count=(size_t)(eol-text)+1;
+    file->eof=FALSE;
+  } /* if */
+  if (count==0 && maxchars>1)
+    return NULL;
+  memcpy(target,text,count);
+  target[count]='\0';
+  file->pos+=count;
+  return (char*)target;
 }
 
 /* pc_writesrc()
@@ -288,11 +431,14 @@ char *pc_readsrc(void *handle,unsigned char *target,int maxchars)
  */
 int pc_writesrc(void *handle,const unsigned char *source)
 {
-  return fputs((char*)source,(FILE*)handle) >= 0;
+  srcfile *file=(srcfile*)handle;
+
+  assert(file!=NULL && file->fp!=NULL);
+  return fputs((char*)source,file->fp) >= 0;
 }
 
 #define MAXPOSITIONS  4
-static fpos_t srcpositions[MAXPOSITIONS];
+static size_t srcpositions[MAXPOSITIONS];
 static unsigned char srcposalloc[MAXPOSITIONS];
 
 void pc_clearpossrc(void)
@@ -303,6 +449,8 @@ void pc_clearpossrc(void)
 
 void *pc_getpossrc(void *handle,void *position)
 {
+  srcfile *file=(srcfile*)handle;
+
   if (position==NULL) {
     /* allocate a new slot */
     int i;
@@ -317,7 +465,7 @@ void *pc_getpossrc(void *handle,void *position)
     /* use the gived slot */
     assert(position>=(void*)srcpositions && position<(void*)((char*)srcpositions+sizeof(srcpositions)));
   } /* if */
-  fgetpos((FILE*)handle,(fpos_t*)position);
+  *(size_t*)position=file->pos;
   return position;
 }
 
@@ -327,15 +475,21 @@ void *pc_getpossrc(void *handle,void *position)
  */
 void pc_resetsrc(void *handle,void *position)
 {
-  assert(handle!=NULL);
+  srcfile *file=(srcfile*)handle;
+
+  assert(file!=NULL);
   assert(position!=NULL);
-  fsetpos((FILE*)handle,(fpos_t*)position);
+  file->pos=*(size_t*)position;
+  file->eof=FALSE;      /* like fsetpos(), this clears the end-of-file flag */
   /* note: the item is not cleared from the pool */
 }
 
 int pc_eofsrc(void *handle)
 {
-  return feof((FILE*)handle);
+  srcfile *file=(srcfile*)handle;
+
+  assert(file!=NULL);
+  return file->eof;
 }
 
 /* should return a pointer, which is used as a "magic cookie" to all I/O
@@ -454,6 +608,7 @@ int pc_compile(int argc, char *argv[])
     int hdrsize=0;
   #endif
   char *ptr;
+  clock_t starttime=clock();
 
   /* set global variables to their initial value */
   binf=NULL;
@@ -553,13 +708,16 @@ int pc_compile(int argc, char *argv[])
   if (inpf_org==NULL)
     error(100,inpfname);
   freading=TRUE;
-  outf=(FILE*)pc_openasm(outfname); /* first write to assembler file (may be temporary) */
-  if (outf==NULL)
-    error(101,outfname);
-  /* immediately open the binary file, for other programs to check */
+  /* immediately open the output file, for other programs to check; the code
+   * for the binary file is kept in memory, there is no intermediate file
+   */
   if (sc_asmfile || sc_listing) {
+    outf=(FILE*)pc_openasm(outfname);
+    if (outf==NULL)
+      error(101,outfname);
     binf=NULL;
   } else {
+    outf=NULL;
     binf=(FILE*)pc_openbin(binfname);
     if (binf==NULL)
       error(101,binfname);
@@ -685,14 +843,13 @@ cleanup:
   /* write the binary file (the file is already open) */
   if (!(sc_asmfile || sc_listing) && errnum==0 && jmpcode==0) {
     assert(binf!=NULL);
-    pc_resetasm(outf);          /* flush and loop back, for reading */
     #if !defined PAWN_LIGHT
       hdrsize=
     #endif
-    assemble(binf,outf);        /* assembler file is now input */
+    assemble(binf);
   } /* if */
   if (outf!=NULL) {
-    pc_closeasm(outf,!(sc_asmfile || sc_listing));
+    pc_closeasm(outf,FALSE);
     outf=NULL;
   } /* if */
   if (binf!=NULL) {
@@ -711,7 +868,7 @@ cleanup:
       if (pc_overlays==0)
         totalsize+=(long)code_idx;
       else if (pc_overlays==1)
-        totalsize+=max_ovlsize;
+        totalsize+=(max_ovlsize>pc_ovlgroupsize) ? max_ovlsize : pc_ovlgroupsize;
       else
         totalsize+=pc_overlays;
       if (pc_amxram==0)
@@ -725,11 +882,15 @@ cleanup:
           pc_printf("\n");
         pc_printf("Header size:       %8lu bytes\n",(long)hdrsize);
         pc_printf("Code size:         %8lu bytes\n",(long)code_idx);
+        if (verbosity>=2 && (sc_debug & sCHKBOUNDS)!=0)
+          pc_printf("Bounds checks:     %8lu removed on loop counters\n",bounds_removed);
         if (pc_overlays>0) {
           if (pc_overlays>1)
             pc_printf("Max. overlay size: %8lu bytes; largest overlay=%ld bytes\n",(long)pc_overlays,(long)max_ovlsize);
           else
             pc_printf("Largest overlay:   %8lu bytes\n",(long)max_ovlsize);
+          if (verbosity>=2 && pc_ovlgroups>0)
+            pc_printf("Overlay groups:    %8d; largest group=%ld bytes\n",pc_ovlgroups,pc_ovlgroupsize);
         } /* if */
         pc_printf("Data size:         %8lu bytes\n",(long)glb_declared*pc_cellsize);
         pc_printf("Stack/heap size:   %8lu bytes; ",(long)pc_stksize*pc_cellsize);
@@ -745,6 +906,9 @@ cleanup:
           pc_printf(" plus %lu bytes for data/stack",(long)(glb_declared+pc_stksize)*pc_cellsize);
         pc_printf("\n");
       } /* if */
+      if (verbosity>=3)
+        pc_printf("Compile time:      %8lu ms; peephole optimizer=%lu ms\n",
+                  (long)((clock()-starttime)*1000/CLOCKS_PER_SEC),phopt_time());
       if (pc_overlays>1 && max_ovlsize>pc_overlays) {
         char symname[2*sNAMEMAX+16];  /* allow space for user defined operators */
         assert(max_ovlname!=NULL);
@@ -785,11 +949,15 @@ cleanup:
     assert(inpfname!=NULL && (int)inpfname!=-1);
     free(inpfname);
     assert(inpf!=NULL && (int)inpf!=-1);
-    fclose(inpf);
+    pc_closesrc(inpf);
   } /* if */
   lexinit(TRUE);                          /* reset and release buffers */
   phopt_cleanup();
   stgbuffer_cleanup();
+  asmcode_cleanup();
+  #if !defined NO_MAIN
+    srccache_clear();
+  #endif
   clearstk();
   assert(jmpcode!=0 || loctab.next==NULL);/* on normal flow, local symbols
                                            * should already have been deleted */
@@ -799,8 +967,10 @@ cleanup:
   delete_consttable(&tagname_tab);
   delete_consttable(&libname_tab);
   delete_consttable(&ntvindex_tab);
+  delete_consttable(&purenative_tab);
   delete_consttable(&sc_automaton_tab);
   delete_consttable(&sc_state_tab);
+  delete_consttable(&looprange_tab);
   state_deletetable();
   delete_aliastable();
   delete_pathtable();
@@ -909,7 +1079,7 @@ static void resetglobals(void)
   curseg=0;             /* 1 if currently parsing CODE, 2 if parsing DATA */
   freading=FALSE;       /* no input file ready yet */
   fline=0;              /* the line number in the current file */
-  fnumber=0;            /* the file number in the file table (debugging) */
+  pc_filecount=0;       /* the file number in the file table (debugging) */
   fcurrent=0;           /* current file being processed (debugging) */
   sc_intest=FALSE;      /* true if inside a test */
   pc_sideeffect=0;      /* true if an expression causes a side-effect */
@@ -924,6 +1094,9 @@ static void resetglobals(void)
   sc_curstates=0;
   pc_memflags=0;
   pc_enumsequence=0;
+  loopvar_count=0;
+  bounds_removed=0;
+  pc_keepbounds=FALSE;
 }
 
 static void initglobals(void)
@@ -943,6 +1116,7 @@ static void initglobals(void)
   verbosity=1;          /* verbosity level, no copyright banner */
   sc_debug=sCHKBOUNDS;  /* by default: bounds checking+assertions */
   pc_optimize=sOPTIMIZE_CORE;
+  pc_inline=-1;         /* inline limit follows the optimization level */
   sc_needsemicolon=FALSE;/* semicolon required to terminate expressions? */
   pc_cellsize=4;        /* default cell size = 4 bytes, 32-bits */
   sc_dataalign=pc_cellsize;
@@ -956,6 +1130,9 @@ static void initglobals(void)
   rational_digits=0;    /* number of fractional digits */
   undefined_vars=FALSE; /* if TRUE, undefined symbols were found */
   pc_overlays=0;        /* do not generate for overlays */
+  ovlprofile[0]='\0';   /* no overlay profile */
+  pc_ovlgroups=0;
+  pc_ovlgroupsize=0;
   for (i=0; i<ovlFIRST; i++)
     pc_ovl0size[i][0]=pc_ovl0size[i][1]=0;
   pc_cryptkey=0;
@@ -971,6 +1148,7 @@ static void initglobals(void)
   tagname_tab.next=NULL;/* tagname table */
   libname_tab.next=NULL;/* library table (#pragma library "..." syntax) */
   ntvindex_tab.next=NULL;
+  purenative_tab.next=NULL;
 
   lptr=NULL;            /* points to the current position in "srcline" */
   curlibrary=NULL;      /* current library */
@@ -1182,6 +1360,9 @@ static void parseoptions(int argc,char **argv,char *oname,char *ename,char *pnam
       case 'p':
         strlcpy(pname,option_value(ptr),_MAX_PATH); /* set name of implicit include file */
         break;
+      case 'P':
+        strlcpy(ovlprofile,option_value(ptr),_MAX_PATH); /* set name of the overlay profile */
+        break;
 #if !defined PAWN_LIGHT
       case 'r':
         strlcpy(rname,option_value(ptr),_MAX_PATH); /* set name of report file */
@@ -1576,6 +1757,7 @@ static void about(void)
     pc_printf("             2    supplemental instruction set\n");
     pc_printf("             3    full instruction set (packed opcodes)\n");
     pc_printf("         -p<name> set name of the \"prefix\" file\n");
+    pc_printf("         -P<name> overlay profile, to group the overlays that call each other most\n");
 #if !defined PAWN_LIGHT
     pc_printf("         -r[name] write cross reference report to console or to specified file\n");
 #endif
@@ -1584,7 +1766,7 @@ static void about(void)
     pc_printf("         -t<num>  TAB indent size (in character positions, default=%d)\n",pc_tabsize);
     pc_printf("         -T<name> set name of the configuration file to use\n");
     pc_printf("         -V<num>  generate overlay code and instructions; set buffer size\n");
-    pc_printf("         -v<num>  verbosity level; 0=quiet, 1=normal, 2=verbose (default=%d)\n",verbosity);
+    pc_printf("         -v<num>  verbosity level; 0=quiet, 1=normal, 2=verbose, 3=timing (default=%d)\n",verbosity);
     pc_printf("         -w<num>  disable a specific warning by its number\n");
     pc_printf("         -X<num>  abstract machine size limit in bytes\n");
     pc_printf("         -XD<num> abstract machine data/stack size limit in bytes\n");
@@ -2504,7 +2686,10 @@ static int declloc(int fstatic)
         /* simple variable, also supports initialization */
         int ctag = tag;         /* set to "tag" by default */
         int explicit_init=FALSE;/* is the variable explicitly initialized? */
+        int initindex=0;
+        cell initcidx=0,initval;
         if (matchtoken('=')) {
+          stgget(&initindex,&initcidx);
           doexpr(FALSE,FALSE,FALSE,FALSE,&ctag,NULL,TRUE);
           explicit_init=TRUE;
         } else {
@@ -2515,7 +2700,15 @@ static int declloc(int fstatic)
         lval.ident=iVARIABLE;
         lval.constval=0;
         lval.tag=tag;
-        check_userop(NULL,ctag,lval.tag,2,NULL,&ctag);
+        if (explicit_init && getexprform(NULL,&initval,NULL)==tNUMBER
+            && fold_userop(NULL,ctag,lval.tag,initval,0,&initval,&ctag))
+        {
+          /* the conversion operator is a "pure" native, store the converted value */
+          stgdel(initindex,initcidx);
+          ldconst(initval,sPRI);
+        } else {
+          check_userop(NULL,ctag,lval.tag,2,NULL,&ctag);
+        } /* if */
         store(&lval);
         markexpr(sEXPR,NULL,0); /* full expression ends after the store */
         assert(staging);        /* end staging phase (optimize expression) */
@@ -3509,8 +3702,7 @@ static int operatoradjust(int opertok,symbol *sym,char *opername,int resulttag)
         refer_symbol(sym,oldsym->refer[i]);
     delete_symbol(&glbtab,oldsym);
   } /* if */
-  strcpy(sym->name,tmpname);
-  sym->hash=namehash(sym->name);/* calculate new hash */
+  rename_symbol(&glbtab,sym,tmpname);
 
   /* operators should return a value, except the '~' operator */
   if (opertok!='~')
@@ -3958,6 +4150,8 @@ static int newfunc(char *firstname,int firsttag,int fpublic,int fstatic,int stoc
     } /* while */
   } /* if */
   startfunc(sym->name,ovl_index); /* creates stack frame */
+  if (!fpublic && state_id==0 && opertok==0)
+    inline_start();     /* keep the code of small functions for inlining */
   insert_dbgline(funcline);
   setline(FALSE);
   if (sc_alignnext) {
@@ -4006,6 +4200,7 @@ static int newfunc(char *firstname,int firsttag,int fpublic,int fstatic,int stoc
     } /* if */
   } /* if */
   endfunc();
+  inline_finish(sym);
   /* for normal functions, set the end address of the function symbol; for
    * for functions with states, adjust the endaddr field for the particular
    * state (these fields are needed for overlays)
@@ -4314,6 +4509,7 @@ static void doarg(char *name,int ident,int offset,int tags[],int numtags,
   arg->defvalue.val=0;          /* clear */
   arg->defvalue_tag=0;
   arg->numdim=0;
+  usage=0;
   matchbrace=0;
   if (matchtoken('['))
     matchbrace=']';
@@ -5053,7 +5249,211 @@ static void gen_ovlinfo(symbol *root)
         } /* if */
       } /* if */
     } /* for */
+    if (pc_optimize>sOPTIMIZE_NONE)
+      group_overlays(root,idx);
+  } /* if */
+}
+
+/* Functions that can share an overlay group: no state functions, because
+ * these are reached through the state tables, and no entry functions.
+ */
+static int groupable(const symbol *sym)
+{
+  return sym->ident==iFUNCTN && sym->parent==NULL && sym->states==NULL
+         && (sym->usage & uNATIVE)==0 && (sym->usage & (uREAD | uPUBLIC))!=0
+         && (sym->usage & uDEFINE)!=0 && strcmp(sym->name,uENTRYFUNC)!=0;
+}
+
+typedef struct {
+  int a,b;              /* indices in the function list, a<b */
+  long weight;          /* number of calls (from the profile), or 1 */
+  long size;            /* combined size of both functions */
+} ovledge;
+
+static int cmp_edgepair(const void *p1,const void *p2)
+{
+  const ovledge *e1=(const ovledge *)p1;
+  const ovledge *e2=(const ovledge *)p2;
+  if (e1->a!=e2->a)
+    return (e1->a<e2->a) ? -1 : 1;
+  return (e1->b<e2->b) ? -1 : (e1->b>e2->b);
+}
+
+static int cmp_edgeweight(const void *p1,const void *p2)
+{
+  const ovledge *e1=(const ovledge *)p1;
+  const ovledge *e2=(const ovledge *)p2;
+  if (e1->weight!=e2->weight)
+    return (e1->weight>e2->weight) ? -1 : 1;
+  if (e1->size!=e2->size)
+    return (e1->size<e2->size) ? -1 : 1;
+  return cmp_edgepair(p1,p2);
+}
+
+/* Read the overlay profile; this is a text file that a host writes after a
+ * run of the program, with the line "overlays <count>" and then one line
+ * "<from> <to> <switches>" per pair of overlay indices. The switches are
+ * added to the weight of the matching call graph edges. Returns FALSE if the
+ * profile belongs to a different program.
+ */
+static int read_ovlprofile(const char *filename,int numoverlays,const int *ovlfunc,
+                           ovledge *edges,int numedges)
+{
+  FILE *fp;
+  int count,from,to;
+  long switches;
+  ovledge key,*edge;
+
+  if ((fp=fopen(filename,"r"))==NULL)
+    error(100,filename);        /* error reading input file */
+  if (fscanf(fp," overlays %d",&count)!=1 || count!=numoverlays) {
+    fclose(fp);
+    return FALSE;
+  } /* if */
+  while (fscanf(fp,"%d %d %ld",&from,&to,&switches)==3) {
+    if (from<0 || from>=numoverlays || to<0 || to>=numoverlays) {
+      fclose(fp);
+      return FALSE;
+    } /* if */
+    if (ovlfunc[from]<0 || ovlfunc[to]<0 || from==to)
+      continue;
+    key.a=(ovlfunc[from]<ovlfunc[to]) ? ovlfunc[from] : ovlfunc[to];
+    key.b=(ovlfunc[from]<ovlfunc[to]) ? ovlfunc[to] : ovlfunc[from];
+    edge=(ovledge *)bsearch(&key,edges,numedges,sizeof(ovledge),cmp_edgepair);
+    if (edge!=NULL)
+      edge->weight+=switches;
+  } /* while */
+  fclose(fp);
+  return TRUE;
+}
+
+/* Group the overlay functions that call each other, so that the assembler
+ * stores every group as one block and the host can load it with one read
+ * (see assemble()). The edges of the call graph are merged heaviest first,
+ * as long as the group fits in half the overlay pool, so that a caller from
+ * outside the group still fits next to it. The sizes of the functions are
+ * those of the previous pass; the assembler checks the groups again.
+ */
+static void group_overlays(symbol *root,int numoverlays)
+{
+  symbol *sym,**funcs;
+  int *ovlfunc,*parent,*members,*groupid;
+  ovledge *edges;
+  int numfuncs,numedges,numgroups,i,j,a,b;
+  long limit,*size;
+
+  numfuncs=numedges=0;
+  for (sym=root->next; sym!=NULL; sym=sym->next) {
+    if (groupable(sym)) {
+      numfuncs++;
+      numedges+=sym->numrefers;
+    } /* if */
+  } /* for */
+  if (numfuncs<2 || numedges==0)
+    return;
+
+  funcs=(symbol **)malloc(numfuncs*sizeof(symbol*));
+  ovlfunc=(int *)malloc(numoverlays*sizeof(int));
+  parent=(int *)malloc(numfuncs*sizeof(int));
+  members=(int *)malloc(numfuncs*sizeof(int));
+  groupid=(int *)malloc(numfuncs*sizeof(int));
+  size=(long *)malloc(numfuncs*sizeof(long));
+  edges=(ovledge *)malloc(numedges*sizeof(ovledge));
+  if (funcs==NULL || ovlfunc==NULL || parent==NULL || members==NULL
+      || groupid==NULL || size==NULL || edges==NULL)
+    error(103);                 /* insufficient memory */
+  for (i=0; i<numoverlays; i++)
+    ovlfunc[i]=-1;
+  i=0;
+  for (sym=root->next; sym!=NULL; sym=sym->next) {
+    if (groupable(sym)) {
+      assert(sym->index>=0 && sym->index<numoverlays);
+      sym->ovlgroup=0;
+      ovlfunc[sym->index]=i;
+      funcs[i]=sym;
+      parent[i]=i;
+      members[i]=1;
+      groupid[i]=0;
+      size[i]=(long)(sym->codeaddr-sym->addr);
+      i++;
+    } /* if */
+  } /* for */
+
+  /* collect the call graph (the referrers of a function are its callers),
+   * without direction and without duplicate edges
+   */
+  numedges=0;
+  for (i=0; i<numfuncs; i++) {
+    for (j=0; j<funcs[i]->numrefers; j++) {
+      sym=funcs[i]->refer[j];
+      if (sym==NULL || sym==funcs[i] || !groupable(sym))
+        continue;
+      a=ovlfunc[sym->index];
+      assert(a>=0 && funcs[a]==sym);
+      edges[numedges].a=(a<i) ? a : i;
+      edges[numedges].b=(a<i) ? i : a;
+      edges[numedges].weight=0;
+      numedges++;
+    } /* for */
+  } /* for */
+  qsort(edges,numedges,sizeof(ovledge),cmp_edgepair);
+  for (i=j=0; i<numedges; i++)
+    if (j==0 || cmp_edgepair(&edges[j-1],&edges[i])!=0)
+      edges[j++]=edges[i];
+  numedges=j;
+
+  /* weigh the edges; without a profile, every call counts the same, with a
+   * profile, calls that did not happen are not worth a group
+   */
+  if (strlen(ovlprofile)==0 || !read_ovlprofile(ovlprofile,numoverlays,ovlfunc,edges,numedges)) {
+    if (strlen(ovlprofile)>0)
+      error(239,ovlprofile);    /* profile does not match the program */
+    for (i=0; i<numedges; i++)
+      edges[i].weight=1;
   } /* if */
+  for (i=j=0; i<numedges; i++) {
+    if (edges[i].weight>0) {
+      edges[j]=edges[i];
+      edges[j].size=size[edges[j].a]+size[edges[j].b];
+      j++;
+    } /* if */
+  } /* for */
+  numedges=j;
+  qsort(edges,numedges,sizeof(ovledge),cmp_edgeweight);
+
+  /* merge the groups at both ends of every edge, while the group fits */
+  limit=(pc_overlays>1) ? pc_overlays/2 : sDEF_OVLGROUP;
+  for (i=0; i<numedges; i++) {
+    for (a=edges[i].a; parent[a]!=a; a=parent[a])
+      parent[a]=parent[parent[a]];
+    for (b=edges[i].b; parent[b]!=b; b=parent[b])
+      parent[b]=parent[parent[b]];
+    if (a!=b && size[a]+size[b]<=limit) {
+      parent[b]=a;
+      size[a]+=size[b];
+      members[a]+=members[b];
+    } /* if */
+  } /* for */
+
+  /* number the groups that have two functions or more */
+  numgroups=0;
+  for (i=0; i<numfuncs; i++) {
+    for (a=i; parent[a]!=a; a=parent[a])
+      /* nothing */;
+    if (members[a]>1) {
+      if (groupid[a]==0)
+        groupid[a]=++numgroups;
+      funcs[i]->ovlgroup=groupid[a];
+    } /* if */
+  } /* for */
+
+  free(funcs);
+  free(ovlfunc);
+  free(parent);
+  free(members);
+  free(groupid);
+  free(size);
+  free(edges);
 }
 
 #if !defined PAWN_LIGHT
@@ -5964,11 +6364,22 @@ static int dofor(void)
   int save_nestlevel,save_endlessloop,skiplab;
   int index,endtok;
   int *ptr;
+  char key[sNAMEMAX+1];
+  symbol *counter,*sym;
+  cell init,limit,step,low,high;
+  int testop,stepop,start,idx;
+  constvalue *range;
 
   save_decl=declared;
   save_nestlevel=nestlevel;
   save_endlessloop=endlessloop;
 
+  /* the position of the "for" keyword identifies the loop in all passes */
+  sprintf(key,"%x:%x:%x",fcurrent,fline,(int)(lptr-srcline));
+  counter=NULL;
+  init=limit=step=0;
+  testop=stepop=0;
+
   addwhile(wq);
   skiplab=getlabel();
   endtok= matchtoken('(') ? ')' : tDO;
@@ -5979,9 +6390,18 @@ static int dofor(void)
        * 'compound statement' level of it own.
        */
       nestlevel++;
+      resetexprform();
       declloc(FALSE); /* declare local variable */
+      /* a single variable with a constant initial value may be a counter */
+      sym=loctab.next;
+      if (sym!=NULL && sym->compound==nestlevel
+          && (sym->next==NULL || sym->next->compound!=nestlevel)
+          && getexprform(NULL,&init,NULL)==tNUMBER)
+        counter=sym;
     } else {
       doexpr(TRUE,TRUE,TRUE,TRUE,NULL,NULL,FALSE);  /* expression 1 */
+      if (getexprform(&sym,&init,NULL)=='=')
+        counter=sym;
       needtoken(';');
     } /* if */
   } /* if */
@@ -6011,18 +6431,56 @@ static int dofor(void)
   if (matchtoken(';')) {
     endlessloop=1;
   } else {
+    start=stgidx;
     endlessloop=test(wq[wqEXIT],FALSE,FALSE);/* expression 2 (jump to wq[wqEXIT] if false) */
+    testop=getexprform(&sym,&limit,&idx);
+    if (sym!=counter || idx!=start)
+      testop=0;                     /* not a test on the counter (alone) */
     needtoken(';');
   } /* if */
   stgmark((char)(sEXPRSTART+1));    /* mark start of 3th expression in stage */
   if (!matchtoken(endtok)) {
+    start=stgidx;
     doexpr(TRUE,TRUE,TRUE,TRUE,NULL,NULL,FALSE);    /* expression 3 */
+    stepop=getexprform(&sym,&step,&idx);
+    if (sym!=counter || idx!=start)
+      stepop=0;                     /* not a step of the counter (alone) */
     needtoken(endtok);
   } /* if */
   stgmark(sENDREORDER);             /* mark end of reversed evaluation */
   stgout(index);
   stgset(FALSE);                    /* stop staging */
+  /* if the loop counter is a plain local variable, and if it stays within a
+   * known range, the bounds checks on array indices in the body may be
+   * dropped; this requires that the counter is not altered in the body, which
+   * is only known after the body is parsed, so the result is taken from the
+   * first pass
+   */
+  if (counter!=NULL && counter->ident==iVARIABLE && counter->vclass==sLOCAL
+      && counter->tag==0 && looprange(init,testop,limit,stepop,step,&low,&high))
+  {
+    assert(loopvar_count<sizearray(loopvars));
+    loopvars[loopvar_count].sym=counter;
+    loopvars[loopvar_count].low=low;
+    loopvars[loopvar_count].high=high;
+    range=find_constval(&looprange_tab,key,-1);
+    loopvars[loopvar_count].safe= (sc_status==statWRITE && range!=NULL && range->value);
+    loopvars[loopvar_count].altered=FALSE;
+    loopvar_count++;
+  } else {
+    counter=NULL;
+  } /* if */
   statement(NULL,FALSE);
+  if (counter!=NULL) {
+    loopvar_count--;
+    assert(loopvar_count>=0 && loopvars[loopvar_count].sym==counter);
+    if (sc_status==statFIRST) {
+      if ((range=find_constval(&looprange_tab,key,-1))==NULL)
+        append_constval(&looprange_tab,key,!loopvars[loopvar_count].altered,0);
+      else if (loopvars[loopvar_count].altered)
+        range->value=FALSE;
+    } /* if */
+  } /* if */
   jumplabel(wq[wqLOOP]);
   setlabel(wq[wqEXIT]);
   delwhile();
@@ -6045,6 +6503,92 @@ static int dofor(void)
   return index;
 }
 
+/*  looprange
+ *
+ *  Determines the range of the counter of a "for" loop in the body of the
+ *  loop, from the initial value of the counter, the test "counter <testop>
+ *  limit" and the step "counter <stepop> step". A loop that counts up must
+ *  test the upper bound and a loop that counts down must test the lower
+ *  bound. Returns FALSE if the loop does not have one of these forms, or if
+ *  the counter could overflow.
+ */
+static int looprange(cell init,int testop,cell limit,int stepop,cell step,
+                     cell *low,cell *high)
+{
+  cell cellmax=(cell)(((ucell)1<<(pc_cellsize*8-1))-1);
+  cell cellmin=-cellmax-1;
+
+  if (stepop==tINC || stepop==tDEC)
+    step=1;
+  if (init<cellmin || init>cellmax || limit<cellmin || limit>cellmax || step<=0 || step>cellmax)
+    return FALSE;
+  if (stepop==tINC || stepop==taADD) {
+    if (testop=='<' && limit>cellmin)
+      *high=limit-1;
+    else if (testop==tlLE)
+      *high=limit;
+    else
+      return FALSE;
+    if (*high>cellmax-step)
+      return FALSE;             /* counter could wrap around */
+    *low=init;
+  } else if (stepop==tDEC || stepop==taSUB) {
+    if (testop=='>' && limit<cellmax)
+      *low=limit+1;
+    else if (testop==tlGE)
+      *low=limit;
+    else
+      return FALSE;
+    if (*low<cellmin+step)
+      return FALSE;             /* counter could wrap around */
+    *high=init;
+  } else {
+    return FALSE;
+  } /* if */
+  return TRUE;
+}
+
+/*  loopvar_write
+ *
+ *  Called when a variable is assigned to (or passed by reference), to flag
+ *  that the range of a loop counter does not hold in the loop body. When
+ *  "sym" is NULL, this holds for all counters of the active loops. Any array
+ *  index with the counter that follows keeps its bounds check, also if the
+ *  first pass had found the counter safe.
+ */
+SC_FUNC void loopvar_write(symbol *sym)
+{
+  int i;
+
+  for (i=0; i<loopvar_count; i++) {
+    if (sym==NULL || loopvars[i].sym==sym) {
+      loopvars[i].altered=TRUE;
+      loopvars[i].safe=FALSE;
+    } /* if */
+  } /* for */
+}
+
+/*  loopvar_inbounds
+ *
+ *  Returns TRUE if the array index "sym" is the counter of an enclosing "for"
+ *  loop whose range falls within 0..high, so that the run-time bounds check
+ *  may be dropped.
+ */
+SC_FUNC int loopvar_inbounds(symbol *sym,cell high)
+{
+  int i;
+
+  if (sym==NULL || pc_keepbounds || pc_optimize==sOPTIMIZE_NONE || (sc_debug & sCHKBOUNDS)==0)
+    return FALSE;
+  for (i=loopvar_count-1; i>=0 && loopvars[i].sym!=sym; i--)
+    /* nothing */;
+  if (i<0 || !loopvars[i].safe || loopvars[i].low<0 || loopvars[i].high>high)
+    return FALSE;
+  assert(sc_status==statWRITE);
+  bounds_removed++;
+  return TRUE;
+}
+
 /* The switch statement is incompatible with its C sibling:
  * 1. the cases are not drop through
  * 2. only one instruction may appear below each case, use a compound
@@ -6060,7 +6604,7 @@ static int dofor(void)
 static void doswitch(void)
 {
   int lbl_table,lbl_exit,lbl_case;
-  int swdefault,casecount;
+  int swdefault;
   int tok;
   cell val;
   char *str;
@@ -6081,7 +6625,6 @@ static void doswitch(void)
   needtoken('{');
   lbl_exit=getlabel();          /* get label number for jumping out of switch */
   swdefault=FALSE;
-  casecount=0;
   do {
     tok=lex(&val,&str);         /* read in (new) token */
     switch (tok) {
@@ -6092,8 +6635,6 @@ static void doswitch(void)
       PUSHSTK_I(sc_allowtags);
       sc_allowtags=FALSE; /* do not allow tagnames here */
       do {
-        casecount++;
-
         /* ??? enforce/document that, in a switch, a statement cannot start
          *     with a label. Then, you can search for:
          *     * the first semicolon (marks the end of a statement)
@@ -6130,7 +6671,6 @@ static void doswitch(void)
           if (end<=val)
             error(50);                  /* invalid range */
           while (++val<=end) {
-            casecount++;
             /* find the new insertion point */
             for (csp=&caselist, cse=caselist.next;
                  cse!=NULL && cse->value<val;
@@ -6190,10 +6730,7 @@ static void doswitch(void)
     /* lbl_case holds the label of the "default" clause */
     label=lbl_case;
   } /* if */
-  ffcase(casecount,label,TRUE,FALSE);
-  /* generate the rest of the table */
-  for (cse=caselist.next; cse!=NULL; cse=cse->next)
-    ffcase(cse->value,strtol(cse->name,NULL,16),FALSE,FALSE);
+  ffcasetbl(caselist.next,label,FALSE);
 
   setlabel(lbl_exit);
   delete_consttable(&caselist); /* clear list of case labels */
@@ -6264,6 +6801,10 @@ static void dolabel(void)
     error(221,st);      /* label name shadows tagname */
   sym=fetchlab(st);
   setlabel((int)sym->addr);
+  /* a "goto" to this label may enter a loop without passing the test of
+   * the loop, so the range of the loop counters is no longer known
+   */
+  loopvar_write(NULL);
   /* since one can jump around variable declarations or out of compound
    * blocks, the stack must be manually adjusted
    */
@@ -6287,11 +6828,11 @@ static symbol *fetchlab(char *name)
   if (sym) {
     if (sym->ident!=iLABEL)
       error_suggest(19,sym->name,iLABEL);  /* not a label: ... */
-    //??? if this is a label definition, update sym->nestlevel and sym->x.declared
+    //??? if this is a label definition, update sym->nestlevel and sym->x.locals
   } else {
     sym=addsym(name,getlabel(),iLABEL,sLOCAL,0,0);
     assert(sym!=NULL);          /* fatal error 103 must be given on error */
-    sym->x.declared=(int)declared;
+    sym->x.locals=(int)declared;
     sym->compound=nestlevel;
   } /* if */
   return sym;
@@ -36,7 +36,7 @@
 #define RAWMODE         0x1
 #define UTF8MODE        0x2
 #define ISPACKED        0x4
-static cell litchar(const unsigned char **lptr,int flags);
+static cell litchar(const unsigned char **str,int flags);
 static symbol *find_symbol(const symbol *root,const char *name,int fnumber,int automaton);
 
 static void substallpatterns(unsigned char *line,int buffersize);
@@ -156,9 +156,9 @@ static char *extensions[] = { ".inc", ".p", ".pawn" };
   if (inpfname==NULL)
     error(103);                 /* insufficient memory */
   inpf=fp;                      /* set input file pointer to include file */
-  fnumber++;
+  pc_filecount++;
   fline=0;                      /* set current line number to 0 */
-  fcurrent=fnumber;
+  fcurrent=pc_filecount;
   icomment=0;                   /* not in a comment */
   insert_dbgfile(inpfname);     /* attach to debug information */
   insert_inputfile(inpfname);   /* save for the error system */
@@ -209,12 +209,12 @@ SC_FUNC int plungefile(char *name,int try_currentpath,int try_includepaths)
   return result;
 }
 
-static void check_empty(const unsigned char *lptr)
+static void check_empty(const unsigned char *str)
 {
   /* verifies that the string contains only whitespace */
-  while (*lptr<=' ' && *lptr!='\0')
-    lptr++;
-  if (*lptr!='\0')
+  while (*str<=' ' && *str!='\0')
+    str++;
+  if (*str!='\0')
     error(38);          /* extra characters on line */
 }
 
@@ -1119,6 +1119,14 @@ static int command(void)
           lptr=(unsigned char*)strchr((char*)lptr,'\0'); /* skip to end (ignore "extra characters on line") */
         } else if (strcmp(str,"dynamic")==0) {
           preproc_expr(&pc_stksize,NULL);
+        } else if (strcmp(str,"inline")==0) {
+          cell val;
+          preproc_expr(&val,NULL);
+          pc_inline=(int)val;   /* max. size of functions to expand inline, 0 = off */
+        } else if (strcmp(str,"keepbounds")==0) {
+          cell val;
+          preproc_expr(&val,NULL);
+          pc_keepbounds=(int)val; /* keep bounds checks on loop counters */
         } else if (strcmp(str,"library")==0) {
           char name[sNAMEMAX+1];
           while (*lptr<=' ' && *lptr!='\0')
@@ -1149,6 +1157,28 @@ static int command(void)
           sym=findconst("overlaysize");
           assert(sym!=NULL);
           sym->addr=val;
+        } else if (strcmp(str,"pure")==0) {
+          char name[sNAMEMAX+1];
+          int i,id,comma;
+          do {
+            /* get the name */
+            while (*lptr<=' ' && *lptr!='\0')
+              lptr++;
+            for (i=0; i<sizearray(name) && alphanum(*lptr); i++,lptr++)
+              name[i]=*lptr;
+            name[i]='\0';
+            /* only natives for which the compiler has an implementation */
+            if ((id=purenative_find(name))==0)
+              error(240,name);    /* native cannot be evaluated at compile time */
+            else if (find_constval(&purenative_tab,name,-1)==NULL)
+              append_constval(&purenative_tab,name,id,0);
+            /* see if a comma follows the name */
+            while (*lptr<=' ' && *lptr!='\0')
+              lptr++;
+            comma= (*lptr==',');
+            if (comma)
+              lptr++;
+          } while (comma);
         } else if (strcmp(str,"rational")==0) {
           char name[sNAMEMAX+1];
           cell digits=0;
@@ -1724,18 +1754,18 @@ static void substallpatterns(unsigned char *line,int buffersize)
  *
  *  The function returns 1 if an ellipsis was found and 0 if not
  */
-static int scanellipsis(const unsigned char *lptr)
+static int scanellipsis(const unsigned char *str)
 {
   static void *inpfmark=NULL;
   unsigned char *localbuf;
   short localcomment,found;
 
   /* first look for the ellipsis in the remainder of the string */
-  while (*lptr<=' ' && *lptr!='\0')
-    lptr++;
-  if (lptr[0]=='.' && lptr[1]=='.' && lptr[2]=='.')
+  while (*str<=' ' && *str!='\0')
+    str++;
+  if (str[0]=='.' && str[1]=='.' && str[2]=='.')
     return 1;
-  if (*lptr!='\0')
+  if (*str!='\0')
     return 0;           /* stumbled on something that is not an ellipsis and not white-space */
 
   /* the ellipsis was not on the active line, read more lines from the current
@@ -1752,13 +1782,13 @@ static int scanellipsis(const unsigned char *lptr)
   /* read from the file, skip preprocessing, but strip off comments */
   while (!found && pc_readsrc(inpf,localbuf,sLINEMAX)!=NULL) {
     stripcom(localbuf);
-    lptr=localbuf;
+    str=localbuf;
     /* skip white space */
-    while (*lptr<=' ' && *lptr!='\0')
-      lptr++;
-    if (lptr[0]=='.' && lptr[1]=='.' && lptr[2]=='.')
+    while (*str<=' ' && *str!='\0')
+      str++;
+    if (str[0]=='.' && str[1]=='.' && str[2]=='.')
       found=1;
-    else if (*lptr!='\0')
+    else if (*str!='\0')
       break;                       /* stumbled on something that is not an ellipsis and not white-space */
   } /* while */
 
@@ -2510,12 +2540,12 @@ SC_FUNC void litinsert(cell value,int pos)
  *        replaced by another character; the syntax '\ddd' is supported,
  *        but ddd must be decimal!
  */
-static cell litchar(const unsigned char **lptr,int flags)
+static cell litchar(const unsigned char **str,int flags)
 {
   cell c=0;
   const unsigned char *cptr;
 
-  cptr=*lptr;
+  cptr=*str;
   if ((flags & RAWMODE)!=0 || *cptr!=sc_ctrlchar) {  /* no escape character */
     #if !defined PAWN_NO_UTF8
       if (sc_is_utf8 && (flags & UTF8MODE)!=0) {
@@ -2603,7 +2633,7 @@ static cell litchar(const unsigned char **lptr,int flags)
       } /* switch */
     } /* if */
   } /* if */
-  *lptr=cptr;
+  *str=cptr;
   assert(c>=0);
   return c;
 }
@@ -2636,6 +2666,37 @@ SC_FUNC int ishex(char c)
   return (c>='0' && c<='9') || (c>='a' && c<='f') || (c>='A' && c<='F');
 }
 
+/* Both symbol tables are also indexed with a hash table on the name. In the
+ * lists, a new symbol always comes before any older symbol with the same name
+ * (see add_symbol()), so inserting new symbols at the head of the bucket
+ * keeps symbols with equal names in the same order as in the list. Lookups
+ * therefore find the same symbol as a walk through the list would.
+ */
+#define sGLBHASH  2048  /* number of buckets, must be a power of 2 */
+#define sLOCHASH  256
+
+static symbol *glbhash[sGLBHASH];
+static symbol *lochash[sLOCHASH];
+
+static symbol **hash_bucket(const symbol *root,uint32_t hash)
+{
+  if (root==&glbtab)
+    return &glbhash[hash & (sGLBHASH-1)];
+  assert(root==&loctab);
+  return &lochash[hash & (sLOCHASH-1)];
+}
+
+static void unlink_hash(const symbol *root,symbol *sym)
+{
+  symbol **link=hash_bucket(root,sym->hash);
+  while (*link!=sym) {
+    assert(*link!=NULL);
+    link=&(*link)->hashnext;
+  } /* while */
+  *link=sym->hashnext;
+  sym->hashnext=NULL;
+}
+
 /* The local variable table must be searched backwards, so that the deepest
  * nesting of local variables is searched first. The simplest way to do
  * this is to insert all new items at the head of the list.
@@ -2645,6 +2706,7 @@ SC_FUNC int ishex(char c)
 static symbol *add_symbol(symbol *root,symbol *entry,int sort)
 {
   symbol *newsym;
+  symbol **bucket=hash_bucket(root,entry->hash);
 
   if (sort)
     while (root->next!=NULL && strcmp(entry->name,root->next->name)>0)
@@ -2657,6 +2719,8 @@ static symbol *add_symbol(symbol *root,symbol *entry,int sort)
   memcpy(newsym,entry,sizeof(symbol));
   newsym->next=root->next;
   root->next=newsym;
+  newsym->hashnext=*bucket;
+  *bucket=newsym;
   return newsym;
 }
 
@@ -2709,26 +2773,58 @@ static void free_symbol(symbol *sym)
   free(sym->refer);
   if (sym->documentation!=NULL)
     free(sym->documentation);
+  if (sym->inlinecode!=NULL)
+    free(sym->inlinecode);
   free(sym);
 }
 
 SC_FUNC void delete_symbol(symbol *root,symbol *sym)
 {
+  symbol *prev=root;
+
   /* find the symbol and its predecessor
    * (this function assumes that you will never delete a symbol that is not
    * in the table pointed at by "root")
    */
   assert(root!=sym);
-  while (root->next!=sym) {
-    root=root->next;
-    assert(root!=NULL);
+  while (prev->next!=sym) {
+    prev=prev->next;
+    assert(prev!=NULL);
   } /* while */
 
   /* unlink it, then free it */
-  root->next=sym->next;
+  prev->next=sym->next;
+  unlink_hash(root,sym);
   free_symbol(sym);
 }
 
+/*  rename_symbol
+ *
+ *  Changes the name of a symbol. The symbol keeps its position in the list,
+ *  and it is moved into the hash bucket of the new name before any symbol
+ *  with the same name that follows it in the list.
+ */
+SC_FUNC void rename_symbol(symbol *root,symbol *sym,const char *name)
+{
+  symbol **link;
+  symbol *ptr;
+
+  unlink_hash(root,sym);
+  assert(strlen(name)<=sNAMEMAX);
+  strcpy(sym->name,name);
+  sym->hash=namehash(name);
+  for (link=hash_bucket(root,sym->hash); *link!=NULL; link=&(*link)->hashnext) {
+    if ((*link)->hash==sym->hash && strcmp((*link)->name,name)==0) {
+      for (ptr=sym->next; ptr!=NULL && ptr!=*link; ptr=ptr->next)
+        /* nothing */;
+      if (ptr!=NULL)
+        break;          /* this symbol follows "sym" in the list */
+    } /* if */
+  } /* for */
+  sym->hashnext=*link;
+  *link=sym;
+}
+
 SC_FUNC void delete_symbols(symbol *root,int level,int delete_labels,int delete_functions)
 {
   symbol *base;
@@ -2802,6 +2898,7 @@ SC_FUNC void delete_symbols(symbol *root,int level,int delete_labels,int delete_
       } /* while */
       if (count==0) {
         base->next=sym->next;
+        unlink_hash(root,sym);
         free_symbol(sym);
       } else {
         /* chain has changed */
@@ -2837,23 +2934,22 @@ SC_FUNC void delete_symbols(symbol *root,int level,int delete_labels,int delete_
 }
 
 /* The purpose of the hash is to reduce the frequency of a "name"
- * comparison (which is costly). There is little interest in avoiding
- * clusters in similar names, which is why this function is plain simple.
+ * comparison (which is costly), and to select the bucket in the hash
+ * tables of the symbol lists (FNV-1a).
  */
 SC_FUNC uint32_t namehash(const char *name)
 {
   const unsigned char *ptr=(const unsigned char *)name;
-  int len=strlen(name);
-  if (len==0)
-    return 0L;
-  assert(len<256);
-  return (len<<24Lu) + (ptr[0]<<16Lu) + (ptr[len-1]<<8Lu) + (ptr[len>>1Lu]);
+  uint32_t hash=2166136261u;
+  while (*ptr!='\0')
+    hash=(hash ^ *ptr++)*16777619u;
+  return hash;
 }
 
 static symbol *find_symbol(const symbol *root,const char *name,int fnumber,int automaton)
 {
-  symbol *sym=root->next;
-  unsigned long hash=namehash(name);
+  uint32_t hash=namehash(name);
+  symbol *sym=*hash_bucket(root,hash);
   while (sym!=NULL) {
     if (hash==sym->hash && strcmp(name,sym->name)==0        /* check name */
         && sym->parent==NULL                                /* sub-types (hierarchical types) are skipped */
@@ -2867,7 +2963,7 @@ static symbol *find_symbol(const symbol *root,const char *name,int fnumber,int a
         return sym;   /* return first match */
       } /* if */
     } /*  */
-    sym=sym->next;
+    sym=sym->hashnext;
   } /* while */
   return NULL;
 }
@@ -2933,8 +3029,10 @@ SC_FUNC void markusage(symbol *sym,int usage)
 {
   assert(sym!=NULL);
   sym->usage |= (char)usage;
-  if ((usage & uWRITTEN)!=0)
+  if ((usage & uWRITTEN)!=0) {
     sym->lnumber=fline;
+    loopvar_write(sym);   /* the range of a loop counter may no longer hold */
+  } /* if */
   /* check if (global) reference must be added to the symbol */
   if ((usage & (uREAD | uWRITTEN))!=0) {
     /* only do this for global symbols */
@@ -35,6 +35,8 @@ static void plnge2(void (*oper)(void),void (*arrayoper)(cell),
                    int (*hier)(value *lval),
                    value *lval1,value *lval2);
 static cell calc(cell left,void (*oper)(),cell right,char *boolresult);
+static int purecall(symbol *sym,int numargs,const cell *args,cell *result);
+static int fold_divisor(int tag1,int tag2,cell *divisor);
 static int hier14(value *lval);
 static int hier13(value *lval);
 static int hier12(value *lval);
@@ -56,11 +58,22 @@ static int skiptotoken(int token);
 static int dbltest(void (*oper)(),value *lval1,value *lval2);
 static int commutative(void (*oper)());
 static int constant(value *lval);
+static void setexprform(symbol *sym,int oper,cell value,int index);
 
 static char lastsymbol[sNAMEMAX+1]; /* name of last function/variable */
 static int bitwise_opercount;   /* count of bitwise operators in an expression */
 static int decl_heap=0;
 
+/* the "form" of the last expression, if it is a simple comparison, assignment
+ * or increment of a variable with a constant; the analysis of "for" loops uses
+ * it (see getexprform()) */
+static struct {
+  symbol *sym;          /* the variable, NULL for a constant expression */
+  int oper;             /* operator token, or 0 if there is no simple form */
+  cell value;           /* the constant operand */
+  int start,end;        /* code of the expression in the staging buffer */
+} exprform;
+
 /* Function addresses of binary operators for signed operations */
 static void (* const op1[17])(void) = {
   os_mult,os_div,os_mod,        /* hier3, index 0 */
@@ -620,15 +633,18 @@ static int plnge(const int *opstr,int opoff,int (*hier)(value *lval),value *lval
  */
 static int plnge_rel(const int *opstr,int opoff,int (*hier)(value *lval),value *lval)
 {
-  int lvalue,opidx;
+  int lvalue,opidx,start;
   value lval2={0};
   int count;
+  symbol *sym;
 
   /* this function should only be called for relational operators */
   assert(op1[opoff]==os_le);
+  start=stgidx;
   lvalue=plnge1(hier,lval);
   if (nextop(&opidx,opstr)==0)
     return lvalue;              /* no operator in "opstr" found */
+  sym= (lvalue && lval->ident==iVARIABLE && lval->tag==0) ? lval->sym : NULL;
   if (lvalue)
     rvalue(lval);
   count=0;
@@ -649,6 +665,8 @@ static int plnge_rel(const int *opstr,int opoff,int (*hier)(value *lval),value *
     plnge2(op1[opidx],op2[opidx],hier,lval,&lval2);
     if (count++>0)
       relop_suffix();
+    else if (sym!=NULL && lval2.ident==iCONSTEXPR && lval2.tag==0)
+      setexprform(sym,opstr[opidx-opoff],lval2.constval,start);
   } while (nextop(&opidx,opstr)); /* enddo */
   lval->constval=lval->boolresult;
   lval->tag=pc_addtag("bool");    /* force tag to be "bool" */
@@ -699,6 +717,8 @@ static void plnge2(void (*oper)(void),void (*arrayoper)(cell),
     if (plnge1(hier,lval2))
       rvalue(lval2);
     if (lval2->ident==iCONSTEXPR) { /* constant on right side */
+      if (oper==os_div && fold_divisor(lval1->tag,lval2->tag,&lval2->constval))
+        oper=os_mult;               /* multiply by the reciprocal instead */
       if (commutative(oper)) {      /* test for commutative operators */
         value lvaltmp = {0};
         stgdel(index,cidx);         /* scratch pushreg() and constant fetch (then
@@ -757,7 +777,13 @@ static void plnge2(void (*oper)(void),void (*arrayoper)(cell),
     /* check whether an "operator" function is defined for the tag names
      * (a constant expression cannot be optimized in that case)
      */
-    if (check_userop(oper,lval1->tag,lval2->tag,2,NULL,&lval1->tag)) {
+    if (lval1->ident==iCONSTEXPR && lval2->ident==iCONSTEXPR
+        && fold_userop(oper,lval1->tag,lval2->tag,lval1->constval,lval2->constval,
+                       &lval1->constval,&lval1->tag))
+    {
+      stgdel(index,cidx);       /* scratch generated code, the "pure" operator
+                                 * was evaluated */
+    } else if (check_userop(oper,lval1->tag,lval2->tag,2,NULL,&lval1->tag)) {
       lval1->ident=iEXPRESSION;
       lval1->constval=0;
     } else if (lval1->ident==iCONSTEXPR && lval2->ident==iCONSTEXPR) {
@@ -841,10 +867,284 @@ static cell calc(cell left,void (*oper)(),cell right,char *boolresult)
   return 0;
 }
 
+/* Natives that the compiler can evaluate at compile time, once they are
+ * declared "pure" with "#pragma pure". These are the fixed point natives of
+ * fixed.inc; the implementations below match those of libfixmath (with
+ * rounding and with saturation on overflow), so that folding a constant
+ * expression gives the same result as evaluating it at run time.
+ */
+enum {
+  pnNONE,
+  pnFIXED,
+  pnFROUND,
+  pnFADD,
+  pnFSUB,
+  pnFMUL,
+  pnFDIV,
+};
+
+static const struct {
+  char *name;
+  int numargs;
+} purenatives[] = {     /* in the order of the identifiers above */
+  { "fixed", 1 },
+  { "fround", 1 },
+  { "fadd", 2 },
+  { "fsub", 2 },
+  { "fmul", 2 },
+  { "fdiv", 2 },
+};
+
+#define FIX16_ONE       0x00010000L
+#define FIX16_MAX       ((int32_t)0x7fffffffL)
+#define FIX16_MIN       ((int32_t)0x80000000L)
+#define FIX16_OVERFLOW  FIX16_MIN
+
+static int32_t fix16_add(int32_t a,int32_t b)
+{
+  uint32_t sum=(uint32_t)a+(uint32_t)b;
+
+  /* overflow only if both operands have the same sign and the sum has not */
+  if (((a ^ b) & 0x80000000L)==0 && (((uint32_t)a ^ sum) & 0x80000000L)!=0)
+    return FIX16_OVERFLOW;
+  return (int32_t)sum;
+}
+
+static int32_t fix16_sub(int32_t a,int32_t b)
+{
+  uint32_t diff=(uint32_t)a-(uint32_t)b;
+
+  if (((a ^ b) & 0x80000000L)!=0 && (((uint32_t)a ^ diff) & 0x80000000L)!=0)
+    return FIX16_OVERFLOW;
+  return (int32_t)diff;
+}
+
+static int32_t fix16_mul(int32_t a,int32_t b)
+{
+  int64_t product=(int64_t)a*b;
+  uint32_t upper=(uint32_t)(product>>47);   /* the upper 17 bits should all be the sign */
+
+  if (product<0) {
+    if (~upper)
+      return FIX16_OVERFLOW;
+    product--;          /* to round -1/2 correctly */
+  } else if (upper) {
+    return FIX16_OVERFLOW;
+  } /* if */
+  return (int32_t)((uint32_t)(product>>16)+(uint32_t)((product & 0x8000)>>15));
+}
+
+static int32_t fix16_div(int32_t a,int32_t b)
+{
+  uint32_t remainder,divider,quotient,div;
+  int bitpos,shift;
+  int32_t result;
+
+  if (b==0)
+    return FIX16_MIN;
+  remainder= (a>=0) ? (uint32_t)a : 0-(uint32_t)a;
+  divider= (b>=0) ? (uint32_t)b : 0-(uint32_t)b;
+  quotient=0;
+  bitpos=17;
+  /* for large divisors, start with a lower estimate of the result */
+  if ((divider & 0xfff00000L)!=0) {
+    quotient=remainder/((divider>>17)+1);
+    remainder-=(uint32_t)(((uint64_t)quotient*divider)>>17);
+  } /* if */
+  /* if the divisor is divisible by 2^n, take advantage of it */
+  while ((divider & 0xf)==0 && bitpos>=4) {
+    divider>>=4;
+    bitpos-=4;
+  } /* while */
+  while (remainder!=0 && bitpos>=0) {
+    /* shift the remainder as much as possible without overflowing */
+    for (shift=0; shift<bitpos && (remainder & 0x80000000L)==0; shift++)
+      remainder<<=1;
+    bitpos-=shift;
+    div=remainder/divider;
+    remainder=remainder%divider;
+    quotient+=div<<bitpos;
+    if ((div & ~(0xffffffffUL>>bitpos))!=0)
+      return FIX16_OVERFLOW;
+    remainder<<=1;
+    bitpos--;
+  } /* while */
+  quotient++;           /* the quotient is always positive, so rounding is easy */
+  result=(int32_t)(quotient>>1);
+  if (((a ^ b) & 0x80000000L)!=0) {
+    if (result==FIX16_MIN)
+      return FIX16_OVERFLOW;
+    result=-result;
+  } /* if */
+  return result;
+}
+
+SC_FUNC int purenative_find(const char *name)
+{
+  int idx;
+
+  for (idx=0; idx<sizearray(purenatives); idx++)
+    if (strcmp(purenatives[idx].name,name)==0)
+      return idx+1;
+  return pnNONE;
+}
+
+/* returns the identifier of the compile-time implementation of the function,
+ * or pnNONE if it is not a native function that was declared "pure" */
+static int purenative_id(symbol *sym)
+{
+  char name[sNAMEMAX+1];
+  constvalue *pure;
+
+  assert(sym!=NULL);
+  if (sym->ident!=iFUNCTN || (sym->usage & uNATIVE)==0 || pc_cellsize!=4)
+    return pnNONE;      /* libfixmath works on 32-bit cells */
+  if (!lookup_alias(name,sym->name))
+    strcpy(name,sym->name);
+  if ((pure=find_constval(&purenative_tab,name,-1))==NULL)
+    return pnNONE;
+  assert(pure->value>pnNONE && pure->value<=sizearray(purenatives));
+  return (int)pure->value;
+}
+
+/*  purecall
+ *
+ *  Evaluates a call to a "pure" native function with constant arguments.
+ *  Returns FALSE if the function has no compile-time implementation.
+ */
+static int purecall(symbol *sym,int numargs,const cell *args,cell *result)
+{
+  int32_t a,b,r;
+  int id;
+
+  if ((id=purenative_id(sym))==pnNONE || purenatives[id-1].numargs!=numargs)
+    return FALSE;
+  a=(int32_t)args[0];
+  b= (numargs>1) ? (int32_t)args[1] : 0;
+  switch (id) {
+  case pnFIXED:
+    r=(int32_t)((uint32_t)a*FIX16_ONE);
+    break;
+  case pnFROUND:
+    if (a>=0)
+      r=(int32_t)((uint32_t)a+FIX16_ONE/2)/FIX16_ONE;
+    else
+      r=(int32_t)((uint32_t)a-FIX16_ONE/2)/FIX16_ONE;
+    break;
+  case pnFADD:
+  case pnFSUB:
+    r= (id==pnFADD) ? fix16_add(a,b) : fix16_sub(a,b);
+    if (r==FIX16_OVERFLOW)
+      r= (a>0) ? FIX16_MAX : FIX16_MIN;
+    break;
+  case pnFMUL:
+  case pnFDIV:
+    r= (id==pnFMUL) ? fix16_mul(a,b) : fix16_div(a,b);
+    if (r==FIX16_OVERFLOW)
+      r= ((a>=0)==(b>=0)) ? FIX16_MAX : FIX16_MIN;
+    break;
+  default:
+    assert(0);
+    return FALSE;
+  } /* switch */
+  *result=(cell)r;
+  return TRUE;
+}
+
+static symbol *finduserop(char *opername,int tag1,int tag2)
+{
+  char symbolname[sNAMEMAX+1];
+
+  operator_symname(symbolname,opername,tag1,tag2,2,tag2);
+  return findglb(symbolname,sGLOBAL);
+}
+
+/*  fold_userop
+ *
+ *  Evaluates a user-defined operator on constant operands at compile time,
+ *  if the operator is implemented by a "pure" native function. Like in
+ *  check_userop(), "oper" is NULL for the assignment operator, which only
+ *  takes the value of the right operand (val1, with tag1) and converts it to
+ *  the tag of the left operand (tag2).
+ */
+SC_FUNC int fold_userop(void (*oper)(void),int tag1,int tag2,cell val1,cell val2,
+                        cell *result,int *resulttag)
+{
+  char *opername;
+  symbol *sym;
+  cell args[2];
+
+  if (tag1==0 && tag2==0)
+    return FALSE;
+  if (oper==NULL)
+    opername="=";
+  else if (oper==os_mult)
+    opername="*";
+  else if (oper==os_div)
+    opername="/";
+  else if (oper==ob_add)
+    opername="+";
+  else if (oper==ob_sub)
+    opername="-";
+  else
+    return FALSE;
+
+  args[0]=val1;
+  args[1]=val2;
+  if ((sym=finduserop(opername,tag1,tag2))==NULL) {
+    /* check for commutative operators, see check_userop() */
+    if (tag1==tag2 || oper==NULL || !commutative(oper))
+      return FALSE;
+    if ((sym=finduserop(opername,tag2,tag1))==NULL)
+      return FALSE;
+    args[0]=val2;
+    args[1]=val1;
+  } /* if */
+  if (sym==curfunc || !purecall(sym,(oper==NULL) ? 1 : 2,args,result))
+    return FALSE;
+  *resulttag=sym->tag;
+  return TRUE;
+}
+
+/*  fold_divisor
+ *
+ *  For a division by a constant that is a power of two, where both the
+ *  division and the multiplication operators for the tag are "pure" natives
+ *  for fdiv and fmul, the division may be replaced by a multiplication with
+ *  the reciprocal: for libfixmath, the results are identical (the reciprocal
+ *  is exact, and both round half away from zero and saturate) and fmul is
+ *  much quicker than fdiv. On success, the divisor is replaced by its
+ *  reciprocal.
+ */
+static int fold_divisor(int tag1,int tag2,cell *divisor)
+{
+  symbol *sym;
+  uint32_t mag;
+  int bits;
+
+  if (tag1==0 || tag1!=tag2 || pc_optimize<=sOPTIMIZE_NONE)
+    return FALSE;
+  if ((sym=finduserop("/",tag1,tag2))==NULL || sym==curfunc || purenative_id(sym)!=pnFDIV)
+    return FALSE;
+  if ((sym=finduserop("*",tag1,tag2))==NULL || sym==curfunc || purenative_id(sym)!=pnFMUL)
+    return FALSE;
+  mag= (*divisor>=0) ? (uint32_t)*divisor : 0-(uint32_t)*divisor;
+  if ((cell)(int32_t)*divisor!=*divisor || mag==0 || (mag & (mag-1))!=0)
+    return FALSE;       /* not a power of two */
+  for (bits=0; (mag>>bits)!=1; bits++)
+    /* nothing */;
+  if (bits<2)
+    return FALSE;       /* the reciprocal does not fit */
+  mag=(uint32_t)1 << (32-bits);
+  *divisor= (*divisor>=0) ? (cell)mag : -(cell)mag;
+  return TRUE;
+}
+
 SC_FUNC int expression(cell *val,int *tag,symbol **symptr,int chkfuncresult)
 {
   int locheap=decl_heap;
   value lval={0};
+  int start=stgidx;
 
   if (hier14(&lval))
     rvalue(&lval);
@@ -853,6 +1153,14 @@ SC_FUNC int expression(cell *val,int *tag,symbol **symptr,int chkfuncresult)
   modheap((locheap-decl_heap)*pc_cellsize); /* remove heap space, so negative delta */
   decl_heap=locheap;
 
+  /* the simple form found last is only valid if it spans the complete
+   * expression, i.e. if no code precedes or follows it
+   */
+  if (lval.ident==iCONSTEXPR)
+    setexprform(NULL,tNUMBER,lval.constval,start);
+  else if (!staging || exprform.start!=start || exprform.end!=stgidx)
+    exprform.oper=0;
+
   if (lval.ident==iCONSTEXPR && val!=NULL)  /* constant expression */
     *val=lval.constval;
   if (tag!=NULL)
@@ -864,6 +1172,41 @@ SC_FUNC int expression(cell *val,int *tag,symbol **symptr,int chkfuncresult)
   return lval.ident;
 }
 
+static void setexprform(symbol *sym,int oper,cell value,int index)
+{
+  exprform.sym=sym;
+  exprform.oper=oper;
+  exprform.value=value;
+  exprform.start=index;
+  exprform.end=stgidx;
+}
+
+/*  getexprform
+ *
+ *  Returns the operator token of the last expression if it has one of the
+ *  forms "variable <relational operator> constant", "variable = constant",
+ *  "variable += constant", "variable -= constant", "variable++" or
+ *  "variable--" (tNUMBER for a constant expression), or 0 if it has none of
+ *  these forms. The start of the expression in the staging buffer is stored
+ *  in "index", so that the caller can verify that the expression is not
+ *  preceded by other expressions (separated by commas).
+ */
+SC_FUNC int getexprform(symbol **sym,cell *value,int *index)
+{
+  if (sym!=NULL)
+    *sym=exprform.sym;
+  if (value!=NULL)
+    *value=exprform.value;
+  if (index!=NULL)
+    *index=exprform.start;
+  return exprform.oper;
+}
+
+SC_FUNC void resetexprform(void)
+{
+  exprform.oper=0;
+}
+
 SC_FUNC int sc_getstateid(constvalue **automaton,constvalue **state,char *statename)
 {
   char name[sNAMEMAX+1],closestmatch[sNAMEMAX+1];
@@ -969,10 +1312,12 @@ static int hier14(value *lval1)
   int tok,i;
   cell val;
   char *st;
-  int bwcount,leftarray;
+  int bwcount,leftarray,start,rhsindex;
+  cell rhscidx;
   cell arrayidx1[sDIMEN_MAX],arrayidx2[sDIMEN_MAX];  /* last used array indices */
   cell *org_arrayidx;
 
+  start=stgidx;
   bwcount=bitwise_opercount;
   bitwise_opercount=0;
   /* initialize the index arrays with unlikely constant indices; note that
@@ -1067,6 +1412,8 @@ static int hier14(value *lval1)
   } /* if */
 
   lval3=*lval1;         /* save symbol to enable storage of expresion result */
+  rhsindex=-1;          /* start of the right operand, if it is the last code */
+  rhscidx=0;
   lval1->arrayidx=org_arrayidx; /* restore array index pointer */
   if (lval1->ident==iARRAYCELL || lval1->ident==iARRAYCHAR
       || lval1->ident==iARRAY || lval1->ident==iREFARRAY)
@@ -1099,6 +1446,7 @@ static int hier14(value *lval1)
     } else {
       /* if direct fetch and simple assignment: no "push"
        * and "pop" needed -> call hier14() directly, */
+      stgget(&rhsindex,&rhscidx);
       if (hier14(&lval2))
         rvalue(&lval2);         /* instead of plnge2() */
       else if (lval2.ident==iVARIABLE)
@@ -1155,13 +1503,28 @@ static int hier14(value *lval1)
       #endif
     } /* if */
   } else {
-    check_userop(NULL,lval2.tag,lval3.tag,2,&lval3,&lval2.tag);
+    if (!oper && lval2.ident==iCONSTEXPR
+        && fold_userop(NULL,lval2.tag,lval3.tag,lval2.constval,0,&lval2.constval,&lval2.tag))
+    {
+      /* the conversion operator is a "pure" native, load the converted value */
+      if (rhsindex>=0)
+        stgdel(rhsindex,rhscidx);
+      ldconst(lval2.constval,sPRI);
+    } else {
+      check_userop(NULL,lval2.tag,lval3.tag,2,&lval3,&lval2.tag);
+    } /* if */
     store(&lval3);      /* now, store the expression result */
   } /* if */
   if (!oper && !matchtag(lval3.tag,lval2.tag,TRUE))
     error(213);         /* tagname mismatch (if "oper", warning already given in plunge2()) */
   if (lval3.sym)
     markusage(lval3.sym,uWRITTEN);
+  if (lval3.ident==iVARIABLE && lval3.tag==0 && (tok=='=' || tok==taADD || tok==taSUB)) {
+    if (lval2.ident==iCONSTEXPR && lval2.tag==0)
+      setexprform(lval3.sym,tok,lval2.constval,start);
+    else if (tok==taADD && lval2.ident==iVARIABLE && lval2.sym==lval3.sym && lval1->tag==0)
+      setexprform(lval3.sym,tok,lval1->constval,start); /* plnge2() swapped the constant into lval1 */
+  } /* if */
   pc_sideeffect=TRUE;
   bitwise_opercount=bwcount;
   lval1->ident=iEXPRESSION;
@@ -1359,7 +1722,7 @@ static int hier3(value *lval)
 
 static int hier2(value *lval)
 {
-  int lvalue,tok;
+  int lvalue,tok,start;
   int tag,paranthese;
   cell val;
   char *st;
@@ -1373,6 +1736,7 @@ static int hier2(value *lval)
       lexpush();                /* to avoid subsequent "shadowing" warnings */
       return error(22);         /* must be lvalue */
     } /* if */
+    start=stgidx;
     if (!hier2(lval))
       return error(22);         /* must be lvalue */
     assert(lval->sym!=NULL);
@@ -1381,9 +1745,12 @@ static int hier2(value *lval)
     if (!check_userop(user_inc,lval->tag,0,1,lval,&lval->tag))
       inc(lval);                /* increase variable first */
     rvalue(lval);               /* and read the result into PRI */
+    if (lval->ident==iVARIABLE && lval->tag==0)
+      setexprform(lval->sym,tINC,1,start);
     pc_sideeffect=TRUE;
     return FALSE;               /* result is no longer lvalue */
   case tDEC:                    /* --lval */
+    start=stgidx;
     if (!hier2(lval))
       return error(22);         /* must be lvalue */
     assert(lval->sym!=NULL);
@@ -1392,6 +1759,8 @@ static int hier2(value *lval)
     if (!check_userop(user_dec,lval->tag,0,1,lval,&lval->tag))
       dec(lval);                /* decrease variable first */
     rvalue(lval);               /* and read the result into PRI */
+    if (lval->ident==iVARIABLE && lval->tag==0)
+      setexprform(lval->sym,tDEC,1,start);
     pc_sideeffect=TRUE;
     return FALSE;               /* result is no longer lvalue */
   case '~':                     /* ~ (one's complement) */
@@ -1620,6 +1989,7 @@ static int hier2(value *lval)
   } /* case */
   default:
     lexpush();
+    start=stgidx;
     lvalue=hier1(lval);
     /* check for postfix operators */
     if (matchtoken(';')) {
@@ -1656,6 +2026,8 @@ static int hier2(value *lval)
           inc(lval);            /* increase variable afterwards */
         if (saveresult)
           popreg(sPRI);         /* restore PRI (result of rvalue()) */
+        if (lval->ident==iVARIABLE && lval->tag==0)
+          setexprform(lval->sym,tINC,1,start);
         pc_sideeffect=TRUE;
         return FALSE;           /* result is no longer lvalue */
       case tDEC:                /* lval-- */
@@ -1674,6 +2046,8 @@ static int hier2(value *lval)
           dec(lval);            /* decrease variable afterwards */
         if (saveresult)
           popreg(sPRI);         /* restore PRI (result of rvalue()) */
+        if (lval->ident==iVARIABLE && lval->tag==0)
+          setexprform(lval->sym,tDEC,1,start);
         pc_sideeffect=TRUE;
         return FALSE;
       default:
@@ -1701,7 +2075,7 @@ static int hier1(value *lval1)
   value lval2={0};
   char *symlabel;
   int close,optbrackets;
-  symbol *sym,*cursym;
+  symbol *sym,*cursym,*idxsym;
   symbol dummysymbol; /* for plunging into pseudo-arrays */
 
   lvalue=primary(lval1,&symtok);
@@ -1751,6 +2125,7 @@ restart:
       } /* if */
       stgget(&index,&cidx);     /* mark position in code generator */
       pushreg(sPRI);            /* save base address of the array */
+      idxsym=NULL;
       if (close==tSYMLABEL || matchtoken(tSYMLABEL)) {
         if (close!=tSYMLABEL)
           tokeninfo(&val,&symlabel);
@@ -1775,8 +2150,11 @@ restart:
           error(94,sym->name);  /* invalid subscript (named indices should be used) */
         if ((sym->usage & uPACKED)==0 && close=='}' || (sym->usage & uPACKED)!=0 && (close==']' || close==tSYMLABEL))
           error(229);
-        if (hier14(&lval2))     /* create expression for the array index */
+        if (hier14(&lval2)) {   /* create expression for the array index */
           rvalue(&lval2);
+          if (lval2.ident==iVARIABLE)
+            idxsym=lval2.sym;   /* plain variable, its range may be known */
+        } /* if */
         if (lval2.ident==iARRAY || lval2.ident==iREFARRAY)
           error(33,lval2.sym->name);    /* array must be indexed */
       } /* if */
@@ -1824,11 +2202,11 @@ restart:
         /* array index is not constant (so brackets are never optional) */
         lval1->arrayidx=NULL;           /* reset, so won't be checked */
         if (close==']') {
-          if (sym->dim.array.length!=0)
+          if (sym->dim.array.length!=0 && !loopvar_inbounds(idxsym,sym->dim.array.length-1))
             ffbounds(sym->dim.array.length-1);  /* run time check for array bounds */
           cell2addr();  /* normal array index */
         } else {
-          if (sym->dim.array.length!=0)
+          if (sym->dim.array.length!=0 && !loopvar_inbounds(idxsym,sym->dim.array.length*(32/sCHARBITS)-1))
             ffbounds(sym->dim.array.length*(32/sCHARBITS)-1);
           char2addr();  /* character array index */
         } /* if */
@@ -2180,6 +2558,11 @@ static int nesting=0;
   cell lexval;
   char *lexstr;
   int reloc;
+  int stgindex,argindex;
+  cell cidx,argcidx;
+  cell constargs[sMAXARGS];
+  int numconst=0;   /* number of arguments with a known (constant) value */
+  int folded;
 
   assert(sym!=NULL);
   lval_result->ident=iEXPRESSION; /* preset, may be changed later */
@@ -2217,9 +2600,16 @@ static int nesting=0;
     error(234,sym->name,ptr);   /* deprecated (probably a native function) */
   } /* if */
 
+  /* in the first pass, a function that is called before it is declared has
+   * no argument list yet, so a loop counter may be passed by reference
+   */
+  if (sc_status==statFIRST && (sym->usage & uPROTOTYPED)==0)
+    loopvar_write(NULL);
+
   /* run through the arguments */
   arg=sym->dim.arglist;
   assert(arg!=NULL);
+  stgget(&stgindex,&cidx);      /* mark position in code generator (for inlining) */
   stgmark(sSTARTREORDER);
   memset(arglist,ARG_UNHANDLED,sizeof arglist);
   if (matchparanthesis) {
@@ -2285,6 +2675,7 @@ static int nesting=0;
          */
       } else {
         arglist[argpos]=ARG_DONE; /* flag argument as "present" */
+        stgget(&argindex,&argcidx);
         lvalue=hier14(&lval);
         assert(sc_status==statFIRST || arg[argidx].ident== 0 || arg[argidx].tags!=NULL);
         reloc=FALSE;
@@ -2345,7 +2736,19 @@ static int nesting=0;
             rvalue(&lval);        /* get value (direct or indirect) */
           /* otherwise, the expression result is already in PRI */
           assert(arg[argidx].numtags>0);
-          check_userop(NULL,lval.tag,arg[argidx].tags[0],2,NULL,&lval.tag);
+          if (lval.ident==iCONSTEXPR
+              && fold_userop(NULL,lval.tag,arg[argidx].tags[0],lval.constval,0,&lval.constval,&lval.tag))
+          {
+            /* the conversion operator is a "pure" native, load the converted value */
+            stgdel(argindex,argcidx);
+            ldconst(lval.constval,sPRI);
+          } else if (check_userop(NULL,lval.tag,arg[argidx].tags[0],2,NULL,&lval.tag)) {
+            lval.ident=iEXPRESSION;   /* value is converted at run time */
+          } /* if */
+          if (lval.ident==iCONSTEXPR && argpos<sMAXARGS) {
+            constargs[argpos]=lval.constval;
+            numconst++;
+          } /* if */
           if (!checktag(arg[argidx].tags,arg[argidx].numtags,lval.tag))
             error(213);
           if (lval.tag!=0)
@@ -2595,17 +2998,31 @@ static int nesting=0;
     arglist[argidx]=ARG_DONE;
   } /* for */
   stgmark(sENDREORDER);         /* mark end of reversed evaluation */
-  pushval((cell)nargs*pc_cellsize);
   nest_stkusage++;
-  ffcall(sym,NULL,nargs);
-  if (sc_status!=statSKIP)
-    markusage(sym,uREAD);       /* do not mark as "used" when this call itself is skipped */
-  if ((sym->usage & uNATIVE)!=0 &&sym->x.lib!=NULL)
-    sym->x.lib->value += 1;     /* increment "usage count" of the library */
+  /* a "pure" native function with constant arguments is evaluated here, it
+   * need not be called (or even be present at run time)
+   */
+  folded= (numconst==nargs && symret==NULL
+           && purecall(sym,nargs,constargs,&lval_result->constval));
+  if (folded) {
+    stgdel(stgindex,cidx);      /* scratch the arguments */
+    ldconst(lval_result->constval,sPRI);
+    lval_result->ident=iCONSTEXPR;
+  } else {
+    if (!inline_expand(sym,stgindex,cidx,nargs)) {
+      pushval((cell)nargs*pc_cellsize);
+      ffcall(sym,NULL,nargs);
+    } /* if */
+    if (sc_status!=statSKIP)
+      markusage(sym,uREAD);     /* do not mark as "used" when this call itself is skipped */
+    if ((sym->usage & uNATIVE)!=0 &&sym->x.lib!=NULL)
+      sym->x.lib->value += 1;   /* increment "usage count" of the library */
+  } /* if */
   modheap(-heapalloc*pc_cellsize);
   if (symret!=NULL)
     popreg(sPRI);               /* pop hidden parameter as function result */
-  pc_sideeffect=TRUE;           /* assume functions carry out a side-effect */
+  if (!folded)
+    pc_sideeffect=TRUE;         /* assume functions carry out a side-effect */
   delete_consttable(&arrayszlst);     /* clear list of array sizes */
   delete_consttable(&taglst);   /* clear list of parameter tags */
 
@@ -157,9 +157,9 @@ SC_FUNC void writetrailer(void)
 SC_FUNC void writestatetables(symbol *root,int lbl_nostate,int lbl_ignorestate)
 {
   int lbl_default,lbl_table,lbl_defnostate;
-  int statecount;
   symbol *sym;
   constvalue *fsa, *state;
+  constvalue caselist = { NULL, "", 0, 0};
   statelist *stlist;
   int fsa_id,listid;
 
@@ -232,10 +232,7 @@ SC_FUNC void writestatetables(symbol *root,int lbl_nostate,int lbl_ignorestate)
       fsa_id=state_getfsa(listid);
       assert(fsa_id>=0);        /* automaton 0 exists */
       fsa=automaton_findid(fsa_id);
-      /* count the number of states actually used; at the same time, check
-       * whether there is a default (i.e. "fallback") state function
-       */
-      statecount=0;
+      /* check whether there is a default (i.e. "fallback") state function */
       if (strcmp(sym->name,uEXITFUNC)==0) {
         lbl_default= (pc_overlays>0) ? ovlEXITSTATE : lbl_ignorestate;
       } else {
@@ -243,11 +240,8 @@ SC_FUNC void writestatetables(symbol *root,int lbl_nostate,int lbl_ignorestate)
         lbl_default=lbl_defnostate;
       } /* if */
       for (stlist=sym->states->next; stlist!=NULL; stlist=stlist->next) {
-        if (stlist->id==-1) {
+        if (stlist->id==-1)
           lbl_default=stlist->label;
-        } else {
-          statecount+=state_count(stlist->id);
-        } /* if */
       } /* for */
       /* generate a stub entry for the functions */
       stgwrite("\tload.pri ");
@@ -265,16 +259,18 @@ SC_FUNC void writestatetables(symbol *root,int lbl_nostate,int lbl_ignorestate)
       ffswitch(lbl_table,(pc_overlays>0));
       /* generate the jump table */
       setlabel(lbl_table);
-      ffcase(statecount,lbl_default,TRUE,(pc_overlays>0));
+      caselist.next=NULL;
       for (state=sc_state_tab.next; state!=NULL; state=state->next) {
         if (state->index==fsa_id) {
           /* find the label for this list id */
           for (stlist=sym->states->next; stlist!=NULL; stlist=stlist->next) {
             if (stlist->id!=-1 && state_inlist(stlist->id,(int)state->value)) {
               /* when overlays are used, the jump-label for the case statement
-               * are overlay indices instead of code labels
+               * are overlay indices instead of code labels; the states of an
+               * automaton are numbered in ascending order, so the list is
+               * sorted
                */
-              ffcase(state->value,stlist->label,FALSE,(pc_overlays>0));
+              append_constval(&caselist,itoh(stlist->label),state->value,0);
               break;
             } /* if */
           } /* for */
@@ -282,6 +278,8 @@ SC_FUNC void writestatetables(symbol *root,int lbl_nostate,int lbl_ignorestate)
             error(230,state->name,sym->name);  /* unimplemented state, no fallback */
         } /* if (state belongs to automaton of function) */
       } /* for (state) */
+      ffcasetbl(caselist.next,lbl_default,(pc_overlays>0));
+      delete_consttable(&caselist);
       stgwrite("\n");
       /* the jump table gets its own overlay index, and the size of the jump
        * table must therefore be known (i.e. update the codeaddr field of the
@@ -842,6 +840,11 @@ SC_FUNC void swap1(void)
  * the label to branch to when none of the values in the case table match.
  * The case table is sorted on the comparison value. This allows more advanced
  * abstract machines to sift the case table with a binary search.
+ * When the comparison values are dense, a "jump" table replaces the case
+ * table. It holds the number of entries, the label for "none-matched", the
+ * lowest comparison value and then one label for every value in the range
+ * (gaps in the range branch to the "none-matched" label). The abstract machine
+ * indexes this table directly.
  * The iswitch statement uses an icase table. The parameter of an iswitch is
  * still a (relative) code address.
  */
@@ -874,6 +877,65 @@ SC_FUNC void ffcase(cell value,int label,int newtable,int icase)
   code_idx+=opcodes(0)+opargs(2);
 }
 
+/*  ffcasetbl
+ *
+ *  Generate the table for a switch. The list holds the case values in
+ *  ascending order, with the label (or the overlay index, for an iswitch) in
+ *  the name field, as a hexadecimal string. A jump table is generated when it
+ *  is not larger than the case table, i.e. when at least half of the values
+ *  in the range are present.
+ */
+SC_FUNC void ffcasetbl(constvalue *caselist,int deflabel,int icase)
+{
+  constvalue *cse;
+  cell count,low,high,value;
+  int label;
+
+  count=0;
+  low=high=0;
+  for (cse=caselist; cse!=NULL; cse=cse->next) {
+    if (count==0)
+      low=cse->value;
+    high=cse->value;
+    count++;
+  } /* for */
+
+  if (count==0 || (ucell)high-(ucell)low>=(ucell)(2*count-1)) {
+    ffcase(count,deflabel,TRUE,icase);
+    for (cse=caselist; cse!=NULL; cse=cse->next)
+      ffcase(cse->value,(int)strtol(cse->name,NULL,16),FALSE,icase);
+    return;
+  } /* if */
+
+  if (icase)
+    stgwrite("\tjumptbl.ovl ");
+  else
+    stgwrite("\tjumptbl ");
+  outval(high-low+1,TRUE,FALSE);
+  stgwrite(" ");
+  outval(deflabel,TRUE,FALSE);
+  stgwrite(" ");
+  outval(low,TRUE,TRUE);
+  code_idx+=opcodes(1)+opargs(3);
+  cse=caselist;
+  for (value=low; ; value++) {
+    while (cse!=NULL && cse->value<value)
+      cse=cse->next;            /* skip duplicate case values (after an error) */
+    if (cse!=NULL && cse->value==value)
+      label=(int)strtol(cse->name,NULL,16);
+    else
+      label=deflabel;
+    if (icase)
+      stgwrite("\tcase.tbl.ovl ");
+    else
+      stgwrite("\tcase.tbl ");
+    outval(label,TRUE,TRUE);
+    code_idx+=opargs(1);
+    if (value==high)
+      break;
+  } /* for */
+}
+
 /*
  *  Call specified function
  */
@@ -1459,6 +1521,7 @@ SC_FUNC void inc(value *lval)
   } else {
     /* local or global variable */
     assert(sym!=NULL);
+    markusage(sym,uWRITTEN);
     stgwrite("\tpush.pri\n");
     if (sym->vclass==sLOCAL)
       stgwrite("\taddr.pri ");
@@ -1508,6 +1571,7 @@ SC_FUNC void dec(value *lval)
   } else {
     /* local or global variable */
     assert(sym!=NULL);
+    markusage(sym,uWRITTEN);
     stgwrite("\tpush.pri\n");
     if (sym->vclass==sLOCAL)
       stgwrite("\taddr.pri ");
@@ -35,9 +35,22 @@
 
 
 static void append_dbginfo(FILE *fout);
+static void append_metadata(FILE *fout,AMX_HEADER *hdr);
+static void ovl_free(void);
 
 
-typedef cell (*OPCODE_PROC)(FILE *fbin,const char *params,cell opcode,cell cip);
+/* The code generator output (after the peephole optimizer) is encoded into
+ * records, one per label or instruction, so that the assembler passes do not
+ * need to parse text. The parameters of all records are stored sequentially
+ * in a separate table.
+ */
+typedef struct {
+  short index;          /* index in opcodelist[], or 0 for a label */
+  short numparams;      /* number of values in the parameter table */
+  symbol *sym;          /* called function (for "call"), or NULL */
+} ASMRECORD;
+
+typedef cell (*OPCODE_PROC)(FILE *fbin,const ASMRECORD *rec,const ucell *params,cell opcode,cell cip);
 
 typedef struct {
   cell opcode;
@@ -49,8 +62,16 @@ typedef struct {
   #endif
 } OPCODE;
 
-static cell *lbltab;    /* label table */
+static ASMRECORD *asmcode;      /* encoded instructions and labels */
+static int asmcode_count,asmcode_size;
+static ucell *asmparams;        /* parameters of the encoded instructions */
+static int asmparams_count,asmparams_size;
+static char *asmline;           /* partial line, waiting for its '\n' */
+static int asmline_length,asmline_size;
+static short asmfile;           /* file number of the last "code" or "data" */
 static int writeerror;
+static AMX_METADATA metadata; /* collected while the data segment is written */
+static symbol *meta_icon,*meta_name;
 
 static char *skipwhitespace(const char *str)
 {
@@ -211,26 +232,29 @@ static void write_cell(FILE *fbin,ucell c)
   writeerror |= !pc_writebin(fbin,aligncell(&c),pc_cellsize);
 }
 
-static cell noop(FILE *fbin,const char *params,cell opcode,cell cip)
+static cell noop(FILE *fbin,const ASMRECORD *rec,const ucell *params,cell opcode,cell cip)
 {
   (void)fbin;
+  (void)rec;
   (void)params;
   (void)opcode;
   (void)cip;
   return 0;
 }
 
-static cell set_currentfile(FILE *fbin,const char *params,cell opcode,cell cip)
+static cell set_currentfile(FILE *fbin,const ASMRECORD *rec,const ucell *params,cell opcode,cell cip)
 {
   (void)fbin;
   (void)opcode;
   (void)cip;
-  fcurrent=(short)getparamvalue(params,NULL);
+  assert(rec->numparams>=1);
+  fcurrent=(short)params[0];
   return 0;
 }
 
-static cell parm0(FILE *fbin,const char *params,cell opcode,cell cip)
+static cell parm0(FILE *fbin,const ASMRECORD *rec,const ucell *params,cell opcode,cell cip)
 {
+  (void)rec;
   (void)params;
   (void)cip;
   if (fbin!=NULL)
@@ -238,21 +262,23 @@ static cell parm0(FILE *fbin,const char *params,cell opcode,cell cip)
   return opcodes(1);
 }
 
-static cell parm1(FILE *fbin,const char *params,cell opcode,cell cip)
+static cell parm1(FILE *fbin,const ASMRECORD *rec,const ucell *params,cell opcode,cell cip)
 {
-  ucell p=getparamvalue(params,NULL);
   (void)cip;
+  assert(rec->numparams==1);
   if (fbin!=NULL) {
     write_cell(fbin,opcode);
-    write_cell(fbin,p);
+    write_cell(fbin,params[0]);
   } /* if */
   return opcodes(1)+opargs(1);
 }
 
-static cell parm1_p(FILE *fbin,const char *params,cell opcode,cell cip)
+static cell parm1_p(FILE *fbin,const ASMRECORD *rec,const ucell *params,cell opcode,cell cip)
 {
-  ucell p=getparamvalue(params,NULL);
+  ucell p;
   (void)cip;
+  assert(rec->numparams==1);
+  p=params[0];
   assert(p<((ucell)1<<(pc_cellsize*4)));
   assert(opcode>=0 && opcode<=255);
   if (fbin!=NULL) {
@@ -262,106 +288,121 @@ static cell parm1_p(FILE *fbin,const char *params,cell opcode,cell cip)
   return opcodes(1);
 }
 
-static cell parm2(FILE *fbin,const char *params,cell opcode,cell cip)
+static cell parm2(FILE *fbin,const ASMRECORD *rec,const ucell *params,cell opcode,cell cip)
 {
-  ucell p1=getparamvalue(params,&params);
-  ucell p2=getparamvalue(params,NULL);
   (void)cip;
+  assert(rec->numparams==2);
   if (fbin!=NULL) {
     write_cell(fbin,opcode);
-    write_cell(fbin,p1);
-    write_cell(fbin,p2);
+    write_cell(fbin,params[0]);
+    write_cell(fbin,params[1]);
   } /* if */
   return opcodes(1)+opargs(2);
 }
 
-static cell parmx(FILE *fbin,const char *params,cell opcode,cell cip)
+static cell parm3(FILE *fbin,const ASMRECORD *rec,const ucell *params,cell opcode,cell cip)
+{
+  (void)cip;
+  assert(rec->numparams==3);
+  if (fbin!=NULL) {
+    write_cell(fbin,opcode);
+    write_cell(fbin,params[0]);
+    write_cell(fbin,params[1]);
+    write_cell(fbin,params[2]);
+  } /* if */
+  return opcodes(1)+opargs(3);
+}
+
+static cell parmx(FILE *fbin,const ASMRECORD *rec,const ucell *params,cell opcode,cell cip)
 {
   int idx;
-  ucell count=getparamvalue(params,&params);
+  ucell count=params[0];
   (void)cip;
+  assert((ucell)rec->numparams==count+1);
   if (fbin!=NULL) {
     write_cell(fbin,opcode);
     write_cell(fbin,(ucell)count);
+    for (idx=1; idx<=count; idx++)
+      write_cell(fbin,params[idx]);
   } /* if */
-  for (idx=0; idx<count; idx++) {
-    ucell p=getparamvalue(params,&params);
-    if (fbin!=NULL)
-      write_cell(fbin,p);
-  } /* for */
   return opcodes(1)+opargs(count+1);
 }
 
-static cell parmx_p(FILE *fbin,const char *params,cell opcode,cell cip)
+static cell parmx_p(FILE *fbin,const ASMRECORD *rec,const ucell *params,cell opcode,cell cip)
 {
   int idx;
   ucell p;
-  ucell count=getparamvalue(params,&params);
+  ucell count=params[0];
   (void)cip;
+  assert((ucell)rec->numparams==count+1);
   assert(count<((ucell)1<<(pc_cellsize*4)));
   assert(opcode>=0 && opcode<=255);
   /* write the instruction (optionally) */
   if (fbin!=NULL) {
     p=(count<<pc_cellsize*4) | opcode;
     write_cell(fbin,p);
+    for (idx=1; idx<=count; idx++)
+      write_cell(fbin,params[idx]);
   } /* if */
-  for (idx=0; idx<count; idx++) {
-    p=getparamvalue(params,&params);
-    if (fbin!=NULL)
-      write_cell(fbin,p);
-  } /* for */
   return opcodes(1)+opargs(count);
 }
 
-static cell do_dump(FILE *fbin,const char *params,cell opcode,cell cip)
+/* copy the contents of the "program_icon" and "program_name" arrays into the
+ * metadata block, "addr" is the address of the cell in the data segment
+ */
+static void collect_metadata(cell addr,ucell value)
 {
-  ucell p;
-  int num = 0;
+  cell index;
+  int i;
+
+  if (meta_icon!=NULL && addr>=meta_icon->addr) {
+    index=(addr-meta_icon->addr)/pc_cellsize;
+    if (index<meta_icon->dim.array.length && index<(cell)sizearray(metadata.icon))
+      metadata.icon[index]=(uint32_t)value;
+  } /* if */
+  if (meta_name!=NULL && addr>=meta_name->addr) {
+    index=(addr-meta_name->addr)/pc_cellsize;
+    if (index<meta_name->dim.array.length && (index+1)*pc_cellsize<=(cell)sizeof metadata.name) {
+      /* packed strings store the first character in the highest byte */
+      for (i=0; i<pc_cellsize; i++)
+        metadata.name[index*pc_cellsize+i]=(char)(value>>((pc_cellsize-1-i)*8));
+    } /* if */
+  } /* if */
+}
+
+static cell do_dump(FILE *fbin,const ASMRECORD *rec,const ucell *params,cell opcode,cell cip)
+{
+  int num;
 
   (void)opcode;
-  (void)cip;
-  while (*params!='\0') {
-    p=getparamvalue(params,&params);
-    if (fbin!=NULL)
-      write_cell(fbin,p);
-    num++;
-    while (isspace(*params))
-      params++;
-  } /* while */
-  return num*pc_cellsize;
+  if (fbin!=NULL) {
+    for (num=0; num<rec->numparams; num++) {
+      write_cell(fbin,params[num]);
+      collect_metadata(cip+num*pc_cellsize,params[num]);
+    } /* for */
+  } /* if */
+  return rec->numparams*pc_cellsize;
 }
 
-static cell do_call(FILE *fbin,const char *params,cell opcode,cell cip)
+static cell do_call(FILE *fbin,const ASMRECORD *rec,const ucell *params,cell opcode,cell cip)
 {
-  char name[sNAMEMAX+1];
   int i;
-  symbol *sym;
   ucell p;
 
-  for (i=0; !isspace(*params); i++,params++) {
-    assert(*params!='\0');
-    assert(i<sNAMEMAX);
-    name[i]=*params;
-  } /* for */
-  name[i]='\0';
-
-  if (name[0]=='l' && name[1]=='.') {
+  if (rec->sym==NULL) {
     /* this is a label, not a function symbol */
-    i=(int)hex2ucell(name+2,NULL);
+    assert(rec->numparams==1);
+    i=(int)params[0];
     assert(i>=0 && i<sc_labnum);
     if (fbin!=NULL) {
       assert(lbltab!=NULL);
       p=lbltab[i]-cip;          /* make relative address */
     } /* if */
   } else {
-    /* look up the function address; note that the correct file number must
-     * already have been set (in order for static globals to be found).
-     */
-    sym=findglb(name,sGLOBAL);
-    assert(sym!=NULL);
-    assert(sym->ident==iFUNCTN || sym->ident==iREFFUNC);
-    assert(sym->vclass==sGLOBAL);
-    p=sym->addr-cip;            /* make relative address */
+    /* the function symbol was looked up when the instruction was encoded */
+    assert(rec->sym->ident==iFUNCTN || rec->sym->ident==iREFFUNC);
+    assert(rec->sym->vclass==sGLOBAL);
+    p=rec->sym->addr-cip;       /* make relative address */
   } /* if */
 
   if (fbin!=NULL) {
@@ -371,12 +412,13 @@ static cell do_call(FILE *fbin,const char *params,cell opcode,cell cip)
   return opcodes(1)+opargs(1);
 }
 
-static cell do_jump(FILE *fbin,const char *params,cell opcode,cell cip)
+static cell do_jump(FILE *fbin,const ASMRECORD *rec,const ucell *params,cell opcode,cell cip)
 {
   int i;
   ucell p;
 
-  i=(int)hex2ucell(params,NULL);
+  assert(rec->numparams==1);
+  i=(int)params[0];
   assert(i>=0 && i<sc_labnum);
 
   if (fbin!=NULL) {
@@ -388,12 +430,13 @@ static cell do_jump(FILE *fbin,const char *params,cell opcode,cell cip)
   return opcodes(1)+opargs(1);
 }
 
-static cell do_switch(FILE *fbin,const char *params,cell opcode,cell cip)
+static cell do_switch(FILE *fbin,const ASMRECORD *rec,const ucell *params,cell opcode,cell cip)
 {
   int i;
   ucell p;
 
-  i=(int)hex2ucell(params,NULL);
+  assert(rec->numparams==1);
+  i=(int)params[0];
   assert(i>=0 && i<sc_labnum);
 
   if (fbin!=NULL) {
@@ -405,38 +448,85 @@ static cell do_switch(FILE *fbin,const char *params,cell opcode,cell cip)
   return opcodes(1)+opargs(1);
 }
 
-static cell do_case(FILE *fbin,const char *params,cell opcode,cell cip)
+static cell do_case(FILE *fbin,const ASMRECORD *rec,const ucell *params,cell opcode,cell cip)
 {
   int i;
-  ucell p,v;
+  ucell p;
 
   (void)opcode;
-  v=hex2ucell(params,&params);
-  i=(int)hex2ucell(params,NULL);
+  assert(rec->numparams==2);
+  i=(int)params[1];
   assert(i>=0 && i<sc_labnum);
 
   if (fbin!=NULL) {
     assert(lbltab!=NULL);
     p=lbltab[i]-cip;
-    write_cell(fbin,v);
+    write_cell(fbin,params[0]);
     write_cell(fbin,p);
   } /* if */
   return opcodes(0)+opargs(2);
 }
 
-static cell do_caseovl(FILE *fbin,const char *params,cell opcode,cell cip)
+static cell do_caseovl(FILE *fbin,const ASMRECORD *rec,const ucell *params,cell opcode,cell cip)
 {
-  ucell v=hex2ucell(params,&params);
-  ucell p=hex2ucell(params,NULL);
   (void)opcode;
   (void)cip;
+  assert(rec->numparams==2);
   if (fbin!=NULL) {
-    write_cell(fbin,v);
-    write_cell(fbin,p);
+    write_cell(fbin,params[0]);
+    write_cell(fbin,params[1]);
   } /* if */
   return opcodes(0)+opargs(2);
 }
 
+static cell do_jumptbl(FILE *fbin,const ASMRECORD *rec,const ucell *params,cell opcode,cell cip)
+{
+  int i;
+  ucell p;
+
+  assert(rec->numparams==3);
+  i=(int)params[1];
+  assert(i>=0 && i<sc_labnum);
+
+  if (fbin!=NULL) {
+    assert(lbltab!=NULL);
+    p=lbltab[i]-cip-pc_cellsize;  /* the label is in the second cell after the opcode */
+    write_cell(fbin,opcode);
+    write_cell(fbin,params[0]);
+    write_cell(fbin,p);
+    write_cell(fbin,params[2]);
+  } /* if */
+  return opcodes(1)+opargs(3);
+}
+
+static cell do_jumpcase(FILE *fbin,const ASMRECORD *rec,const ucell *params,cell opcode,cell cip)
+{
+  int i;
+  ucell p;
+
+  (void)opcode;
+  assert(rec->numparams==1);
+  i=(int)params[0];
+  assert(i>=0 && i<sc_labnum);
+
+  if (fbin!=NULL) {
+    assert(lbltab!=NULL);
+    p=lbltab[i]-cip+pc_cellsize;  /* relative to the cell before this entry */
+    write_cell(fbin,p);
+  } /* if */
+  return opargs(1);
+}
+
+static cell do_jumpcaseovl(FILE *fbin,const ASMRECORD *rec,const ucell *params,cell opcode,cell cip)
+{
+  (void)opcode;
+  (void)cip;
+  assert(rec->numparams==1);
+  if (fbin!=NULL)
+    write_cell(fbin,params[0]);
+  return opargs(1);
+}
+
 static OPCODE opcodelist[] = {
   /* node for "invalid instruction" */
   {  0, NULL,          0,        noop,     0 },
@@ -458,6 +548,8 @@ static OPCODE opcodelist[] = {
   { 77, "call.ovl",    sIN_CSEG, parm1,    1 },
   {  0, "case",        sIN_CSEG, do_case,  1 },
   {  0, "case.ovl",    sIN_CSEG, do_caseovl, 1 },
+  {  0, "case.tbl",    sIN_CSEG, do_jumpcase, 1 },
+  {  0, "case.tbl.ovl", sIN_CSEG, do_jumpcaseovl, 1 },
   { 74, "casetbl",     sIN_CSEG, parm0,    1 },
   { 80, "casetbl.ovl", sIN_CSEG, parm0,    1 },
   { 65, "cmps",        sIN_CSEG, parm1,    1 },
@@ -508,6 +600,8 @@ static OPCODE opcodelist[] = {
   { 95, "jsleq",       sIN_CSEG, do_jump,  2 },
   { 94, "jsless",      sIN_CSEG, do_jump,  2 },
   { 34, "jump",        sIN_CSEG, do_jump,  1 },
+  {176, "jumptbl",     sIN_CSEG, do_jumptbl, 1 },
+  {178, "jumptbl.ovl", sIN_CSEG, parm3,    1 },
   { 35, "jzer",        sIN_CSEG, do_jump,  1 },
   { 19, "lctrl",       sIN_CSEG, parm1,    1 },
   { 81, "lidx",        sIN_CSEG, parm0,    2 },
@@ -610,6 +704,8 @@ static OPCODE opcodelist[] = {
   { 71, "swap.pri",    sIN_CSEG, parm0,    1 },
   { 70, "switch",      sIN_CSEG, do_switch,1 },
   { 79, "switch.ovl",  sIN_CSEG, do_switch,1 },
+/*{175, "switch.tbl",  sIN_CSEG, do_switch,1 }, not generated by the compiler */
+/*{177, "switch.tbl.ovl", sIN_CSEG, do_switch,1 }, not generated by the compiler */
   { 69, "sysreq",      sIN_CSEG, parm1,    1 },
 /*{ 75, "sysreq.d",    sIN_CSEG, parm1,    1 }, not generated by the compiler */
   {112, "sysreq.n",    sIN_CSEG, parm2,    2 },
@@ -655,29 +751,537 @@ static int findopcode(char *instr,int maxlen)
   return 0;             /* not found, return special index */
 }
 
-SC_FUNC int assemble(FILE *fout,FILE *fin)
+static void grow_asmcode(int records,int params)
+{
+  if (asmcode_count+records>asmcode_size) {
+    int size=(asmcode_size==0) ? 1024 : 2*asmcode_size;
+    ASMRECORD *p;
+    while (size<asmcode_count+records)
+      size*=2;
+    p=(ASMRECORD *)realloc(asmcode,size*sizeof(ASMRECORD));
+    if (p==NULL)
+      error(103);               /* insufficient memory */
+    asmcode=p;
+    asmcode_size=size;
+  } /* if */
+  if (asmparams_count+params>asmparams_size) {
+    int size=(asmparams_size==0) ? 2048 : 2*asmparams_size;
+    ucell *p;
+    while (size<asmparams_count+params)
+      size*=2;
+    p=(ucell *)realloc(asmparams,size*sizeof(ucell));
+    if (p==NULL)
+      error(103);               /* insufficient memory */
+    asmparams=p;
+    asmparams_size=size;
+  } /* if */
+}
+
+/* encode a single line of assembler code; the line is modified */
+static void encode_line(char *line)
+{
+  ASMRECORD *rec;
+  char *instr,*params;
+  char name[sNAMEMAX+1];
+  int i;
+
+  stripcomment(line);
+  instr=skipwhitespace(line);
+  /* ignore empty lines */
+  if (*instr=='\0')
+    return;
+  grow_asmcode(1,0);
+  rec=&asmcode[asmcode_count];
+  rec->sym=NULL;
+  if (tolower(*instr)=='l' && *(instr+1)=='.') {
+    /* labels have a special syntax */
+    grow_asmcode(0,1);
+    rec->index=0;
+    rec->numparams=1;
+    asmparams[asmparams_count++]=hex2ucell(instr+2,NULL);
+    asmcode_count++;
+    return;
+  } /* if */
+
+  /* get to the end of the instruction (there is always a '\n' at the end of
+   * the line, so we will *always* drop on a whitespace character) */
+  for (params=instr; *params!='\0' && !isspace(*params); params++)
+    /* nothing */;
+  assert(params>instr);
+  i=findopcode(instr,(int)(params-instr));
+  assert(opcodelist[i].name!=NULL);
+  assert(opcodelist[i].opt_level<=pc_optimize || pc_optimize==0 && opcodelist[i].opt_level<=1);
+  rec->index=(short)i;
+  rec->numparams=0;
+  params=skipwhitespace(params);
+  if (opcodelist[i].func==do_call && !(params[0]=='l' && params[1]=='.')) {
+    /* look up the function now, while the file number is known (in order
+     * for static functions to be found)
+     */
+    short save=fcurrent;
+    for (i=0; !isspace(*params); i++,params++) {
+      assert(*params!='\0');
+      assert(i<sNAMEMAX);
+      name[i]=*params;
+    } /* for */
+    name[i]='\0';
+    fcurrent=asmfile;
+    rec->sym=findglb(name,sGLOBAL);
+    fcurrent=save;
+    assert(rec->sym!=NULL);
+  } else {
+    if (opcodelist[i].func==do_call)
+      params+=2;                /* skip "l." of the label */
+    while (*params!='\0') {
+      grow_asmcode(0,1);
+      asmparams[asmparams_count++]=getparamvalue(params,(const char **)&params);
+      asmcode[asmcode_count].numparams++;
+      params=skipwhitespace(params);
+    } /* while */
+    if (opcodelist[i].func==set_currentfile) {
+      assert(asmcode[asmcode_count].numparams>=1);
+      asmfile=(short)asmparams[asmparams_count-1];
+    } /* if */
+  } /* if */
+  asmcode_count++;
+}
+
+/* asmcode_write
+ *
+ * Encodes the lines in "str" into the binary intermediate code that is read
+ * by assemble(). A line may be split over several calls.
+ */
+SC_FUNC int asmcode_write(const char *str)
+{
+  const char *eol;
+  int len;
+
+  while (*str!='\0') {
+    eol=strchr(str,'\n');
+    len=(eol!=NULL) ? (int)(eol-str)+1 : (int)strlen(str);
+    if (asmline_length+len+1>asmline_size) {
+      int size=(asmline_size==0) ? 256 : 2*asmline_size;
+      char *p;
+      while (size<asmline_length+len+1)
+        size*=2;
+      p=(char *)realloc(asmline,size);
+      if (p==NULL)
+        error(103);             /* insufficient memory */
+      asmline=p;
+      asmline_size=size;
+    } /* if */
+    memcpy(asmline+asmline_length,str,len);
+    asmline_length+=len;
+    asmline[asmline_length]='\0';
+    str+=len;
+    if (eol!=NULL) {
+      encode_line(asmline);
+      asmline_length=0;
+    } /* if */
+  } /* while */
+  return TRUE;
+}
+
+SC_FUNC void asmcode_cleanup(void)
+{
+  if (asmcode!=NULL) {
+    free(asmcode);
+    asmcode=NULL;
+  } /* if */
+  if (asmparams!=NULL) {
+    free(asmparams);
+    asmparams=NULL;
+  } /* if */
+  if (asmline!=NULL) {
+    free(asmline);
+    asmline=NULL;
+  } /* if */
+  asmcode_count=asmcode_size=0;
+  asmparams_count=asmparams_size=0;
+  asmline_length=asmline_size=0;
+  asmfile=0;
+  ovl_free();
+}
+
+/* With overlay groups (see gen_ovlinfo()), the overlays of a group are moved
+ * next to each other, so that a host can load a group with a single read.
+ * The code is cut into blocks at the start of every overlay, and the code
+ * pass writes the blocks in the order of "ovlorder". Without groups, there is
+ * a single block. All jumps are relative and they stay inside a function, so
+ * a block can be moved as a whole; the addresses in the symbol table and in
+ * the debug information are adjusted with ovl_remap().
+ */
+typedef struct {
+  int firstrec,lastrec; /* range of records in asmcode[] */
+  int firstparam;       /* index in asmparams[] of the first record */
+  cell addr;            /* original address */
+  cell size;            /* size in bytes */
+  cell newaddr;         /* address after the overlays are grouped */
+  int group;            /* overlay group of the block, 0 if none */
+} OVLBLOCK;
+
+static OVLBLOCK *ovlblocks;     /* blocks in their original order */
+static int *ovlorder;           /* indices in ovlblocks[], in the order of writing */
+static int ovlblock_count;
+static AMX_OVLGROUP *ovlgrouptab;
+
+static void ovl_free(void)
+{
+  if (ovlblocks!=NULL) {
+    free(ovlblocks);
+    ovlblocks=NULL;
+  } /* if */
+  if (ovlorder!=NULL) {
+    free(ovlorder);
+    ovlorder=NULL;
+  } /* if */
+  if (ovlgrouptab!=NULL) {
+    free(ovlgrouptab);
+    ovlgrouptab=NULL;
+  } /* if */
+  ovlblock_count=0;
+}
+
+/* set up a single block for all code */
+static void ovl_single(void)
+{
+  ovl_free();
+  ovlblocks=(OVLBLOCK *)malloc(sizeof(OVLBLOCK));
+  ovlorder=(int *)malloc(sizeof(int));
+  if (ovlblocks==NULL || ovlorder==NULL)
+    error(103);                 /* insufficient memory */
+  ovlblocks[0].firstrec=0;
+  ovlblocks[0].lastrec=asmcode_count;
+  ovlblocks[0].firstparam=0;
+  ovlblocks[0].addr=ovlblocks[0].newaddr=0;
+  ovlblocks[0].size=code_idx;
+  ovlblocks[0].group=0;
+  ovlorder[0]=0;
+  ovlblock_count=1;
+}
+
+/* find the block that holds the code at the address, the block must exist */
+static int ovl_findblock(cell addr)
+{
+  int low=0,high=ovlblock_count-1,mid;
+
+  while (low<high) {
+    mid=(low+high+1)/2;
+    if (ovlblocks[mid].addr<=addr)
+      low=mid;
+    else
+      high=mid-1;
+  } /* while */
+  return low;
+}
+
+/* ovl_remap
+ *
+ * Returns the address of the code at "addr" after the overlays are grouped.
+ * An "end" address is the address just behind a range of code, and it is
+ * adjusted together with the last byte of that range.
+ */
+static cell ovl_remap(cell addr,int end)
+{
+  int k;
+
+  if (ovlblock_count<=1 || addr<0 || addr>code_idx || end && addr==0)
+    return addr;
+  if (end) {
+    k=ovl_findblock(addr-1);
+    return ovlblocks[k].newaddr+(addr-ovlblocks[k].addr);
+  } /* if */
+  if (addr==code_idx)
+    return addr;
+  k=ovl_findblock(addr);
+  return ovlblocks[k].newaddr+(addr-ovlblocks[k].addr);
+}
+
+/* returns the index of the label in the parameters of an instruction, -1 if
+ * the instruction has no label, or -2 if it refers to the address of another
+ * function
+ */
+static int labelparam(const ASMRECORD *rec)
+{
+  OPCODE_PROC func=opcodelist[rec->index].func;
+
+  if (func==do_call)
+    return (rec->sym==NULL) ? 0 : -2;
+  if (func==do_jump || func==do_switch || func==do_jumpcase)
+    return 0;
+  if (func==do_case || func==do_jumptbl)
+    return 1;
+  return -1;
+}
+
+static int cmp_ovlstart(const void *p1,const void *p2)
+{
+  const cell *c1=(const cell *)p1;
+  const cell *c2=(const cell *)p2;
+  return (c1[0]<c2[0]) ? -1 : (c1[0]>c2[0]);
+}
+
+/* ovl_layout
+ *
+ * Cuts the code into blocks at the start of every overlay and sets the order
+ * of the blocks, so that the overlays of each group are adjacent. Returns the
+ * number of groups; if the blocks cannot be moved safely, the code keeps its
+ * original order and there are no groups.
+ */
+static int ovl_layout(void)
+{
+  cell *starts;         /* pairs of start address and group */
+  int *lblblock,*groupsize,*groupmembers,*groupnum;
+  int numstarts,numgroups,maxgroup,i,k,blk,n,tail,ok;
+  cell codeindex,size;
+  symbol *sym;
+  statelist *stlist;
+  ASMRECORD *rec;
+  ucell *params;
+
+  ovl_single();
+  pc_ovlgroups=0;
+  pc_ovlgroupsize=0;
+  if (pc_overlays==0)
+    return 0;
+
+  /* collect the start addresses of all overlays */
+  maxgroup=0;
+  numstarts=ovlFIRST;
+  for (sym=glbtab.next; sym!=NULL; sym=sym->next) {
+    if (sym->ident==iFUNCTN) {
+      numstarts++;
+      if (sym->states!=NULL)
+        for (stlist=sym->states->next; stlist!=NULL; stlist=stlist->next)
+          numstarts++;
+      if (sym->ovlgroup>maxgroup)
+        maxgroup=sym->ovlgroup;
+    } /* if */
+  } /* for */
+  if (maxgroup==0)
+    return 0;
+  starts=(cell *)malloc(2*numstarts*sizeof(cell));
+  if (starts==NULL)
+    error(103);                 /* insufficient memory */
+  n=0;
+  for (i=0; i<ovlFIRST; i++) {
+    if (pc_ovl0size[i][1]!=0) {
+      starts[2*n]=pc_ovl0size[i][0];
+      starts[2*n+1]=0;
+      n++;
+    } /* if */
+  } /* for */
+  for (sym=glbtab.next; sym!=NULL; sym=sym->next) {
+    if (sym->ident==iFUNCTN
+        && (sym->usage & uNATIVE)==0 && (sym->usage & (uREAD | uPUBLIC))!=0
+        && (sym->usage & uDEFINE)!=0)
+    {
+      if (strcmp(sym->name,uENTRYFUNC)!=0) {
+        starts[2*n]=sym->addr;
+        starts[2*n+1]=sym->ovlgroup;
+        n++;
+      } /* if */
+      if (sym->states!=NULL) {
+        for (stlist=sym->states->next; stlist!=NULL; stlist=stlist->next) {
+          starts[2*n]=stlist->addr;
+          starts[2*n+1]=0;
+          n++;
+        } /* for */
+      } /* if */
+    } /* if */
+  } /* for */
+  assert(n<=numstarts);
+  numstarts=n;
+  qsort(starts,numstarts,2*sizeof(cell),cmp_ovlstart);
+
+  /* cut the records into blocks; a label at the start of an overlay still
+   * belongs to the previous function, other records without code (like the
+   * "code" directive) belong to the next
+   */
+  ovl_free();
+  ovlblocks=(OVLBLOCK *)malloc((numstarts+1)*sizeof(OVLBLOCK));
+  ovlorder=(int *)malloc((numstarts+1)*sizeof(int));
+  lblblock=(int *)malloc((sc_labnum+1)*sizeof(int));
+  groupsize=(int *)malloc((maxgroup+1)*sizeof(int));
+  groupmembers=(int *)malloc((maxgroup+1)*sizeof(int));
+  groupnum=(int *)malloc((maxgroup+1)*sizeof(int));
+  if (ovlblocks==NULL || ovlorder==NULL || lblblock==NULL || groupsize==NULL
+      || groupmembers==NULL || groupnum==NULL)
+    error(103);                 /* insufficient memory */
+  ok=TRUE;
+  blk=0;
+  i=(numstarts>0 && starts[0]==0) ? 1 : 0;  /* next overlay start */
+  ovlblocks[0].firstrec=0;
+  ovlblocks[0].firstparam=0;
+  ovlblocks[0].addr=0;
+  ovlblocks[0].group=(i==1) ? (int)starts[1] : 0;
+  codeindex=0;
+  tail=-1;              /* first record of the trailing records without code */
+  params=asmparams;
+  for (rec=asmcode; ok && rec<asmcode+asmcode_count; params+=rec->numparams,rec++) {
+    if (rec->index==0) {
+      lblblock[(int)params[0]]=blk;
+      tail=-1;
+      continue;
+    } /* if */
+    if (opcodelist[rec->index].segment!=sIN_CSEG) {
+      if (tail<0)
+        tail=(int)(rec-asmcode);
+      continue;
+    } /* if */
+    size=opcodelist[rec->index].func(NULL,rec,params,opcodelist[rec->index].opcode,codeindex);
+    if (size==0) {
+      if (tail<0)
+        tail=(int)(rec-asmcode);
+      continue;
+    } /* if */
+    if (i<numstarts && codeindex>starts[2*i])
+      ok=FALSE;         /* an overlay starts inside an instruction */
+    if (i<numstarts && codeindex==starts[2*i]) {
+      int first=(tail>=0) ? tail : (int)(rec-asmcode);
+      ovlblocks[blk].lastrec=first;
+      ovlblocks[blk].size=codeindex-ovlblocks[blk].addr;
+      blk++;
+      ovlblocks[blk].firstrec=first;
+      ovlblocks[blk].firstparam=(int)(params-asmparams);
+      while (first<(int)(rec-asmcode))
+        ovlblocks[blk].firstparam-=asmcode[first++].numparams;
+      ovlblocks[blk].addr=codeindex;
+      ovlblocks[blk].group=(int)starts[2*i+1];
+      i++;
+    } /* if */
+    tail=-1;
+    codeindex+=size;
+  } /* for */
+  ovlblocks[blk].lastrec=asmcode_count;
+  ovlblocks[blk].size=codeindex-ovlblocks[blk].addr;
+  ovlblock_count=blk+1;
+  if (i<numstarts || codeindex!=code_idx)
+    ok=FALSE;
+
+  /* every jump must stay inside its block */
+  for (blk=0; ok && blk<ovlblock_count; blk++) {
+    params=asmparams+ovlblocks[blk].firstparam;
+    for (k=ovlblocks[blk].firstrec; ok && k<ovlblocks[blk].lastrec; params+=asmcode[k].numparams,k++) {
+      rec=&asmcode[k];
+      if (rec->index==0 || opcodelist[rec->index].segment!=sIN_CSEG)
+        continue;
+      n=labelparam(rec);
+      if (n==-2 || n>=0 && lblblock[(int)params[n]]!=blk)
+        ok=FALSE;
+    } /* for */
+  } /* for */
+
+  /* measure the groups; drop the groups that do not fit in the overlay pool */
+  numgroups=0;
+  if (ok) {
+    for (i=0; i<=maxgroup; i++)
+      groupsize[i]=groupmembers[i]=groupnum[i]=0;
+    for (blk=0; blk<ovlblock_count; blk++) {
+      groupsize[ovlblocks[blk].group]+=(int)ovlblocks[blk].size;
+      groupmembers[ovlblocks[blk].group]++;
+    } /* for */
+    for (i=1; i<=maxgroup; i++)
+      if (groupmembers[i]<2 || pc_overlays>1 && groupsize[i]>pc_overlays)
+        groupmembers[i]=0;
+    for (blk=0; blk<ovlblock_count; blk++)
+      if (groupmembers[ovlblocks[blk].group]==0)
+        ovlblocks[blk].group=0;
+    /* write every group at the position of its first block */
+    n=0;
+    for (blk=0; blk<ovlblock_count; blk++) {
+      int group=ovlblocks[blk].group;
+      if (group==0) {
+        ovlorder[n++]=blk;
+      } else if (groupnum[group]==0) {
+        groupnum[group]=++numgroups;
+        for (k=blk; k<ovlblock_count; k++)
+          if (ovlblocks[k].group==group)
+            ovlorder[n++]=k;
+      } /* if */
+    } /* for */
+    assert(n==ovlblock_count);
+    codeindex=0;
+    for (k=0; k<ovlblock_count; k++) {
+      ovlblocks[ovlorder[k]].newaddr=codeindex;
+      codeindex+=ovlblocks[ovlorder[k]].size;
+    } /* for */
+    assert(codeindex==code_idx);
+  } /* if */
+
+  if (numgroups>0) {
+    ovlgrouptab=(AMX_OVLGROUP *)malloc(numgroups*sizeof(AMX_OVLGROUP));
+    if (ovlgrouptab==NULL)
+      error(103);               /* insufficient memory */
+    for (k=0; k<ovlblock_count; k++) {
+      OVLBLOCK *block=&ovlblocks[ovlorder[k]];
+      if (block->group!=0 && groupsize[block->group]>0) {
+        i=groupnum[block->group]-1;
+        ovlgrouptab[i].offset=(int32_t)block->newaddr;
+        ovlgrouptab[i].size=(int32_t)groupsize[block->group];
+        if (pc_ovlgroupsize<groupsize[block->group])
+          pc_ovlgroupsize=groupsize[block->group];
+        groupsize[block->group]=0;  /* the first block of the group is done */
+      } /* if */
+    } /* for */
+    pc_ovlgroups=numgroups;
+
+    /* adjust the overlay addresses */
+    for (i=0; i<ovlFIRST; i++)
+      if (pc_ovl0size[i][1]!=0)
+        pc_ovl0size[i][0]=(int)ovl_remap(pc_ovl0size[i][0],FALSE);
+    for (sym=glbtab.next; sym!=NULL; sym=sym->next) {
+      if (sym->ident==iFUNCTN
+          && (sym->usage & uNATIVE)==0 && (sym->usage & (uREAD | uPUBLIC))!=0
+          && (sym->usage & uDEFINE)!=0)
+      {
+        if (strcmp(sym->name,uENTRYFUNC)!=0) {
+          sym->codeaddr=ovl_remap(sym->codeaddr,TRUE);
+          sym->addr=ovl_remap(sym->addr,FALSE);
+        } /* if */
+        if (sym->states!=NULL) {
+          for (stlist=sym->states->next; stlist!=NULL; stlist=stlist->next) {
+            stlist->endaddr=ovl_remap(stlist->endaddr,TRUE);
+            stlist->addr=ovl_remap(stlist->addr,FALSE);
+          } /* for */
+        } /* if */
+      } /* if */
+    } /* for */
+  } else {
+    ovl_single();
+  } /* if */
+
+  free(starts);
+  free(lblblock);
+  free(groupsize);
+  free(groupmembers);
+  free(groupnum);
+  return numgroups;
+}
+
+SC_FUNC int assemble(FILE *fout)
 {
   AMX_HEADER hdr;
   AMX_FUNCSTUB func;
   int numpublics,numnatives,numoverlays,numlibraries,numpubvars,numtags;
-  int padding;
+  int numgroups,groupsize,padding;
   long nametablesize,nameofs;
-  char line[512];
-  char *instr,*params;
-  int i,pass,size;
+  int i,k,pass,size;
   int16_t count;
   symbol *sym;
   symbol **nativelist;
   constvalue *constptr;
   cell mainaddr;
   char nullchar;
+  ASMRECORD *rec;
+  ucell *params;
 
   #if !defined NDEBUG
     /* verify that the opcode list is sorted (skip entry 1; it is reserved
      * for a non-existant opcode)
      */
     {
-      #define MAX_OPCODE 176
+      #define MAX_OPCODE 178
       unsigned char opcodearray[MAX_OPCODE+1];
       assert(opcodelist[1].name!=NULL);
       memset(opcodearray,0,sizeof opcodearray);
@@ -692,6 +1296,13 @@ SC_FUNC int assemble(FILE *fout,FILE *fin)
     }
   #endif
 
+  /* a last line without '\n' is still pending */
+  if (asmline_length>0)
+    asmcode_write("\n");
+  /* group the overlays, this adjusts the addresses of the functions */
+  numgroups=ovl_layout();
+  groupsize=(numgroups>0) ? numgroups*sizeof(AMX_OVLGROUP)+sizeof(AMX_OVLGROUPS) : 0;
+
   writeerror=FALSE;
   nametablesize=sizeof(int16_t);
   numpublics=0;
@@ -773,7 +1384,7 @@ SC_FUNC int assemble(FILE *fout,FILE *fin)
    * => and thereby the stack top is aligned too
    */
   assert(sc_dataalign!=0);
-  padding= (int)(sc_dataalign - (sizeof hdr + nametablesize) % sc_dataalign);
+  padding= (int)(sc_dataalign - (sizeof hdr + nametablesize + groupsize) % sc_dataalign);
   if (padding==sc_dataalign)
     padding=0;
 
@@ -804,7 +1415,7 @@ SC_FUNC int assemble(FILE *fout,FILE *fin)
   hdr.tags=hdr.pubvars + numpubvars*sizeof(AMX_FUNCSTUB);
   hdr.overlays=hdr.tags + numtags*sizeof(AMX_FUNCSTUB);
   hdr.nametable=hdr.overlays + numoverlays*sizeof(AMX_OVERLAYINFO);
-  hdr.cod=hdr.nametable + nametablesize + padding;
+  hdr.cod=hdr.nametable + nametablesize + padding + groupsize; /* the group table ends at the code */
   hdr.dat=(int32_t)(hdr.cod + code_idx);
   hdr.hea=(int32_t)(hdr.dat + glb_declared*pc_cellsize);
   hdr.stp=(int32_t)(hdr.hea + pc_stksize*pc_cellsize);
@@ -1022,6 +1633,28 @@ SC_FUNC int assemble(FILE *fout,FILE *fin)
       } /* if */
     } /* for */
   } /* if */
+
+  /* write the overlay groups, with the trailer that a host looks for */
+  if (numgroups>0) {
+    AMX_OVLGROUP group;
+    AMX_OVLGROUPS trailer;
+    pc_resetbin(fout,hdr.cod-groupsize);
+    for (i=0; i<numgroups; i++) {
+      group=ovlgrouptab[i];
+      #if BYTE_ORDER==BIG_ENDIAN
+        align32((uint32_t*)&group.offset);
+        align32((uint32_t*)&group.size);
+      #endif
+      pc_writebin(fout,&group,sizeof group);
+    } /* for */
+    trailer.count=numgroups;
+    trailer.magic=AMX_OVLGROUP_MAGIC;
+    #if BYTE_ORDER==BIG_ENDIAN
+      align32((uint32_t*)&trailer.count);
+      align32(&trailer.magic);
+    #endif
+    pc_writebin(fout,&trailer,sizeof trailer);
+  } /* if */
   pc_resetbin(fout,hdr.cod);
 
   /* First pass: relocate all labels */
@@ -1038,57 +1671,45 @@ SC_FUNC int assemble(FILE *fout,FILE *fin)
     if (lbltab==NULL)
       error(103);               /* insufficient memory */
     memset(lbltab,0,sc_labnum*sizeof(cell));
-    pc_resetasm(fin);
-    while (pc_readasm(fin,line,sizeof line)!=NULL) {
-      stripcomment(line);
-      instr=skipwhitespace(line);
-      /* ignore empty lines */
-      if (*instr=='\0')
-        continue;
-      if (tolower(*instr)=='l' && *(instr+1)=='.') {
-        int lindex=(int)hex2ucell(instr+2,NULL);
-        assert(lindex>=0 && lindex<sc_labnum);
-        assert(lbltab[lindex]==0);  /* should not already be declared */
-        lbltab[lindex]=codeindex;
-      } else {
-        /* get to the end of the instruction (make use of the '\n' that fgets()
-         * added at the end of the line; this way we will *always* drop on a
-         * whitespace character) */
-        for (params=instr; *params!='\0' && !isspace(*params); params++)
-          /* nothing */;
-        assert(params>instr);
-        i=findopcode(instr,(int)(params-instr));
-        assert(opcodelist[i].name!=NULL);
-        assert(opcodelist[i].opt_level<=pc_optimize || pc_optimize==0 && opcodelist[i].opt_level<=1);
-        if (opcodelist[i].segment==sIN_CSEG)
-          codeindex+=opcodelist[i].func(NULL,skipwhitespace(params),opcodelist[i].opcode,codeindex);
-      } /* if */
-    } /* while */
+    for (k=0; k<ovlblock_count; k++) {
+      const OVLBLOCK *block=&ovlblocks[ovlorder[k]];
+      params=asmparams+block->firstparam;
+      for (rec=asmcode+block->firstrec; rec<asmcode+block->lastrec; params+=rec->numparams,rec++) {
+        if (rec->index==0) {
+          int lindex=(int)params[0];
+          assert(lindex>=0 && lindex<sc_labnum);
+          assert(lbltab[lindex]==0);  /* should not already be declared */
+          lbltab[lindex]=codeindex;
+        } else if (opcodelist[rec->index].segment==sIN_CSEG) {
+          codeindex+=opcodelist[rec->index].func(NULL,rec,params,opcodelist[rec->index].opcode,codeindex);
+        } /* if */
+      } /* for */
+    } /* for */
   } /* if */
 
+  /* the icon and name are picked from the data segment while it is written */
+  memset(&metadata,0,sizeof metadata);
+  meta_icon=findglb("program_icon",sGLOBAL);
+  if (meta_icon!=NULL && (meta_icon->ident!=iARRAY || meta_icon->dim.array.level!=0))
+    meta_icon=NULL;
+  meta_name=findglb("program_name",sGLOBAL);
+  if (meta_name!=NULL && (meta_name->ident!=iARRAY || meta_name->dim.array.level!=0))
+    meta_name=NULL;
+
   /* Second pass (actually 2 more passes, one for all code and one for all data) */
   for (pass=sIN_CSEG; pass<=sIN_DSEG; pass++) {
     cell codeindex=0; /* address of the current opcode similar to "code_idx" */
-    pc_resetasm(fin);
-    while (pc_readasm(fin,line,sizeof line)!=NULL) {
-      stripcomment(line);
-      instr=skipwhitespace(line);
-      /* ignore empty lines and labels (labels have a special syntax, so these
-       * must be parsed separately) */
-      if (*instr=='\0' || tolower(*instr)=='l' && *(instr+1)=='.')
-        continue;
-      /* get to the end of the instruction (make use of the '\n' that fgets()
-       * added at the end of the line; this way we will *always* drop on a
-       * whitespace character) */
-      for (params=instr; *params!='\0' && !isspace(*params); params++)
-        /* nothing */;
-      assert(params>instr);
-      i=findopcode(instr,(int)(params-instr));
-      assert(opcodelist[i].name!=NULL);
-      assert(opcodelist[i].opt_level<=pc_optimize || pc_optimize==0 && opcodelist[i].opt_level<=1);
-      if (opcodelist[i].segment==pass)
-        codeindex+=opcodelist[i].func(fout,skipwhitespace(params),opcodelist[i].opcode,codeindex);
-    } /* while */
+    for (k=0; k<ovlblock_count; k++) {
+      /* the code is written in the order of the overlay groups, the data
+       * keeps its order */
+      const OVLBLOCK *block=&ovlblocks[(pass==sIN_CSEG) ? ovlorder[k] : k];
+      params=asmparams+block->firstparam;
+      for (rec=asmcode+block->firstrec; rec<asmcode+block->lastrec; params+=rec->numparams,rec++) {
+        /* skip labels */
+        if (rec->index!=0 && opcodelist[rec->index].segment==pass)
+          codeindex+=opcodelist[rec->index].func(fout,rec,params,opcodelist[rec->index].opcode,codeindex);
+      } /* for */
+    } /* for */
   } /* for */
 
   if (lbltab!=NULL) {
@@ -1101,6 +1722,9 @@ SC_FUNC int assemble(FILE *fout,FILE *fin)
   assert(hdr.size==pc_lengthbin(fout));
   if (!writeerror && (sc_debug & sSYMBOLIC)!=0)
     append_dbginfo(fout);       /* optionally append debug file */
+  if (!writeerror && (meta_icon!=NULL || meta_name!=NULL))
+    append_metadata(fout,&hdr); /* must be the last block in the file */
+  ovl_free();
 
   if (writeerror)
     error(101,"disk full");
@@ -1133,15 +1757,160 @@ SC_FUNC int assemble(FILE *fout,FILE *fin)
   return size;
 }
 
+static void append_metadata(FILE *fout,AMX_HEADER *hdr)
+{
+  symbol *sym;
+  int i;
+
+  if (meta_icon!=NULL)
+    metadata.icon_rows=(int32_t)((meta_icon->dim.array.length<(cell)sizearray(metadata.icon)) ?
+                                 meta_icon->dim.array.length : sizearray(metadata.icon));
+  metadata.name[sizeof metadata.name-1]='\0';
+  sym=findconst("program_version");
+  metadata.version=(sym!=NULL) ? (int32_t)sym->addr : 0;
+  /* with overlays, only the overlay table (in front of the code) and the
+   * data and stack must be resident; the code is swapped in from the pool
+   */
+  if ((hdr->flags & AMX_FLAG_OVERLAY)!=0)
+    metadata.memory=hdr->cod+(hdr->stp-hdr->dat);
+  else
+    metadata.memory=hdr->stp;
+  metadata.size=sizeof metadata;
+  metadata.magic=AMX_META_MAGIC;
+
+  #if BYTE_ORDER==BIG_ENDIAN
+    for (i=0; i<(int)sizearray(metadata.icon); i++)
+      align32(&metadata.icon[i]);
+    align32((uint32_t*)&metadata.icon_rows);
+    align32((uint32_t*)&metadata.version);
+    align32((uint32_t*)&metadata.memory);
+    align32((uint32_t*)&metadata.size);
+    align32(&metadata.magic);
+  #else
+    (void)i;
+  #endif
+  writeerror |= !pc_writebin(fout,&metadata,sizeof metadata);
+}
+
+/* an entry in the file or the line table of the debug information */
+typedef struct {
+  ucell address;
+  int seq;              /* position in the debug strings, -1 for an added file entry */
+  const char *str;      /* file name or line number */
+} DBGENTRY;
+
+static int cmp_dbgentry(const void *p1,const void *p2)
+{
+  const DBGENTRY *e1=(const DBGENTRY *)p1;
+  const DBGENTRY *e2=(const DBGENTRY *)p2;
+  if (e1->address!=e2->address)
+    return (e1->address<e2->address) ? -1 : 1;
+  return (e1->seq<e2->seq) ? -1 : (e1->seq>e2->seq);
+}
+
+/* collect_dbgentries
+ *
+ * Returns the file ("F") or line ("L") entries of the debug information, at
+ * their addresses after the overlays are grouped and sorted on these
+ * addresses. Of the files that start at the same address, only the last one
+ * is kept. When blocks of code have moved, every block starts with the file
+ * that it started with before.
+ */
+static DBGENTRY *collect_dbgentries(char type,int *count)
+{
+  DBGENTRY *list;
+  const char *str;
+  int index,num,k,i;
+
+  num=(type=='F') ? ovlblock_count : 0;
+  for (index=0; (str=get_dbgstring(index))!=NULL; index++)
+    if (str[0]==type)
+      num++;
+  list=(DBGENTRY *)malloc((num+1)*sizeof(DBGENTRY));
+  if (list==NULL)
+    error(103);                 /* insufficient memory */
+  num=0;
+  for (index=0; (str=get_dbgstring(index))!=NULL; index++) {
+    assert(str[0]!='\0' && str[1]==':');
+    if (str[0]==type) {
+      list[num].address=hex2ucell(str+2,&str);
+      list[num].seq=index;
+      list[num].str=skipwhitespace(str);
+      num++;
+    } /* if */
+  } /* for */
+  if (ovlblock_count>1) {
+    if (type=='F') {
+      int files=num;
+      for (k=1; k<ovlblock_count; k++) {
+        for (i=files-1; i>=0 && list[i].address>(ucell)ovlblocks[k].addr; i--)
+          /* nothing */;
+        if (i>=0) {
+          list[num].address=ovlblocks[k].addr;
+          list[num].seq=-1;
+          list[num].str=list[i].str;
+          num++;
+        } /* if */
+      } /* for */
+    } /* if */
+    for (i=0; i<num; i++)
+      list[i].address=(ucell)ovl_remap((cell)list[i].address,FALSE);
+    qsort(list,num,sizeof(DBGENTRY),cmp_dbgentry);
+  } /* if */
+  if (type=='F') {
+    for (i=k=0; i<num; i++) {
+      if (i+1<num && list[i+1].address==list[i].address)
+        continue;               /* a later file at the same address replaces it */
+      if (list[i].seq<0 && k>0 && strcmp(list[k-1].str,list[i].str)==0)
+        continue;               /* added entry for the file that is already active */
+      list[k++]=list[i];
+    } /* for */
+    num=k;
+  } /* if */
+  *count=num;
+  return list;
+}
+
+/* adjust the code range of a symbol for the grouped overlays; a range that
+ * spans more than one block is widened to cover all these blocks
+ */
+static void remap_dbgrange(cell *start,cell *end)
+{
+  int first,last,k;
+  cell low,high;
+
+  if (ovlblock_count<=1 || *end<=*start || *start<0 || *end>code_idx)
+    return;
+  first=ovl_findblock(*start);
+  last=ovl_findblock(*end-1);
+  if (first==last) {
+    *start=ovl_remap(*start,FALSE);
+    *end=ovl_remap(*end,TRUE);
+    return;
+  } /* if */
+  low=code_idx;
+  high=0;
+  for (k=first; k<=last; k++) {
+    if (low>ovlblocks[k].newaddr)
+      low=ovlblocks[k].newaddr;
+    if (high<ovlblocks[k].newaddr+ovlblocks[k].size)
+      high=ovlblocks[k].newaddr+ovlblocks[k].size;
+  } /* for */
+  *start=low;
+  *end=high;
+}
+
 static void append_dbginfo(FILE *fout)
 {
   AMX_DBG_HDR dbghdr;
   AMX_DBG_LINE dbgline;
   AMX_DBG_SYMBOL dbgsym;
   AMX_DBG_SYMDIM dbgidxtag[sDIMEN_MAX];
+  DBGENTRY *files,*lines;
+  int numfiles,numlines;
   int index,dim,dbgsymdim;
-  const char *str,*prevstr,*name,*prevname;
-  ucell codeidx,previdx;
+  const char *str,*prevstr,*name;
+  ucell previdx;
   constvalue *constptr;
   char symname[2*sNAMEMAX+16];
   int16_t id1,id2;
@@ -1157,41 +1926,16 @@ static void append_dbginfo(FILE *fout)
   /* first pass: collect the number of items in various tables */
 
   /* file table */
-  previdx=0;
-  prevstr=NULL;
-  prevname=NULL;
-  for (index=0; (str=get_dbgstring(index))!=NULL; index++) {
-    assert(str!=NULL);
-    assert(str[0]!='\0' && str[1]==':');
-    if (str[0]=='F') {
-      codeidx=hex2ucell(str+2,&name);
-      if (codeidx!=previdx) {
-        if (prevstr!=NULL) {
-          assert(prevname!=NULL);
-          dbghdr.files++;
-          dbghdr.size+=(int32_t)(sizeof(AMX_DBG_FILE)+strlen(prevname));
-        } /* if */
-        previdx=codeidx;
-      } /* if */
-      prevstr=str;
-      prevname=skipwhitespace(name);
-    } /* if */
-  } /* for */
-  if (prevstr!=NULL) {
-    assert(prevname!=NULL);
+  files=collect_dbgentries('F',&numfiles);
+  for (index=0; index<numfiles; index++) {
     dbghdr.files++;
-    dbghdr.size+=(int32_t)(sizeof(AMX_DBG_FILE)+strlen(prevname));
-  } /* if */
+    dbghdr.size+=(int32_t)(sizeof(AMX_DBG_FILE)+strlen(files[index].str));
+  } /* for */
 
   /* line number table */
-  for (index=0; (str=get_dbgstring(index))!=NULL; index++) {
-    assert(str!=NULL);
-    assert(str[0]!='\0' && str[1]==':');
-    if (str[0]=='L') {
-      dbghdr.lines++;
-      dbghdr.size+=sizeof(AMX_DBG_LINE);
-    } /* if */
-  } /* for */
+  lines=collect_dbgentries('L',&numlines);
+  dbghdr.lines=(int16_t)numlines;
+  dbghdr.size+=numlines*sizeof(AMX_DBG_LINE);
 
   /* symbol table */
   for (index=0; (str=get_dbgstring(index))!=NULL; index++) {
@@ -1250,52 +1994,27 @@ static void append_dbginfo(FILE *fout)
   writeerror |= !pc_writebin(fout,&dbghdr,sizeof dbghdr);
 
   /* file table */
-  previdx=0;
-  prevstr=NULL;
-  prevname=NULL;
-  for (index=0; (str=get_dbgstring(index))!=NULL; index++) {
-    assert(str!=NULL);
-    assert(str[0]!='\0' && str[1]==':');
-    if (str[0]=='F') {
-      codeidx=hex2ucell(str+2,&name);
-      if (codeidx!=previdx) {
-        if (prevstr!=NULL) {
-          assert(prevname!=NULL);
-          #if BYTE_ORDER==BIG_ENDIAN
-            align32(&previdx);
-          #endif
-          writeerror |= !pc_writebin(fout,&previdx,sizeof(uint32_t));
-          writeerror |= !pc_writebin(fout,prevname,(int)strlen(prevname)+1);
-        } /* if */
-        previdx=codeidx;
-      } /* if */
-      prevstr=str;
-      prevname=skipwhitespace(name);
-    } /* if */
-  } /* for */
-  if (prevstr!=NULL) {
-    assert(prevname!=NULL);
+  for (index=0; index<numfiles; index++) {
+    previdx=files[index].address;
     #if BYTE_ORDER==BIG_ENDIAN
       align32(&previdx);
     #endif
     writeerror |= !pc_writebin(fout,&previdx,sizeof(uint32_t));
-    writeerror |= !pc_writebin(fout,prevname,(int)strlen(prevname)+1);
-  } /* if */
+    writeerror |= !pc_writebin(fout,files[index].str,(int)strlen(files[index].str)+1);
+  } /* for */
+  free(files);
 
   /* line number table */
-  for (index=0; (str=get_dbgstring(index))!=NULL; index++) {
-    assert(str!=NULL);
-    assert(str[0]!='\0' && str[1]==':');
-    if (str[0]=='L') {
-      dbgline.address=(uint32_t)hex2ucell(str+2,&str);
-      dbgline.line=(int32_t)hex2ucell(str,NULL);
-      #if BYTE_ORDER==BIG_ENDIAN
-        align32(&dbgline.address);
-        align32(&dbgline.line);
-      #endif
-      writeerror |= !pc_writebin(fout,&dbgline,sizeof dbgline);
-    } /* if */
+  for (index=0; index<numlines; index++) {
+    dbgline.address=(uint32_t)lines[index].address;
+    dbgline.line=(int32_t)hex2ucell(lines[index].str,NULL);
+    #if BYTE_ORDER==BIG_ENDIAN
+      align32(&dbgline.address);
+      align32(&dbgline.line);
+    #endif
+    writeerror |= !pc_writebin(fout,&dbgline,sizeof dbgline);
   } /* for */
+  free(lines);
 
   /* symbol table */
   for (index=0; (str=get_dbgstring(index))!=NULL; index++) {
@@ -1315,10 +2034,21 @@ static void append_dbginfo(FILE *fout)
       dbgsym.codeend=(uint32_t)hex2ucell(str,&str);
       dbgsym.ident=(char)hex2ucell(str,&str);
       dbgsym.vclass=(char)hex2ucell(str,&str);
+      if (dbgsym.ident==iFUNCTN) {
+        dbgsym.address=(uint32_t)ovl_remap((cell)dbgsym.address,FALSE);
+        dbgsym.codestart=(uint32_t)ovl_remap((cell)dbgsym.codestart,FALSE);
+        dbgsym.codeend=(uint32_t)ovl_remap((cell)dbgsym.codeend,TRUE);
+      } else {
+        cell start=(cell)dbgsym.codestart,end=(cell)dbgsym.codeend;
+        remap_dbgrange(&start,&end);
+        dbgsym.codestart=(uint32_t)start;
+        dbgsym.codeend=(uint32_t)end;
+      } /* if */
       dbgsym.dim=0;
       str=skipwhitespace(str);
       if (*str=='[') {
         while (*(str=skipwhitespace(str+1))!=']') {
+          dbgidxtag[dbgsym.dim].tag=0;  /* index tags are not recorded */
           dbgidxtag[dbgsym.dim].size=(uint32_t)hex2ucell(str,&str);
           dbgsym.dim++;
         } /* while */
@@ -48,6 +48,7 @@
 #include <stdlib.h>     /* for atoi() */
 #include <string.h>
 #include <ctype.h>
+#include <time.h>       /* for clock() */
 #if defined FORTIFY
   #include <alloc/fortify.h>
 #endif
@@ -74,17 +75,16 @@
 
 static int stgstring(char *start,char *end);
 static void stgopt(char *start,char *end,int (*outputfunc)(char *str));
+static int inlcapture(char *str);
 
 
 #define sSTG_GROW   512
 #define sSTG_MAX    20480
 
-static char *stgbuf=NULL;
-static int stgmax=0;    /* current size of the staging buffer */
-
-static char *stgpipe=NULL;
-static int pipemax=0;   /* current size of the stage pipe, a second staging buffer */
-static int pipeidx=0;
+static char *inlbuf=NULL;   /* captured code of the function that is being compiled */
+static int inlmax=0;
+static int inlidx=-1;       /* -1 if not capturing */
+static cell inlstart;       /* code index at the start of the function body */
 
 #define CHECK_STGBUFFER(index) if ((int)(index)>=stgmax)  grow_stgbuffer(&stgbuf, &stgmax, (index)+1)
 #define CHECK_STGPIPE(index)   if ((int)(index)>=pipemax) grow_stgbuffer(&stgpipe, &pipemax, (index)+1)
@@ -127,6 +127,12 @@ SC_FUNC void stgbuffer_cleanup(void)
     pipemax=0;
     pipeidx=0;
   } /* if */
+  if (inlbuf!=NULL) {
+    free(inlbuf);
+    inlbuf=NULL;
+    inlmax=0;
+    inlidx=-1;
+  } /* if */
 }
 
 /* the variables "stgidx" and "staging" are declared in "scvars.c" */
@@ -172,8 +178,15 @@ static int rebuffer(char *str)
 
 static int filewrite(char *str)
 {
-  if (sc_status==statWRITE)
-    return pc_writeasm(outf,str);
+  if (sc_status==statWRITE) {
+    inlcapture(str);
+    /* only write text when an assembler file or a listing is requested,
+     * otherwise encode the instructions for the assembler directly
+     */
+    if (outf!=NULL)
+      return pc_writeasm(outf,str);
+    return asmcode_write(str);
+  } /* if */
   return TRUE;
 }
 
@@ -397,13 +410,568 @@ SC_FUNC void stgset(int onoff)
   stgbuf[0]='\0';
 }
 
+/*  Inline expansion of functions
+ *
+ *  In the final pass, the generated code of a function is captured from
+ *  filewrite(). When the function is small, takes only single-cell arguments
+ *  by value and does not change these arguments, the captured body is kept
+ *  with the symbol. A later call to this function where every argument is a
+ *  constant or a simple variable is then replaced by the body; the body reads
+ *  the arguments from their source instead of from the stack frame, so no
+ *  arguments are pushed and no stack frame is created. This saves the call
+ *  and the return, as well as the overlay switches when overlays are in use.
+ *  The break instructions of the body are dropped, so that the debug
+ *  information maps the inlined code to the line of the call.
+ */
+#define sINL_DEFSIZE  8   /* default size limit (in cells) */
+#define sINL_LABELS   16  /* max. number of labels in an inlined body */
+#define sINL_LINE     80  /* max. length of an instruction */
+
+static int inlcapture(char *str)
+{
+  int len;
+
+  if (inlidx<0)
+    return TRUE;
+  len=(int)strlen(str);
+  if (inlidx+len+1>sSTG_MAX/2) {
+    inlidx=-1;              /* too big to inline anyway, stop capturing */
+    return TRUE;
+  } /* if */
+  if (inlidx+len>=inlmax)
+    grow_stgbuffer(&inlbuf,&inlmax,inlidx+len+1);
+  memcpy(inlbuf+inlidx,str,len+1);
+  inlidx+=len;
+  return TRUE;
+}
+
+/* Split an instruction line into the mnemonic and the parameters; for a
+ * comment, the mnemonic is the first word of the comment (the optimizer
+ * markers start with ";$"). Returns FALSE if a field is too long.
+ */
+static int splitinstr(const char *line,char *name,char *params)
+{
+  int i;
+
+  assert(line!=NULL);
+  while (*line==' ' || *line=='\t')
+    line++;
+  for (i=0; *line>' ' && i<sINL_LINE-1; i++)
+    name[i]=*line++;
+  name[i]='\0';
+  if (*line>' ')
+    return FALSE;           /* mnemonic too long */
+  if (name[0]==';')
+    return TRUE;
+  while (*line==' ' || *line=='\t')
+    line++;
+  for (i=0; *line!='\0' && *line!=';' && *line!='\n' && i<sINL_LINE-1; i++)
+    params[i]=*line++;
+  while (i>0 && params[i-1]<=' ')
+    i--;
+  params[i]='\0';
+  return i<sINL_LINE-1;
+}
+
+/* Instructions that access the stack frame; the result is 1 for the ones
+ * that read an argument (and that can be substituted), or -1 for any other.
+ */
+static int frameaccess(const char *name)
+{
+  static const char *argloads[] = { "load.s.pri", "load.s.alt", "push.s", "load2.s", "pushm.s",
+                                    "load.p.s.pri", "load.p.s.alt", "push.p.s", "pushm.p.s" };
+  const char *ptr;
+  int i;
+
+  for (i=0; i<(int)(sizeof argloads/sizeof argloads[0]); i++)
+    if (strcmp(name,argloads[i])==0)
+      return 1;
+  if (strcmp(name,"lctrl")==0 || strcmp(name,"sctrl")==0
+      || strncmp(name,"addr",4)==0 && (name[4]=='\0' || name[4]=='.'))
+    return -1;
+  for (ptr=name; ptr!=NULL; ptr=strchr(ptr,'.')) {
+    if (*ptr=='.')
+      ptr++;
+    if (strncmp(ptr,"s",1)==0 && (ptr[1]=='\0' || ptr[1]=='.')
+        || strncmp(ptr,"adr",3)==0 && (ptr[3]=='\0' || ptr[3]=='.'))
+      return -1;
+  } /* for */
+  return 0;
+}
+
+/* Instructions that may change a global variable (directly or through a
+ * function call); with these, a global variable cannot be substituted for
+ * an argument.
+ */
+static int changesmemory(const char *name)
+{
+  static const char *stores[] = { "stor", "sref", "strb", "movs", "fill", "call",
+                                  "sysreq", "inc", "dec", "zero", "const" };
+  const char *ext;
+  int i,len;
+
+  ext=strchr(name,'.');
+  len= (ext!=NULL) ? (int)(ext-name) : (int)strlen(name);
+  for (i=0; i<(int)(sizeof stores/sizeof stores[0]); i++) {
+    if ((int)strlen(stores[i])==len && strncmp(name,stores[i],len)==0) {
+      /* register variants of inc, dec, zero and const do not touch memory */
+      if (i>=7 && ext!=NULL && (strcmp(ext,".pri")==0 || strcmp(ext,".alt")==0
+                                || strcmp(ext,".p.pri")==0 || strcmp(ext,".p.alt")==0))
+        return FALSE;
+      return TRUE;
+    } /* if */
+  } /* for */
+  return FALSE;
+}
+
+/* Returns the argument index for a frame offset, or -1 if the offset is not
+ * that of an argument.
+ */
+static int argindex(const char *param,int numargs)
+{
+  ucell offset=hex2ucell(param,NULL);
+
+  if (offset<3*(ucell)pc_cellsize || offset>=(ucell)(3+numargs)*pc_cellsize
+      || offset % pc_cellsize!=0)
+    return -1;
+  return (int)(offset/pc_cellsize)-3;
+}
+
+/*  inline_start
+ *
+ *  Starts capturing the code of a function, if inlining is enabled. This must
+ *  be called right after the function entry point is generated.
+ */
+SC_FUNC void inline_start(void)
+{
+  if (sc_status!=statWRITE || pc_optimize<sOPTIMIZE_MACRO || pc_inline==0)
+    return;
+  inlidx=0;
+  grow_stgbuffer(&inlbuf,&inlmax,sSTG_GROW);
+  inlbuf[0]='\0';
+  inlstart=code_idx;
+}
+
+/*  inline_finish
+ *
+ *  Stops capturing the code of the function and keeps the body with the
+ *  symbol if the function can be inlined.
+ */
+SC_FUNC void inline_finish(symbol *sym)
+{
+  char name[sINL_LINE],params[sINL_LINE];
+  char *line,*next,*code;
+  arginfo *arg;
+  int numargs,codeidx,retidx,limit;
+  cell size;
+
+  assert(sym!=NULL && sym->ident==iFUNCTN);
+  if (sym->inlinecode!=NULL) {
+    free(sym->inlinecode);
+    sym->inlinecode=NULL;
+  } /* if */
+  if (inlidx<0)
+    return;
+  inlidx=-1;                    /* stop capturing */
+  /* only single-cell arguments, passed by value */
+  numargs=0;
+  for (arg=sym->dim.arglist; arg->ident!=0; arg++) {
+    if (arg->ident!=iVARIABLE)
+      return;
+    numargs++;
+  } /* for */
+  if (finddepend(sym)!=NULL)
+    return;                     /* function returns an array */
+  if ((code=(char*)malloc(strlen(inlbuf)+1))==NULL)
+    return;
+  size=code_idx-inlstart;
+  codeidx=0;
+  retidx=-1;
+  for (line=inlbuf; *line!='\0'; line=next) {
+    if ((next=strchr(line,'\n'))!=NULL)
+      *next++='\0';
+    else
+      next=strchr(line,'\0');
+    if (line[0]=='l' && line[1]=='.') {
+      /* label, keep only the name */
+      params[0]='\0';
+      strncat(params,line,sINL_LINE-1);
+      strtok(params,"\t ");
+      codeidx+=sprintf(code+codeidx,"%s\n",params);
+      continue;
+    } /* if */
+    if (line[0]=='\0')
+      continue;
+    if (line[0]!='\t' && line[0]!=' ' || !splitinstr(line,name,params))
+      break;                    /* data or a segment directive */
+    if (name[0]=='\0' || name[0]==';') {
+      if (strcmp(name,";$par")==0)
+        codeidx+=sprintf(code+codeidx,"%s\n",name);
+      continue;
+    } /* if */
+    if (strcmp(name,"break")==0) {
+      size-=opcodes(1);
+      continue;
+    } /* if */
+    if (strcmp(name,"retn")==0 || strcmp(name,"retn.ovl")==0) {
+      size-=opcodes(1);
+      retidx=codeidx;
+      codeidx+=sprintf(code+codeidx,"retn\n");
+      continue;
+    } /* if */
+    if (strcmp(name,"ret")==0 || strncmp(name,"switch",6)==0 || strncmp(name,"case",4)==0)
+      break;
+    if (strncmp(name,"call",4)==0) {
+      /* no recursive functions */
+      if (pc_overlays>0 ? (int)hex2ucell(params,NULL)==sym->index : strcmp(params,sym->name)==0)
+        break;
+    } else if (frameaccess(name)!=0) {
+      char *ptr;
+      if (frameaccess(name)<0)
+        break;
+      /* the parameters must all be arguments of the function (after the
+       * count, for "pushm") */
+      ptr=strtok(params," ");
+      if (strncmp(name,"pushm",5)==0 && ptr!=NULL)
+        ptr=strtok(NULL," ");
+      while (ptr!=NULL && argindex(ptr,numargs)>=0)
+        ptr=strtok(NULL," ");
+      if (ptr!=NULL)
+        break;
+      splitinstr(line,name,params);   /* restore the parameters */
+    } /* if */
+    codeidx+=sprintf(code+codeidx,(params[0]!='\0') ? "%s %s\n" : "%s\n",name,params);
+    retidx=-1;
+  } /* for */
+  limit= (pc_inline>0) ? pc_inline : sINL_DEFSIZE;
+  if (*line!='\0' || size>(cell)limit*pc_cellsize) {
+    free(code);
+    return;
+  } /* if */
+  /* the final return is not needed, the code falls through */
+  if (retidx>=0) {
+    memmove(code+retidx,code+retidx+5,codeidx-(retidx+5)+1);
+    codeidx-=5;
+  } /* if */
+  code[codeidx]='\0';
+  sym->inlinecode=code;
+  sym->inlinesize=size;
+}
+
+/*  inline_expand
+ *
+ *  Replaces a call to a function that has been captured for inlining, if all
+ *  arguments in the staging buffer (from "index" on) are simple values. On
+ *  success, the arguments are removed from the staging buffer and the code
+ *  of the function is written instead.
+ */
+SC_FUNC int inline_expand(symbol *sym,int index,cell code_index,int nargs)
+{
+  /* for constants, local variables and global variables, the instruction
+   * to load PRI, to load ALT and to push the value */
+  static const char *loads[3][3] = {
+    { "const.pri",  "const.alt",  "push.c" },
+    { "load.s.pri", "load.s.alt", "push.s" },
+    { "load.pri",   "load.alt",   "push"   },
+  };
+  char name[sINL_LINE],params[sINL_LINE];
+  char argval[sMAXARGS][2*sizeof(ucell)+1];
+  signed char argkind[sMAXARGS];
+  int oldlabel[sINL_LABELS],newlabel[sINL_LABELS];
+  int pos,state,numargs,numlabels,globals,endlabel,i;
+  char *ptr,*end,*line;
+  const char *code;
+  arginfo *arg;
+  cell size;
+
+  assert(sym!=NULL);
+  if (!staging || sc_status!=statWRITE || sym->inlinecode==NULL)
+    return FALSE;
+  numargs=0;
+  for (arg=sym->dim.arglist; arg->ident!=0; arg++)
+    numargs++;
+  if (nargs!=numargs)
+    return FALSE;
+
+  /* check the arguments: each must be a single load of PRI followed by a push */
+  memset(argkind,-1,sizeof argkind);
+  ptr=stgbuf+index;
+  end=stgbuf+stgidx;
+  if (ptr>=end || *ptr!=sSTARTREORDER)
+    return FALSE;
+  ptr++;
+  pos=-1;
+  state=0;
+  globals=FALSE;
+  while (ptr<end && *ptr!=sENDREORDER) {
+    if ((*ptr & sEXPRSTART)==sEXPRSTART) {
+      if (pos>=0 && state<2)
+        return FALSE;
+      pos=(unsigned char)*ptr - sEXPRSTART;
+      if (pos>=numargs)
+        return FALSE;
+      state=0;
+      ptr++;
+      continue;
+    } /* if */
+    if (*ptr==sSTARTREORDER || pos<0)
+      return FALSE;
+    line=ptr;
+    ptr+=strlen(ptr)+1;
+    if (!splitinstr(line,name,params))
+      return FALSE;
+    switch (state) {
+    case 0:
+      if (strcmp(name,"zero.pri")==0) {
+        argkind[pos]=0;
+        strcpy(params,itoh(0));
+      } else if (strcmp(name,"const.pri")==0) {
+        argkind[pos]=0;
+      } else if (strcmp(name,"load.s.pri")==0) {
+        argkind[pos]=1;
+      } else if (strcmp(name,"load.pri")==0) {
+        argkind[pos]=2;
+        globals=TRUE;
+      } else {
+        return FALSE;
+      } /* if */
+      if (params[0]=='\0' || strlen(params)>=sizeof argval[0] || strchr(params,' ')!=NULL)
+        return FALSE;
+      strcpy(argval[pos],params);
+      break;
+    case 1:
+      if (strcmp(name,"push.pri")!=0)
+        return FALSE;
+      break;
+    case 2:
+      if (strcmp(name,";$par")!=0)
+        return FALSE;
+      break;
+    default:
+      return FALSE;
+    } /* switch */
+    state++;
+  } /* while */
+  if (ptr>=end || pos>=0 && state<2)
+    return FALSE;
+  for (pos=0; pos<numargs; pos++)
+    if (argkind[pos]<0)
+      return FALSE;
+
+  /* collect the labels in the body, and verify that a global variable may
+   * be passed
+   */
+  numlabels=0;
+  for (code=sym->inlinecode; *code!='\0'; code=strchr(code,'\n')+1) {
+    if (code[0]=='l' && code[1]=='.') {
+      if (numlabels>=sINL_LABELS)
+        return FALSE;
+      oldlabel[numlabels]=(int)hex2ucell(code+2,NULL);
+      newlabel[numlabels]=-1;
+      numlabels++;
+    } else if (globals) {
+      splitinstr(code,name,params);
+      if (changesmemory(name))
+        return FALSE;
+    } /* if */
+  } /* for */
+  for (i=0; i<numlabels; i++)
+    newlabel[i]=getlabel();
+
+  /* remove the arguments and write the function body */
+  stgdel(index,code_index);
+  size=sym->inlinesize;
+  endlabel=-1;
+  for (code=sym->inlinecode; *code!='\0'; code=strchr(code,'\n')+1) {
+    if (code[0]=='l' && code[1]=='.') {
+      int label=(int)hex2ucell(code+2,NULL);
+      for (i=0; i<numlabels && oldlabel[i]!=label; i++)
+        /* nothing */;
+      assert(i<numlabels);
+      stgwrite("l.");
+      stgwrite(itoh(newlabel[i]));
+      stgwrite("\n");
+      continue;
+    } /* if */
+    splitinstr(code,name,params);
+    if (strcmp(name,"retn")==0) {
+      /* return from the middle of the function: jump to the end */
+      if (endlabel<0)
+        endlabel=getlabel();
+      stgwrite("\tjump ");
+      stgwrite(itoh(endlabel));
+      stgwrite("\n");
+      size+=opcodes(1)+opargs(1);
+    } else if (name[0]=='j' && params[0]!='\0') {
+      int label=(int)hex2ucell(params,NULL);
+      for (i=0; i<numlabels && oldlabel[i]!=label; i++)
+        /* nothing */;
+      stgwrite("\t");
+      stgwrite(name);
+      stgwrite(" ");
+      stgwrite((i<numlabels) ? itoh(newlabel[i]) : params);
+      stgwrite("\n");
+    } else if (frameaccess(name)>0) {
+      int reg=(strstr(name,".alt")!=NULL) ? 1 : (strncmp(name,"push",4)==0) ? 2 : 0;
+      if (strncmp(name,"pushm",5)==0) {
+        /* push the arguments one by one, except for the last */
+        int count=(int)hex2ucell(params,NULL);
+        char *ptr=strchr(params,' ');
+        assert(count>1 && ptr!=NULL);
+        while (--count>0) {
+          pos=argindex(ptr+1,numargs);
+          ptr=strchr(ptr+1,' ');
+          assert(pos>=0 && pos<numargs && ptr!=NULL);
+          stgwrite("\t");
+          stgwrite(loads[(int)argkind[pos]][2]);
+          stgwrite(" ");
+          stgwrite(argval[pos]);
+          stgwrite("\n");
+          size+=opcodes(1);
+        } /* while */
+        pos=argindex(ptr+1,numargs);
+        if (strstr(name,".p.")==NULL)
+          size-=opargs(1);      /* the count was not packed in the instruction */
+      } else if (strcmp(name,"load2.s")==0) {
+        /* split into a load of PRI and one of ALT */
+        pos=argindex(params,numargs);
+        stgwrite("\t");
+        stgwrite(loads[(int)argkind[pos]][0]);
+        stgwrite(" ");
+        stgwrite(argval[pos]);
+        stgwrite("\n");
+        pos=argindex(strchr(params,' ')+1,numargs);
+        reg=1;
+        size+=opcodes(1);
+      } else {
+        pos=argindex(params,numargs);
+        if (strstr(name,".p.")!=NULL)
+          size+=opargs(1);      /* the value no longer fits in a packed instruction */
+      } /* if */
+      assert(pos>=0 && pos<numargs);
+      stgwrite("\t");
+      stgwrite(loads[(int)argkind[pos]][reg]);
+      stgwrite(" ");
+      stgwrite(argval[pos]);
+      stgwrite("\n");
+    } else if (name[0]==';') {
+      stgwrite("\t");
+      stgwrite(name);
+      stgwrite("\n");
+    } else {
+      stgwrite("\t");
+      stgwrite(name);
+      if (params[0]!='\0') {
+        stgwrite(" ");
+        stgwrite(params);
+      } /* if */
+      stgwrite("\n");
+    } /* if */
+  } /* for */
+  if (endlabel>=0) {
+    stgwrite("l.");
+    stgwrite(itoh(endlabel));
+    stgwrite("\n");
+  } /* if */
+  code_idx=code_index+size;
+  return TRUE;
+}
+
+/* The sequences are indexed on their first instruction, so that stgopt()
+ * only tries the sequences that can match at a position. Every list keeps
+ * the order of the sequences table, because that order sets the priority.
+ */
+typedef struct {
+  const char *name;     /* first instruction, or NULL for an unused slot */
+  int length;
+  int first,count;      /* range in seqlist[] */
+} SEQINDEX;
+
+#define SEQINDEX_SIZE 256 /* power of 2, well above the number of different first instructions */
+
+static SEQUENCE *sequences;
+static SEQINDEX seqindex[SEQINDEX_SIZE];
+static int *seqlist;    /* sequence numbers, grouped on their first instruction */
+static char *seqlevel;  /* optimization level of every sequence */
+static clock_t opt_clock; /* time spent in stgopt() */
+
+/* length of the first instruction on a line or in a pattern, which ends at
+ * whitespace, at a comment or at the end of a line in the pattern ('!')
+ */
+static int instrlength(const char *str)
+{
+  int len=0;
+  while (str[len]!='\0' && !isspace(str[len]) && str[len]!='!' && (str[len]!=';' || len==0))
+    len++;
+  return len;
+}
+
+static SEQINDEX *findseqindex(const char *name,int length)
+{
+  unsigned hash=2166136261u;
+  int i;
+
+  /* FNV-1a, case insensitive like matchsequence() */
+  for (i=0; i<length; i++)
+    hash=(hash ^ (unsigned char)tolower(name[i]))*16777619u;
+  hash&=SEQINDEX_SIZE-1;
+  while (seqindex[hash].name!=NULL) {
+    if (seqindex[hash].length==length) {
+      for (i=0; i<length && tolower(seqindex[hash].name[i])==tolower(name[i]); i++)
+        /* nothing */;
+      if (i==length)
+        break;
+    } /* if */
+    hash=(hash+1) & (SEQINDEX_SIZE-1);
+  } /* while */
+  return &seqindex[hash];
+}
+
+static void phopt_index(int number)
+{
+  SEQINDEX *idx;
+  int i,len,first,level;
+
+  memset(seqindex,0,sizeof seqindex);
+  /* count the sequences for every first instruction */
+  level=sOPTIMIZE_NONE;
+  for (i=0; i<number; i++) {
+    if (*sequences[i].find<sOPTIMIZE_NUMBER) {
+      assert(*sequences[i].find>level);  /* levels must be in ascending order */
+      level=*sequences[i].find;
+      seqlevel[i]=(char)sOPTIMIZE_NUMBER;
+      continue;
+    } /* if */
+    seqlevel[i]=(char)level;
+    len=instrlength(sequences[i].find);
+    assert(len>0 && (sequences[i].find[len]==' ' || sequences[i].find[len]=='!'));
+    idx=findseqindex(sequences[i].find,len);
+    if (idx->name==NULL) {
+      idx->name=sequences[i].find;
+      idx->length=len;
+    } /* if */
+    idx->count++;
+  } /* for */
+  /* assign the ranges, then fill them in table order */
+  first=0;
+  for (i=0; i<SEQINDEX_SIZE; i++) {
+    seqindex[i].first=first;
+    first+=seqindex[i].count;
+    seqindex[i].count=0;
+  } /* for */
+  for (i=0; i<number; i++) {
+    if (*sequences[i].find<sOPTIMIZE_NUMBER)
+      continue;
+    idx=findseqindex(sequences[i].find,instrlength(sequences[i].find));
+    seqlist[idx->first+idx->count++]=i;
+  } /* for */
+}
+
 /* phopt_init
  * Initialize all sequence strings of the peehole optimizer. The strings
  * are embedded in the .EXE file in compressed format, here we expand
  * them (and allocate memory for the sequences).
  */
-static SEQUENCE *sequences;
-
 SC_FUNC int phopt_init(void)
 {
   int number, i, len;
@@ -445,9 +1013,24 @@ SC_FUNC int phopt_init(void)
       return phopt_cleanup();
   } /* for */
 
+  seqlist=(int*)malloc(number*sizeof(int));
+  seqlevel=(char*)malloc(number*sizeof(char));
+  if (seqlist==NULL || seqlevel==NULL)
+    return phopt_cleanup();
+  phopt_index(number-1);
+  opt_clock=0;
+
   return TRUE;
 }
 
+/* phopt_time
+ * Returns the time spent in the peephole optimizer, in milliseconds.
+ */
+SC_FUNC long phopt_time(void)
+{
+  return (long)(opt_clock*1000/CLOCKS_PER_SEC);
+}
+
 SC_FUNC int phopt_cleanup(void)
 {
   int i;
@@ -463,6 +1046,14 @@ SC_FUNC int phopt_cleanup(void)
     free(sequences);
     sequences=NULL;
   } /* if */
+  if (seqlist!=NULL) {
+    free(seqlist);
+    seqlist=NULL;
+  } /* if */
+  if (seqlevel!=NULL) {
+    free(seqlevel);
+    seqlevel=NULL;
+  } /* if */
   return FALSE;
 }
 
@@ -603,7 +1194,7 @@ static int matchsequence(char *start,char *end,const char *pattern,
 
 static char *replacesequence(const char *pattern,char symbols[MAX_OPT_VARS+1][MAX_ALIAS+1],int *repl_length)
 {
-  char *lptr;
+  char *cptr;
   int var,optsym;
   char *buffer;
 
@@ -615,13 +1206,13 @@ static char *replacesequence(const char *pattern,char symbols[MAX_OPT_VARS+1][MA
   assert(repl_length!=NULL);
   *repl_length=0;
   optsym=FALSE;
-  lptr=(char*)pattern;
-  while (*lptr) {
-    switch (*lptr) {
+  cptr=(char*)pattern;
+  while (*cptr) {
+    switch (*cptr) {
     case '%':
-      lptr++;           /* skip '%' */
-      assert(isdigit(*lptr));
-      var=atoi(lptr);
+      cptr++;           /* skip '%' */
+      assert(isdigit(*cptr));
+      var=atoi(cptr);
       assert(var>=0 && var<=MAX_OPT_VARS);
       assert(symbols[var][0]!='\0' || optsym);  /* variable should be defined */
       assert(var!=0 || strlen(symbols[var])==pc_cellsize || (symbols[var][0]=='-' && strlen(symbols[var])==pc_cellsize+1) || atoi(symbols[var])==0);
@@ -629,9 +1220,9 @@ static char *replacesequence(const char *pattern,char symbols[MAX_OPT_VARS+1][MA
       optsym=FALSE;
       break;
     case '~': /* optional space followed by optional symbol */
-      assert(lptr[1]=='%');
-      assert(isdigit(lptr[2]));
-      var=atoi(lptr+2);
+      assert(cptr[1]=='%');
+      assert(isdigit(cptr[2]));
+      var=atoi(cptr+2);
       assert(var>=0 && var<=MAX_OPT_VARS);
       if (symbols[var][0]!='\0')
         *repl_length+=1;  /* copy space if following symbol is valid */
@@ -639,10 +1230,10 @@ static char *replacesequence(const char *pattern,char symbols[MAX_OPT_VARS+1][MA
         optsym=TRUE;      /* don't copy space, and symbol is optional */
       break;
     case '#':
-      lptr++;           /* skip '#' */
-      assert(alphanum(*lptr));
-      while (alphanum(lptr[1]))
-        lptr++;
+      cptr++;           /* skip '#' */
+      assert(alphanum(*cptr));
+      while (alphanum(cptr[1]))
+        cptr++;
       *repl_length+=pc_cellsize*2;
       break;
     case '!':
@@ -651,7 +1242,7 @@ static char *replacesequence(const char *pattern,char symbols[MAX_OPT_VARS+1][MA
     default:
       *repl_length+=1;
     } /* switch */
-    lptr++;
+    cptr++;
   } /* while */
 
   /* allocate a buffer to replace the sequence in */
@@ -662,10 +1253,10 @@ static char *replacesequence(const char *pattern,char symbols[MAX_OPT_VARS+1][MA
 
   /* replace the pattern into this temporary buffer */
   optsym=FALSE;
-  lptr=buffer;
-  *lptr++='\t';         /* the "replace" patterns do not have tabs */
+  cptr=buffer;
+  *cptr++='\t';         /* the "replace" patterns do not have tabs */
   while (*pattern) {
-    assert((int)(lptr-buffer)<*repl_length);
+    assert((int)(cptr-buffer)<*repl_length);
     switch (*pattern) {
     case '%':
       /* write out the symbol */
@@ -675,8 +1266,8 @@ static char *replacesequence(const char *pattern,char symbols[MAX_OPT_VARS+1][MA
       assert(var>=0 && var<=MAX_OPT_VARS);
       assert(symbols[var][0]!='\0' || optsym);  /* variable should be defined */
       assert(symbols[var][0]=='\0' || !optsym); /* but optional variable should be undefined */
-      strcpy(lptr,symbols[var]);
-      lptr+=strlen(symbols[var]);
+      strcpy(cptr,symbols[var]);
+      cptr+=strlen(symbols[var]);
       optsym=FALSE;
       break;
     case '~':
@@ -685,15 +1276,15 @@ static char *replacesequence(const char *pattern,char symbols[MAX_OPT_VARS+1][MA
       var=atoi(pattern+2);
       assert(var>=0 && var<=MAX_OPT_VARS);
       if (symbols[var][0]!='\0')
-        *lptr++=' ';      /* replace ~ by a space */
+        *cptr++=' ';      /* replace ~ by a space */
       else
         optsym=TRUE;      /* don't copy space, and symbol is optional */
       break;
     case '#': {
       ucell v=hex2ucell(pattern+1,NULL);
       char *ptr=itoh(v);
-      strcpy(lptr,ptr);
-      lptr+=strlen(ptr);
+      strcpy(cptr,ptr);
+      cptr+=strlen(ptr);
       assert(alphanum(pattern[1]));
       while (alphanum(pattern[1]))
         pattern++;
@@ -701,18 +1292,18 @@ static char *replacesequence(const char *pattern,char symbols[MAX_OPT_VARS+1][MA
     } /* case */
     case '!':
       /* finish the line, optionally start the next line with an indent */
-      *lptr++='\n';
-      *lptr++='\0';
+      *cptr++='\n';
+      *cptr++='\0';
       if (*(pattern+1)!='\0')
-        *lptr++='\t';
+        *cptr++='\t';
       break;
     default:
-      *lptr++=*pattern;
+      *cptr++=*pattern;
     } /* switch */
     pattern++;
   } /* while */
 
-  assert((int)(lptr-buffer)==*repl_length);
+  assert((int)(cptr-buffer)==*repl_length);
   return buffer;
 }
 
@@ -735,32 +1326,39 @@ static void strreplace(char *dest,char *replace,int sub_length,int repl_length,i
  *  buffer to be separated with '\n' and '\0' characters.
  *
  *  The longest sequences should probably be checked first.
+ *
+ *  Only the sequences that start with the instruction at the current line
+ *  are tried, see phopt_index().
  */
 
 static void stgopt(char *start,char *end,int (*outputfunc)(char *str))
 {
   char symbols[MAX_OPT_VARS+1][MAX_ALIAS+1];
-  int seq,match_length,repl_length;
+  int seq,n,match_length,repl_length;
   int matches;
   char *debut=start;  /* save original start of the buffer */
+  char *instr;
+  const SEQINDEX *idx;
+  clock_t t0;
 
   assert(sequences!=NULL);
   /* do not match anything if debug-level is maximum */
   if (pc_optimize>sOPTIMIZE_NONE && sc_status==statWRITE) {
+    t0=clock();
     do {
       matches=0;
       start=debut;
       while (start<end) {
-        seq=0;
-        while (sequences[seq].find!=NULL) {
-          assert(seq>=0);
-          if (*sequences[seq].find<sOPTIMIZE_NUMBER) {
-            if (*sequences[seq].find>pc_optimize)
-              break;    /* don't look further */
-            seq++;    /* continue with next string */
-            continue;
-          } /* if */
-          if (matchsequence(start,end,sequences[seq].find,symbols,&match_length)) {
+        for (instr=start; *instr=='\t' || *instr==' '; instr++)
+          /* nothing */;
+        idx=findseqindex(instr,instrlength(instr));
+        n=0;
+        while (n<idx->count) {
+          seq=seqlist[idx->first+n];
+          assert(seq>=0 && sequences[seq].find!=NULL);
+          if (seqlevel[seq]<=pc_optimize
+              && matchsequence(start,end,sequences[seq].find,symbols,&match_length))
+          {
             char *replace=replacesequence(sequences[seq].replace,symbols,&repl_length);
             /* If the replacement is bigger than the original section, we may need
              * to "grow" the staging buffer. This is quite complex, due to the
@@ -776,21 +1374,25 @@ static void stgopt(char *start,char *end,int (*outputfunc)(char *str))
               end-=match_length-repl_length;
               free(replace);
               code_idx-=opcodes(sequences[seq].opc)+opargs(sequences[seq].arg);
-              seq=0;                      /* restart search for matches */
+              /* restart search for matches, the first instruction has changed */
+              for (instr=start; *instr=='\t' || *instr==' '; instr++)
+                /* nothing */;
+              idx=findseqindex(instr,instrlength(instr));
+              n=0;
               matches++;
             } else {
               /* actually, we should never get here (match_length<repl_length) */
               assert(0);
-              seq++;
+              n++;
             } /* if */
           } else {
-            seq++;
+            n++;
           } /* if */
         } /* while */
-        assert(sequences[seq].find==NULL || *sequences[seq].find<sOPTIMIZE_NUMBER);
         start += strlen(start) + 1;       /* to next string */
       } /* while (start<end) */
     } while (matches>0);
+    opt_clock+=clock()-t0;
   } /* if (pc_optimize>sOPTIMIZE_NONE && sc_status==statWRITE) */
 
   for (start=debut; start<end; start+=strlen(start)+1)
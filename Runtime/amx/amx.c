@@ -378,6 +378,14 @@ typedef enum {
   OP_HALT_P,
   OP_BOUNDS_P,
 #endif
+  /* jump tables for dense switches; these are numbered after the packed
+   * instructions, also when those are not supported (SWITCH.TBL and
+   * SWITCH.TBL.OVL are patched instructions)
+   */
+  OP_SWITCH_TBL=175,
+  OP_JUMPTBL,
+  OP_SWITCH_TBL_OVL,
+  OP_JUMPTBL_OVL,
   /* ----- */
   OP_NUM_OPCODES
 } OPCODE;
@@ -626,6 +634,16 @@ int AMXAPI amx_Callback(AMX *amx, cell index, cell *result, const cell *params)
 
 #if defined AMX_INIT
 
+/* check whether the instruction at "addr" has the given opcode; instructions
+ * before "cip" have already been relocated
+ */
+static int is_opcode(AMX *amx,cell addr,cell cip,cell opcode,const cell *opcode_list)
+{
+  if (opcode_list!=NULL && addr<cip)
+    opcode=opcode_list[opcode];
+  return *(cell *)(amx->code+(int)addr)==opcode;
+}
+
 int VerifyPcode(AMX *amx)
 {
   AMX_HEADER *hdr;
@@ -976,11 +994,15 @@ int VerifyPcode(AMX *amx)
 #endif
       break;
 
+    case OP_SWITCH:     /* a switch on a jump table runs as SWITCH.TBL */
+      tgt=*(cell*)(amx->code+(int)cip)+cip-sizeof(cell);
+      if (tgt>=0 && tgt<amx->codesize && is_opcode(amx,tgt,cip,OP_JUMPTBL,opcode_list))
+        *(cell*)(amx->code+(int)cip-sizeof(cell))=(opcode_list!=NULL) ? opcode_list[OP_SWITCH_TBL] : OP_SWITCH_TBL;
+      /* drop through */
     case OP_CALL:       /* opcodes that need relocation (JIT only), or conversion to position-independent code */
     case OP_JUMP:
     case OP_JZER:
     case OP_JNZ:
-    case OP_SWITCH:
 #if !defined AMX_NO_MACRO_INSTR
     case OP_JEQ:
     case OP_JNEQ:
@@ -1010,6 +1032,8 @@ int VerifyPcode(AMX *amx)
         amx->flags &= ~AMX_FLAG_VERIFY;
         return AMX_ERR_BOUNDS;
       } /* if */
+      if (tgt<amx->codesize && is_opcode(amx,tgt,cip,OP_JUMPTBL_OVL,opcode_list))
+        *(cell*)(amx->code+(int)cip-sizeof(cell))=(opcode_list!=NULL) ? opcode_list[OP_SWITCH_TBL_OVL] : OP_SWITCH_TBL_OVL;
       /* drop through */
     case OP_CALL_OVL:
       cip+=sizeof(cell);
@@ -1031,6 +1055,18 @@ int VerifyPcode(AMX *amx)
         return AMX_ERR_OVERLAY;       /* no overlay callback */
       break;
     } /* case */
+    case OP_JUMPTBL_OVL: {
+      cell num;
+      DBGPARAM(num);    /* number of entries follows the opcode */
+      if (num<0 || cip+(num+2)*(cell)sizeof(cell)>amx->codesize) {
+        amx->flags &= ~AMX_FLAG_VERIFY;
+        return AMX_ERR_BOUNDS;
+      } /* if */
+      cip+=(num + 2)*sizeof(cell);
+      if (amx->overlay==NULL)
+        return AMX_ERR_OVERLAY;       /* no overlay callback */
+      break;
+    } /* case */
 #endif
 
     case OP_SYSREQ:
@@ -1064,6 +1100,33 @@ int VerifyPcode(AMX *amx)
       break;
     } /* case */
 
+    case OP_JUMPTBL: {
+      cell num,offs;
+      int i;
+      DBGPARAM(num);    /* number of entries follows the opcode */
+      if (num<0 || cip+(num+2)*(cell)sizeof(cell)>amx->codesize) {
+        amx->flags &= ~AMX_FLAG_VERIFY;
+        return AMX_ERR_BOUNDS;
+      } /* if */
+      /* the "none-matched" address comes first, then the lowest case value
+       * and the addresses for all values in the range
+       */
+      for (i=0; i<=num; i++) {
+        offs=(i==0) ? cip : cip+(i+1)*sizeof(cell);
+        tgt=*(cell*)(amx->code+(int)offs)+offs-sizeof(cell);
+        if (tgt<0 || tgt>amx->codesize) {
+          amx->flags &= ~AMX_FLAG_VERIFY;
+          return AMX_ERR_BOUNDS;
+        } /* if */
+        #if defined AMX_JIT
+          RELOC_ABS(amx->code, offs);
+          reloc_count++;
+        #endif
+      } /* for */
+      cip+=(num + 2)*sizeof(cell);
+      break;
+    } /* case */
+
     default:
       amx->flags &= ~AMX_FLAG_VERIFY;
       return AMX_ERR_INVINSTR;
@@ -1579,6 +1642,18 @@ int AMXAPI amx_NameLength(AMX *amx, int *length)
 }
 #endif /* AMX_NAMELENGTH */
 
+#if defined AMX_REGISTER || defined AMX_XXXPUBLICS
+static uint32_t hashname(const char *name)
+{
+  uint32_t hash=2166136261u;    /* FNV-1a */
+
+  while (*name!='\0')
+    hash=(hash ^ (unsigned char)*name++)*16777619u;
+  return hash;
+}
+
+#endif
+
 #if defined AMX_XXXNATIVES
 int AMXAPI amx_NumNatives(AMX *amx, int *number)
 {
@@ -1657,28 +1732,100 @@ int AMXAPI amx_GetPublic(AMX *amx, int index, char *name, ucell *address)
   return AMX_ERR_NONE;
 }
 
+#define PUBLICINDEX_TAG AMX_USERTAG('P','I','D','X')
+
+typedef struct tagPUBLICINDEX {
+  unsigned mask;                /* number of slots - 1 */
+  uint16_t slots[1];            /* public function index + 1, 0 for unused slots */
+} PUBLICINDEX;
+
+static PUBLICINDEX *getpublicindex(AMX *amx)
+{
+  #if AMX_USERNUM > 0
+    int i;
+    for (i=0; i<AMX_USERNUM; i++)
+      if (amx->usertags[i]==PUBLICINDEX_TAG)
+        return (PUBLICINDEX *)amx->userdata[i];
+  #endif
+  return NULL;
+}
+
+/* Build a hash index of the public function names in the given memory and
+ * attach it to the abstract machine (as user data), after which
+ * amx_FindPublic() needs a single lookup. The memory must remain valid
+ * while the abstract machine is in use; it needs a few bytes plus two
+ * bytes per slot, and there are up to two slots per public function.
+ * The index holds table positions only, so clones of the abstract machine
+ * can share it.
+ */
+int AMXAPI amx_IndexPublics(AMX *amx, void *memory, size_t size)
+{
+  AMX_HEADER *hdr;
+  PUBLICINDEX *pidx;
+  unsigned numslots,i;
+  int num,idx;
+
+  assert(amx!=NULL);
+  assert(memory!=NULL);
+  hdr=(AMX_HEADER *)amx->base;
+  amx_NumPublics(amx,&num);
+  if (num>=0xffff)
+    return AMX_ERR_MEMORY;
+
+  /* the number of slots must be a power of two */
+  numslots=1;
+  while (numslots<2*(unsigned)num && offsetof(PUBLICINDEX,slots)+2*numslots*sizeof(uint16_t)<=size)
+    numslots*=2;
+  if (numslots<=(unsigned)num || offsetof(PUBLICINDEX,slots)+numslots*sizeof(uint16_t)>size)
+    return AMX_ERR_MEMORY;
+
+  pidx=(PUBLICINDEX *)memory;
+  pidx->mask=numslots-1;
+  memset(pidx->slots,0,numslots*sizeof(uint16_t));
+  for (idx=0; idx<num; idx++) {
+    i=hashname(GETENTRYNAME(hdr,GETENTRY(hdr,publics,idx))) & pidx->mask;
+    while (pidx->slots[i]!=0)
+      i=(i+1) & pidx->mask;
+    pidx->slots[i]=(uint16_t)(idx+1);
+  } /* for */
+  return amx_SetUserData(amx,PUBLICINDEX_TAG,pidx);
+}
+
 int AMXAPI amx_FindPublic(AMX *amx, const char *name, int *index)
 {
+  AMX_HEADER *hdr;
+  PUBLICINDEX *pidx;
   int first,last,mid,result;
-  char pname[sNAMEMAX+1];
+  unsigned i;
 
-  amx_NumPublics(amx, &last);
-  last--;       /* last valid index is 1 less than the number of functions */
-  first=0;
-  /* binary search */
-  while (first<=last) {
-    mid=(first+last)/2;
-    amx_GetPublic(amx,mid,pname,NULL);
-    result=strcmp(pname,name);
-    if (result>0) {
-      last=mid-1;
-    } else if (result<0) {
-      first=mid+1;
-    } else {
-      *index=mid;
-      return AMX_ERR_NONE;
-    } /* if */
-  } /* while */
+  hdr=(AMX_HEADER *)amx->base;
+  pidx=getpublicindex(amx);
+  if (pidx!=NULL) {
+    for (i=hashname(name) & pidx->mask; pidx->slots[i]!=0; i=(i+1) & pidx->mask) {
+      mid=pidx->slots[i]-1;
+      if (strcmp(GETENTRYNAME(hdr,GETENTRY(hdr,publics,mid)),name)==0) {
+        *index=mid;
+        return AMX_ERR_NONE;
+      } /* if */
+    } /* for */
+  } else {
+    amx_NumPublics(amx, &last);
+    last--;     /* last valid index is 1 less than the number of functions */
+    first=0;
+    /* binary search, comparing the names in place in the name table */
+    while (first<=last) {
+      mid=(first+last)/2;
+      result=strcmp(GETENTRYNAME(hdr,GETENTRY(hdr,publics,mid)),name);
+      if (result>0) {
+        last=mid-1;
+      } else if (result<0) {
+        first=mid+1;
+      } else {
+        *index=mid;
+        return AMX_ERR_NONE;
+      } /* if */
+    } /* while */
+  } /* if */
   /* not found, set to an invalid index, so amx_Exec() on this index will fail
    * with an error
    */
@@ -1725,23 +1872,30 @@ int AMXAPI amx_GetPubVar(AMX *amx, int index, char *name, cell **address)
 
 int AMXAPI amx_FindPubVar(AMX *amx, const char *name, cell **address)
 {
+  AMX_HEADER *hdr;
+  AMX_FUNCSTUB *var;
+  unsigned char *data;
   int first,last,mid,result;
-  char pname[sNAMEMAX+1];
 
+  hdr=(AMX_HEADER *)amx->base;
   amx_NumPubVars(amx,&last);
   last--;       /* last valid index is 1 less than the number of functions */
   first=0;
-  /* binary search */
+  /* binary search, comparing the names in place in the name table */
   while (first<=last) {
     mid=(first+last)/2;
-    amx_GetPubVar(amx,mid,pname,address);
-    result=strcmp(pname,name);
-    if (result>0)
+    var=GETENTRY(hdr,pubvars,mid);
+    result=strcmp(GETENTRYNAME(hdr,var),name);
+    if (result>0) {
       last=mid-1;
-    else if (result<0)
+    } else if (result<0) {
       first=mid+1;
-    else
+    } else {
+      data=(amx->data!=NULL) ? amx->data : amx->base+(int)hdr->dat;
+      assert(address!=NULL);
+      *address=(cell *)(data+(int)var->address);
       return AMX_ERR_NONE;
+    } /* if */
   } /* while */
   /* not found */
   assert(address!=NULL);
@@ -1803,6 +1957,8 @@ int AMXAPI amx_GetTag(AMX *amx, int index, char *tagname, cell *tag_id)
 
 int AMXAPI amx_FindTagId(AMX *amx, cell tag_id, char *tagname)
 {
+  AMX_HEADER *hdr;
+  AMX_FUNCSTUB *tag;
   int first,last,mid;
   cell mid_id;
 
@@ -1823,16 +1979,20 @@ int AMXAPI amx_FindTagId(AMX *amx, cell tag_id, char *tagname)
   amx_NumTags(amx, &last);
   last--;       /* last valid index is 1 less than the number of functions */
   first=0;
-  /* binary search */
+  /* binary search on the id, the name is only copied for the match */
+  hdr=(AMX_HEADER *)amx->base;
   while (first<=last) {
     mid=(first+last)/2;
-    amx_GetTag(amx,mid,tagname,&mid_id);
-    if (mid_id>tag_id)
+    tag=GETENTRY(hdr,tags,mid);
+    mid_id=tag->address;
+    if (mid_id>tag_id) {
       last=mid-1;
-    else if (mid_id<tag_id)
+    } else if (mid_id<tag_id) {
       first=mid+1;
-    else
+    } else {
+      strcpy(tagname,GETENTRYNAME(hdr,tag));
       return AMX_ERR_NONE;
+    } /* if */
   } /* while */
   /* not found */
   *tagname='\0';
@@ -1921,6 +2081,96 @@ int AMXAPI amx_Register(AMX *amx, const AMX_NATIVE_INFO *list, int number)
     amx->flags|=AMX_FLAG_NTVREG;
   return err;
 }
+
+/* Build a hash table of all functions in the lists (each terminated with a
+ * NULL name) in the given memory. If a name appears in several lists, the
+ * first one is used, as with successive calls to amx_Register(). The table
+ * needs a little more than one pointer per function; twice that is best.
+ */
+int AMXAPI amx_RegistryInit(AMX_NATIVE_REGISTRY *registry, const AMX_NATIVE_INFO * const *lists,
+                            int numlists, void *memory, size_t size)
+{
+  const AMX_NATIVE_INFO *entry;
+  unsigned count,numslots,i;
+  int l;
+
+  assert(registry!=NULL);
+  assert(lists!=NULL || numlists==0);
+  count=0;
+  for (l=0; l<numlists; l++)
+    for (entry=lists[l]; entry->name!=NULL; entry++)
+      count++;
+
+  /* the number of slots must be a power of two */
+  numslots=1;
+  while (numslots<2*count && 2*numslots*sizeof(AMX_NATIVE_INFO*)<=size)
+    numslots*=2;
+  if (numslots<=count || numslots*sizeof(AMX_NATIVE_INFO*)>size)
+    return AMX_ERR_MEMORY;
+
+  registry->slots=(const AMX_NATIVE_INFO **)memory;
+  registry->mask=numslots-1;
+  memset(registry->slots,0,numslots*sizeof(AMX_NATIVE_INFO*));
+  for (l=0; l<numlists; l++) {
+    for (entry=lists[l]; entry->name!=NULL; entry++) {
+      i=hashname(entry->name) & registry->mask;
+      while (registry->slots[i]!=NULL && strcmp(registry->slots[i]->name,entry->name)!=0)
+        i=(i+1) & registry->mask;
+      if (registry->slots[i]==NULL)
+        registry->slots[i]=entry;
+    } /* for */
+  } /* for */
+  return AMX_ERR_NONE;
+}
+
+static AMX_NATIVE findregistry(const AMX_NATIVE_REGISTRY *registry, const char *name)
+{
+  const AMX_NATIVE_INFO *entry;
+  unsigned i;
+
+  i=hashname(name) & registry->mask;
+  while ((entry=registry->slots[i])!=NULL) {
+    if (strcmp(name,entry->name)==0)
+      return entry->func;
+    i=(i+1) & registry->mask;
+  } /* while */
+  return NULL;
+}
+
+/* Bind all native functions of the program in a single pass, with a
+ * registry made by amx_RegistryInit().
+ */
+int AMXAPI amx_RegisterAll(AMX *amx, const AMX_NATIVE_REGISTRY *registry)
+{
+  AMX_FUNCSTUB *func;
+  AMX_HEADER *hdr;
+  int i,numnatives,err;
+  AMX_NATIVE funcptr;
+
+  assert(amx!=NULL);
+  assert(registry!=NULL);
+  hdr=(AMX_HEADER *)amx->base;
+  assert(hdr!=NULL);
+  assert(hdr->magic==AMX_MAGIC);
+  assert(hdr->natives<=hdr->libraries);
+  numnatives=NUMENTRIES(hdr,natives,libraries);
+
+  err=AMX_ERR_NONE;
+  func=GETENTRY(hdr,natives,0);
+  for (i=0; i<numnatives; i++) {
+    if (func->address==0) {
+      funcptr=findregistry(registry,GETENTRYNAME(hdr,func));
+      if (funcptr!=NULL)
+        func->address=(ucell)funcptr;
+      else
+        err=AMX_ERR_NOTFOUND;
+    } /* if */
+    func=(AMX_FUNCSTUB*)((unsigned char*)func+hdr->defsize);
+  } /* for */
+  if (err==AMX_ERR_NONE)
+    amx->flags|=AMX_FLAG_NTVREG;
+  return err;
+}
 #endif /* AMX_REGISTER */
 
 #if defined AMX_NATIVEINFO
@@ -2712,10 +2962,29 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
       assert(*JUMPREL(cip)==OP_CASETBL);
       cip=JUMPREL(cptr+1);      /* preset to "none-matched" case */
       i=(int)*cptr;             /* number of records in the case table */
-      for (cptr+=2; i>0 && *cptr!=pri; i--,cptr+=2)
-        /* nothing */;
-      if (i>0)
-        cip=JUMPREL(cptr+1);    /* case found */
+      /* the records are sorted on the case value, so use a binary search */
+      for (cptr+=2; i>0; i>>=1) {
+        cell *mid=cptr+2*(i>>1);
+        if (*mid==pri) {
+          cip=JUMPREL(mid+1);   /* case found */
+          break;
+        } /* if */
+        if (*mid<pri) {
+          cptr=mid+2;           /* continue with the records above "mid" */
+          i--;
+        } /* if */
+      } /* for */
+      break;
+    } /* case */
+    case OP_SWITCH_TBL: {
+      cell *cptr=JUMPREL(cip)+1;/* +1, to skip the "jumptbl" opcode */
+      assert(*JUMPREL(cip)==OP_JUMPTBL);
+      offs=(cell)((ucell)pri-(ucell)*(cptr+2)); /* index in the jump table */
+      if ((ucell)offs<(ucell)*cptr)
+        cptr+=offs+3;           /* case found */
+      else
+        cptr+=1;                /* "none-matched" case */
+      cip=JUMPREL(cptr);
       break;
     } /* case */
     case OP_SWAP_PRI:
@@ -2826,10 +3095,31 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
       assert(*JUMPREL(cip)==OP_CASETBL_OVL);
       amx->ovl_index=*(cptr+1);   /* preset to "none-matched" case */
       i=(int)*cptr;               /* number of records in the case table */
-      for (cptr+=2; i>0 && *cptr!=pri; i--,cptr+=2)
-        /* nothing */;
-      if (i>0)
-        amx->ovl_index=*(cptr+1); /* case found */
+      for (cptr+=2; i>0; i>>=1) { /* binary search, see OP_SWITCH */
+        cell *mid=cptr+2*(i>>1);
+        if (*mid==pri) {
+          amx->ovl_index=*(mid+1);/* case found */
+          break;
+        } /* if */
+        if (*mid<pri) {
+          cptr=mid+2;
+          i--;
+        } /* if */
+      } /* for */
+      assert(amx->overlay!=NULL);
+      if ((i=amx->overlay(amx,amx->ovl_index))!=AMX_ERR_NONE)
+        ABORT(amx,i);
+      cip=(cell*)amx->code;
+      break;
+    } /* case */
+    case OP_SWITCH_TBL_OVL: {
+      cell *cptr=JUMPREL(cip)+1;  /* +1, to skip the "jumptbl.ovl" opcode */
+      assert(*JUMPREL(cip)==OP_JUMPTBL_OVL);
+      offs=(cell)((ucell)pri-(ucell)*(cptr+2)); /* index in the jump table */
+      if ((ucell)offs<(ucell)*cptr)
+        amx->ovl_index=*(cptr+offs+3); /* case found */
+      else
+        amx->ovl_index=*(cptr+1);      /* "none-matched" case */
       assert(amx->overlay!=NULL);
       if ((i=amx->overlay(amx,amx->ovl_index))!=AMX_ERR_NONE)
         ABORT(amx,i);
@@ -163,6 +163,7 @@ extern  "C" {
  *   9 macro opcodes
  *  10 position-independent code, overlays, packed instructions
  *  11 relocating instructions for the native interface, reorganized instruction set
+ *  12 jump tables for dense switches (JUMPTBL and JUMPTBL.OVL)
  * MIN_FILE_VERSION is the lowest file version number that the current AMX
  * implementation supports. If the AMX file header gets new fields, this number
  * often needs to be incremented. MIN_AMX_VERSION is the lowest AMX version that
@@ -171,9 +172,9 @@ extern  "C" {
  * The file version supported by the JIT may run behind MIN_AMX_VERSION. So
  * there is an extra constant for it: MAX_FILE_VER_JIT.
  */
-#define CUR_FILE_VERSION 11     /* current file version; also the current AMX version */
+#define CUR_FILE_VERSION 12     /* current file version; also the current AMX version */
 #define MIN_FILE_VERSION 11     /* lowest supported file format version for the current AMX version */
-#define MIN_AMX_VERSION  11     /* minimum AMX version needed to support the current file format */
+#define MIN_AMX_VERSION  12     /* minimum AMX version needed to support the current file format */
 #define MAX_FILE_VER_JIT 11     /* file version supported by the JIT */
 #define MIN_AMX_VER_JIT  11     /* AMX version supported by the JIT */
 
@@ -251,6 +252,14 @@ typedef struct tagAMX_NATIVE_INFO {
   AMX_NATIVE func;
 } PACKED AMX_NATIVE_INFO;
 
+/* Hash table of the functions in one or more AMX_NATIVE_INFO lists, see
+ * amx_RegistryInit() and amx_RegisterAll()
+ */
+typedef struct tagAMX_NATIVE_REGISTRY {
+  const AMX_NATIVE_INFO **slots;  /* NULL for unused slots */
+  unsigned mask;                  /* number of slots - 1 */
+} AMX_NATIVE_REGISTRY;
+
 #if !defined AMX_USERNUM
 #define AMX_USERNUM     4
 #endif
@@ -267,6 +276,21 @@ typedef struct tagOVERLAYINFO {
   int32_t size;             /* size in bytes */
 } PACKED AMX_OVERLAYINFO;
 
+/* Groups of overlays that are stored next to each other, so that a host can
+ * load a group with a single read. The table is optional; it ends just in
+ * front of the code block, with the AMX_OVLGROUPS trailer.
+ */
+typedef struct tagOVLGROUP {
+  int32_t offset;           /* offset relative to the start of the code block */
+  int32_t size;             /* size in bytes of all overlays in the group */
+} PACKED AMX_OVLGROUP;
+
+typedef struct tagOVLGROUPS {
+  int32_t count;            /* number of AMX_OVLGROUP entries before the trailer */
+  uint32_t magic;           /* AMX_OVLGROUP_MAGIC */
+} PACKED AMX_OVLGROUPS;
+#define AMX_OVLGROUP_MAGIC  0x53505247  /* "GRPS" */
+
 /* The AMX structure is the internal structure for many functions. Not all
  * fields are valid at all times; many fields are cached in local variables.
  */
@@ -345,6 +369,21 @@ typedef struct tagAMX_HEADER {
   #define AMX_MAGIC     AMX_MAGIC_64
 #endif
 
+/* Program metadata (name, icon, version), appended after all other blocks
+ * of the file. The block ends with the magic value, so that a launcher can
+ * find it with a single read at a fixed offset from the end of the file.
+ */
+typedef struct tagAMX_METADATA {
+  char name[32];            /* program name, zero-terminated */
+  uint32_t icon[32];        /* icon bitmap, one 32-pixel row per entry */
+  int32_t icon_rows;        /* number of rows in the icon, 0 if none */
+  int32_t version;          /* value of the constant "program_version", or 0 */
+  int32_t memory;           /* bytes of RAM needed to run the program */
+  int32_t size;             /* size of this structure */
+  uint32_t magic;           /* AMX_META_MAGIC */
+} PACKED AMX_METADATA;
+#define AMX_META_MAGIC  0x4154454d  /* "META" */
+
 enum {
   AMX_ERR_NONE,
   /* reserve the first 15 error codes for exit codes of the abstract machine */
@@ -478,6 +517,7 @@ int AMXAPI amx_GetPubVar(AMX *amx, int index, char *name, cell **address);
 int AMXAPI amx_GetString(char *dest,const cell *source, int use_wchar, size_t size);
 int AMXAPI amx_GetTag(AMX *amx, int index, char *tagname, cell *tag_id);
 int AMXAPI amx_GetUserData(AMX *amx, long tag, void **ptr);
+int AMXAPI amx_IndexPublics(AMX *amx, void *memory, size_t size);
 int AMXAPI amx_Init(AMX *amx, void *program);
 int AMXAPI amx_InitJIT(AMX *amx, void *reloc_table, void *native_code);
 int AMXAPI amx_MemInfo(AMX *amx, long *codesize, long *datasize, long *stackheap);
@@ -493,6 +533,9 @@ int AMXAPI amx_PushArray(AMX *amx, cell **address, const cell array[], int numce
 int AMXAPI amx_PushString(AMX *amx, cell **address, const char *string, int pack, int use_wchar);
 int AMXAPI amx_RaiseError(AMX *amx, int error);
 int AMXAPI amx_Register(AMX *amx, const AMX_NATIVE_INFO *nativelist, int number);
+int AMXAPI amx_RegisterAll(AMX *amx, const AMX_NATIVE_REGISTRY *registry);
+int AMXAPI amx_RegistryInit(AMX_NATIVE_REGISTRY *registry, const AMX_NATIVE_INFO * const *lists,
+                            int numlists, void *memory, size_t size);
 int AMXAPI amx_Release(AMX *amx, cell *address);
 int AMXAPI amx_SetCallback(AMX *amx, AMX_CALLBACK callback);
 int AMXAPI amx_SetDebugHook(AMX *amx, AMX_DEBUG debug);
@@ -167,6 +167,8 @@ static const void * const amx_opcodelist[] = {
         &&op_dec_p,       &&op_dec_p_s,     &&op_movs_p,      &&op_cmps_p,
         &&op_fill_p,      &&op_halt_p,      &&op_bounds_p,
 #endif
+        /* jump tables (numbered after the packed instructions) */
+        [175]=&&op_switch_tbl,&&op_jumptbl, &&op_switch_tbl_ovl,&&op_jumptbl_ovl,
 };
   AMX_HEADER *hdr;
   cell pri,alt,stk,frm,hea;
@@ -667,10 +669,28 @@ static const void * const amx_opcodelist[] = {
     cell *cptr=JUMPREL(cip)+1;  /* +1, to skip the "casetbl" opcode */
     cip=JUMPREL(cptr+1);        /* preset to "none-matched" case */
     num=(int)*cptr;             /* number of records in the case table */
-    for (cptr+=2; num>0 && *cptr!=pri; num--,cptr+=2)
-      /* nothing */;
-    if (num>0)
-      cip=JUMPREL(cptr+1);      /* case found */
+    /* the records are sorted on the case value, so use a binary search */
+    for (cptr+=2; num>0; num>>=1) {
+      cell *mid=cptr+2*(num>>1);
+      if (*mid==pri) {
+        cip=JUMPREL(mid+1);     /* case found */
+        break;
+      } /* if */
+      if (*mid<pri) {
+        cptr=mid+2;             /* continue with the records above "mid" */
+        num--;
+      } /* if */
+    } /* for */
+    NEXT(cip,op);
+    }
+  op_switch_tbl: {
+    cell *cptr=JUMPREL(cip)+1;  /* +1, to skip the "jumptbl" opcode */
+    offs=(cell)((ucell)pri-(ucell)*(cptr+2)); /* index in the jump table */
+    if ((ucell)offs<(ucell)*cptr)
+      cptr+=offs+3;             /* case found */
+    else
+      cptr+=1;                  /* "none-matched" case */
+    cip=JUMPREL(cptr);
     NEXT(cip,op);
     }
   op_swap_pri:
@@ -787,10 +807,30 @@ static const void * const amx_opcodelist[] = {
     cell *cptr=JUMPREL(cip)+1;  /* +1, to skip the "icasetbl" opcode */
     amx->ovl_index=*(cptr+1);   /* preset to "none-matched" case */
     num=(int)*cptr;             /* number of records in the case table */
-    for (cptr+=2; num>0 && *cptr!=pri; num--,cptr+=2)
-      /* nothing */;
-    if (num>0)
-      amx->ovl_index=*(cptr+1); /* case found */
+    for (cptr+=2; num>0; num>>=1) { /* binary search, see op_switch */
+      cell *mid=cptr+2*(num>>1);
+      if (*mid==pri) {
+        amx->ovl_index=*(mid+1);/* case found */
+        break;
+      } /* if */
+      if (*mid<pri) {
+        cptr=mid+2;
+        num--;
+      } /* if */
+    } /* for */
+    assert(amx->overlay!=NULL);
+    if ((num=amx->overlay(amx,amx->ovl_index))!=AMX_ERR_NONE)
+      ABORT(amx,num);
+    cip=(cell*)amx->code;
+    NEXT(cip,op);
+    }
+  op_switch_tbl_ovl: {
+    cell *cptr=JUMPREL(cip)+1;  /* +1, to skip the "jumptbl.ovl" opcode */
+    offs=(cell)((ucell)pri-(ucell)*(cptr+2)); /* index in the jump table */
+    if ((ucell)offs<(ucell)*cptr)
+      amx->ovl_index=*(cptr+offs+3); /* case found */
+    else
+      amx->ovl_index=*(cptr+1);      /* "none-matched" case */
     assert(amx->overlay!=NULL);
     if ((num=amx->overlay(amx,amx->ovl_index))!=AMX_ERR_NONE)
       ABORT(amx,num);
@@ -801,9 +841,12 @@ static const void * const amx_opcodelist[] = {
   op_call_ovl:
   op_retn_ovl:
   op_switch_ovl:
+  op_switch_tbl_ovl:
     ABORT(amx,AMX_ERR_INVINSTR);
 #endif
   op_casetbl_ovl:
+  op_jumptbl:
+  op_jumptbl_ovl:
     assert(0);                  /* this should not occur during execution */
     ABORT(amx,AMX_ERR_INVINSTR);
 
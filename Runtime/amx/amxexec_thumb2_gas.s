@@ -279,6 +279,14 @@ amx_opcodelist:
     .word   (.OP_HALT_P + call_offset)
     .word   (.OP_BOUNDS_P + call_offset)
 .endif  @ AMX_NO_PACKED_OPC
+    @ jump tables (numbered after the packed opcodes)
+    .space  175*4-(.-amx_opcodelist)
+    .word   (.OP_SWITCH_TBL + call_offset)
+    .word   (.OP_JUMPTBL + call_offset)
+.ifndef AMX_NO_OVERLAY
+    .word   (.OP_SWITCH_TBL_OVL + call_offset)
+    .word   (.OP_JUMPTBL_OVL + call_offset)
+.endif  @ AMX_NO_OVERLAY
 .equ    opcodelist_size, .-amx_opcodelist
 
 
@@ -1049,24 +1057,47 @@ amx_exec_run:
     bne .amx_exit               @ yes -> quit
     NEXT
 
-.OP_SWITCH:                     @ tested
-    str r14, [sp, #-4]!         @ need extra register
+.OP_SWITCH:
+    stmfd sp!, {r9, r14}        @ need extra registers
     ldr r11, [r4]               @ r11 = [CIP], relative offset to case-table
     add r11, r11, r4            @ r11 = direct address, OP_CASETBL opcode already skipped
     ldr r12, [r11]              @ r12 = number of case-table records
     ldr r14, [r11, #4]          @ preset CIP to "default" case (none-matched)
     add r4, r11, r14
+    add r11, r11, #8            @ r11 = first record; records are sorted on the case value
 .op_switch_loop:
-    subs r12, r12, #1           @ decrement number to do; any left?
-    bmi .op_switch_done         @ no, quit (CIP already set to the default value)
-    add r11, r11, #8            @ move to next record
-    ldr r14, [r11]              @ get the case value
-    cmp r0, r14                 @ case value identical to PRI ?
-    bne .op_switch_loop         @ no, continue
-    ldr r14, [r11, #4]          @ yes, load matching CIP and exit loop
-    add r4, r11, r14            @ r4 = address of case record + offset
+    cmp r12, #0                 @ any records left?
+    beq .op_switch_done         @ no, quit (CIP already set to the default value)
+    mov r9, r12, LSR #1
+    add r14, r11, r9, LSL #3    @ r14 = middle record
+    ldr r9, [r14]               @ get the case value
+    cmp r0, r9                  @ case value identical to PRI ?
+    beq .op_switch_found
+    itt gt                      @ PRI above the case value?
+    addgt r11, r14, #8          @ yes, continue with the records above the middle
+    subgt r12, r12, #1
+    mov r12, r12, LSR #1        @ halve the number of records
+    b   .op_switch_loop
+.op_switch_found:
+    ldr r9, [r14, #4]           @ load matching CIP
+    add r4, r14, r9             @ r4 = address of case record + offset
 .op_switch_done:
-    ldr r14, [sp], #4           @ restore r14
+    ldmfd sp!, {r9, r14}        @ restore registers
+    NEXT
+
+.OP_SWITCH_TBL:
+    ldr r11, [r4]               @ r11 = [CIP], relative offset to jump table
+    add r11, r11, r4            @ r11 = direct address, OP_JUMPTBL opcode already skipped
+    ldr r12, [r11, #8]          @ r12 = lowest case value
+    sub r12, r0, r12            @ r12 = index in the jump table
+    ldr r4, [r11]               @ r4 = number of entries
+    cmp r12, r4                 @ index out of range (unsigned compare)?
+    it  hs
+    mvnhs r12, #1               @ yes, index -2 selects the "default" entry
+    add r11, r11, r12, LSL #2
+    ldr r12, [r11, #12]         @ r12 = relative offset from the entry
+    add r4, r11, r12
+    add r4, r4, #8              @ r4 = address of entry + offset - 4
     NEXT
 
 .OP_SWAP_PRI:                   @ tested
@@ -1107,6 +1138,8 @@ amx_exec_run:
 
 .OP_CASETBL:
 .OP_CASETBL_OVL:
+.OP_JUMPTBL:
+.OP_JUMPTBL_OVL:
     mov r11, #AMX_ERR_INVINSTR  @ these instructions are no longer supported
     b   .amx_exit
 
@@ -1200,21 +1233,30 @@ amx_exec_run:
     NEXT
 
 .OP_SWITCH_OVL:
-    str r14, [sp, #-4]!         @ need extra register
+    stmfd sp!, {r9, r14}        @ need extra registers
     ldr r11, [r4]               @ r11 = [CIP], relative offset to case-table
     add r11, r11, r4            @ r11 = direct address, OP_CASETBL opcode already skipped
     ldr r12, [r11]              @ r12 = number of case-table records
     ldr r4, [r11, #4]           @ preset ovl_index to "default" case (none-matched)
+    add r11, r11, #8            @ r11 = first record, binary search as in OP_SWITCH
 .op_iswitch_loop:
-    subs r12, r12, #1           @ decrement number to do; any left?
-    bmi .op_iswitch_done        @ no, quit (CIP already set to the default value)
-    add r11, r11, #8            @ move to next record
-    ldr r14, [r11]              @ get the case value
-    cmp r0, r14                 @ case value identical to PRI ?
-    bne .op_iswitch_loop        @ no, continue
-    ldr r4, [r11, #4]           @ yes, load matching ovl_index and exit loop
+    cmp r12, #0                 @ any records left?
+    beq .op_iswitch_done        @ no, quit (ovl_index already set to the default value)
+    mov r9, r12, LSR #1
+    add r14, r11, r9, LSL #3    @ r14 = middle record
+    ldr r9, [r14]               @ get the case value
+    cmp r0, r9                  @ case value identical to PRI ?
+    beq .op_iswitch_found
+    itt gt
+    addgt r11, r14, #8
+    subgt r12, r12, #1
+    mov r12, r12, LSR #1
+    b   .op_iswitch_loop
+.op_iswitch_found:
+    ldr r4, [r14, #4]           @ load matching ovl_index
 .op_iswitch_done:
-    ldr r14, [sp], #4           @ restore r14
+    ldmfd sp!, {r9, r14}        @ restore registers
+.op_iswitch_load:
     str r4, [r10, #amxOvlIndex] @ store new overlay index
     stmfd sp!, {r0 - r3, r4, lr}@ save some extra registers (r4 is a dummy, to keep sp 8-byte aligned)
     mov r0, r10                 @ 1st arg = AMX
@@ -1226,6 +1268,19 @@ amx_exec_run:
     mov r4, r8                  @ CIP = code base
     NEXT
 
+.OP_SWITCH_TBL_OVL:
+    ldr r11, [r4]               @ r11 = [CIP], relative offset to jump table
+    add r11, r11, r4            @ r11 = direct address, OP_JUMPTBL_OVL opcode already skipped
+    ldr r12, [r11, #8]          @ r12 = lowest case value
+    sub r12, r0, r12            @ r12 = index in the jump table
+    ldr r4, [r11]               @ r4 = number of entries
+    cmp r12, r4                 @ index out of range (unsigned compare)?
+    it  hs
+    mvnhs r12, #1               @ yes, index -2 selects the "default" entry
+    add r11, r11, r12, LSL #2
+    ldr r4, [r11, #12]          @ r4 = overlay index
+    b   .op_iswitch_load
+
 .endif  @ AMX_NO_OVERLAY
 
 
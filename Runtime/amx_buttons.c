@@ -23,15 +23,10 @@ static cell AMX_NATIVE_CALL amx_scroller_speed(AMX *amx, const cell *params)
     return scroller_speed();
 }
 
-int amxinit_buttons(AMX *amx)
-{
-    static const AMX_NATIVE_INFO funcs[] = {
-        {"peek_keys", amx_peek_keys},
-        {"get_keys", amx_get_keys},
-        {"held_keys", amx_held_keys},
-        {"scroller_speed", amx_scroller_speed},
-        {0, 0}
-    };
-    
-    return amx_Register(amx, funcs, -1);
-}
+const AMX_NATIVE_INFO buttons_natives[] = {
+    {"peek_keys", amx_peek_keys},
+    {"get_keys", amx_get_keys},
+    {"held_keys", amx_held_keys},
+    {"scroller_speed", amx_scroller_speed},
+    {0, 0}
+};
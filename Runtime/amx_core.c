@@ -105,18 +105,13 @@ static cell AMX_NATIVE_CALL amx_memcpy(AMX *amx,const cell *params)
     return 0;
 }
 
-int amx_CoreInit(AMX *amx)
-{
-    const AMX_NATIVE_INFO core_Natives[] = {
-        { "numargs",       numargs },
-        { "getarg",        getarg },
-        { "setarg",        setarg },
-        { "heapspace",     heapspace },
-        { "funcidx",       funcidx },
-        { "memset", amx_memset},
-        { "memcpy", amx_memcpy},
-        {0, 0}
-    };
-    
-    return amx_Register(amx, core_Natives, -1);
-}
+const AMX_NATIVE_INFO core_natives[] = {
+    { "numargs",       numargs },
+    { "getarg",        getarg },
+    { "setarg",        setarg },
+    { "heapspace",     heapspace },
+    { "funcidx",       funcidx },
+    { "memset", amx_memset},
+    { "memcpy", amx_memcpy},
+    {0, 0}
+};
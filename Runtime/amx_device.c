@@ -63,17 +63,12 @@ static cell AMX_NATIVE_CALL amx_read_SN(AMX *amx , const cell *params)
 
 
 
-int amxinit_device(AMX *amx)
-{
-    static const AMX_NATIVE_INFO funcs[] = {
-        {"set_backlight", amx_set_backlight},
-        {"set_powersave", amx_set_powersave},
-        {"beep", amx_beep},
-        {"battery_voltage", amx_battery_voltage},
-        {"read_flash", amx_read_flash},
-        {"read_SN", amx_read_SN},
-        {0, 0}
-    };
-    
-    return amx_Register(amx, funcs, -1);
-}
+const AMX_NATIVE_INFO device_natives[] = {
+    {"set_backlight", amx_set_backlight},
+    {"set_powersave", amx_set_powersave},
+    {"beep", amx_beep},
+    {"battery_voltage", amx_battery_voltage},
+    {"read_flash", amx_read_flash},
+    {"read_SN", amx_read_SN},
+    {0, 0}
+};
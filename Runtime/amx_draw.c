@@ -74,71 +74,51 @@ static cell AMX_NATIVE_CALL amx_blend(AMX *amx, const cell *params)
 static cell AMX_NATIVE_CALL amx_putcolumn(AMX *amx, const cell *params)
 {
     // putcolumn(x, y, const pixels[], count, wait);
-    __Point_SCR(params[1], params[2]);
-    
-    cell *pixels = (cell*)params[3];
-    int count = params[4];
-    
-    // Routine copied from SYS1.50 source and modified to do
-    // 32 -> 16 bit mapping on the fly.
-    DMA2_Channel1->CCR = 0x5990;
-    DMA2_Channel1->CMAR = (uint32_t)pixels;
-    DMA2_Channel1->CNDTR = count;
-    DMA2_Channel1->CCR = 0x5991;
-    
-    if (params[5])
-    {
-        __LCD_DMA_Ready();
-    }
-    
+    lcd_write_column(params[1], params[2], (cell*)params[3], params[4], true, params[5]);
     return 0;
 }
 
 static cell AMX_NATIVE_CALL amx_getcolumn(AMX *amx, const cell *params)
 {
     // getcolumn(x, y, pixels[], count);
+    lcd_read_column(params[1], params[2], (cell*)params[3], params[4], true);
+    return 0;
+}
+
+static cell AMX_NATIVE_CALL amx_putcolumn16(AMX *amx, const cell *params)
+{
+    // putcolumn16(x, y, const pixels[], count, wait);
+    lcd_write_column(params[1], params[2], (cell*)params[3], params[4], false, params[5]);
+    return 0;
+}
+
+static cell AMX_NATIVE_CALL amx_getcolumn16(AMX *amx, const cell *params)
+{
+    // getcolumn16(x, y, pixels[], count);
+    lcd_read_column(params[1], params[2], (cell*)params[3], params[4], false);
+    return 0;
+}
+
+static cell AMX_NATIVE_CALL amx_putarea16(AMX *amx, const cell *params)
+{
+    // putarea16(x, y, w, h, const pixels[]);
+    int x = params[1], y = params[2], w = params[3], h = params[4];
+    const uint16_t *pixels = (const uint16_t*)params[5];
     
-    int x = params[1];
-    int y = params[2];
-    cell *pixels = (cell*)params[3];
-    int count = params[4];
-    
-    // Seems like DSO Quad may use two different kinds of LCD's, with
-    // slightly different command sets..
-    if (LCD_RD_Type() == LCD_TYPE_ILI9327)
-    {
-        __Point_SCR(x, y);
-        LCD_WR_Ctrl(0x2E);
-        
-        // Dummy read
-        always_read(LCD_PORT);
-        
-        // Use DMA to do the transfer
-        DMA2_Channel1->CCR = 0x5980;
-        DMA2_Channel1->CMAR = (uint32_t)pixels;
-        DMA2_Channel1->CNDTR = count;
-        DMA2_Channel1->CCR = 0x5981;
-        
-        __LCD_DMA_Ready();
+    for (int i = 0; i < w; i++)
+        lcd_write_column(x + i, y, pixels + i * h, h, false, true);
     
-        LCD_WR_Ctrl(0x2C);
-    }
-    else
-    {
-        // I haven't been able to test this code path.
-        __LCD_DMA_Ready();
-        // The R61509V doesn't automatically increment the address
-        // when reading, which slows this down a bit...
-        LCD_WR_REG(0x0201, x);
+    return 0;
+}
 
-        while (count--)
-        {
-            LCD_WR_REG(0x0200, y++);
-            LCD_WR_Ctrl(0x0202);
-            always_read(LCD_PORT);
-            *pixels++ = LCD_PORT;
-        }
-    }
+static cell AMX_NATIVE_CALL amx_getarea16(AMX *amx, const cell *params)
+{
+    // getarea16(x, y, w, h, pixels[]);
+    int x = params[1], y = params[2], w = params[3], h = params[4];
+    uint16_t *pixels = (uint16_t*)params[5];
+    
+    for (int i = 0; i < w; i++)
+        lcd_read_column(x + i, y, pixels + i * h, h, false);
     
     return 0;
 }
@@ -150,6 +130,13 @@ static cell AMX_NATIVE_CALL amx_drawline_aa(AMX *amx, const cell *params)
     return 0;
 }
 
+static cell AMX_NATIVE_CALL amx_drawpolyline_aa(AMX *amx, const cell *params)
+{
+    // drawpolyline_aa(const Fixed: xpoints[], const Fixed: ypoints[], count, color);
+    drawpolyline_aa((fix16_t*)params[1], (fix16_t*)params[2], params[3], params[4]);
+    return 0;
+}
+
 static cell AMX_NATIVE_CALL amx_drawline(AMX *amx, const cell *params)
 {
     // drawline(x1, y1, x2, y2, color, dots)
@@ -170,6 +157,178 @@ static cell AMX_NATIVE_CALL amx_draw_bitmap(AMX *amx, const cell *params)
     return 0;
 }
 
+static cell AMX_NATIVE_CALL amx_draw_bitmap16(AMX *amx, const cell *params)
+{
+    // draw_bitmap16(const bitmap[], x, y, width, height, const Color: palette[16], center);
+    draw_bitmap16((uint32_t*)params[1], params[2], params[3], params[4], params[5],
+                  (uint32_t*)params[6], params[7]);
+    return 0;
+}
+
+/* Graph grid generation for graph.inc */
+
+// Field indexes in the GraphAxis pseudo-struct
+enum {AXIS_TICKCOLOR, AXIS_MIN, AXIS_MAX, AXIS_MAJOR, AXIS_MINOR, AXIS_LOG};
+
+typedef struct {
+    fix16_t min, max, major;
+    int minor;
+    bool log;
+    int start, length;
+    fix16_t scale; // Pixels per axis unit
+} grid_axis_t;
+
+static void grid_axis_init(grid_axis_t *axis, const cell *fields, int start, int length)
+{
+    axis->min = fields[AXIS_MIN];
+    axis->max = fields[AXIS_MAX];
+    axis->major = fields[AXIS_MAJOR];
+    axis->minor = fields[AXIS_MINOR];
+    axis->log = fields[AXIS_LOG];
+    axis->start = start;
+    axis->length = length;
+    
+    if (axis->max > axis->min)
+        axis->scale = fix16_div(fix16_from_int(length), axis->max - axis->min);
+    else
+        axis->scale = 0;
+}
+
+// Same rounding as graph_topixels() followed by fround().
+static int grid_topixels(const grid_axis_t *axis, fix16_t value)
+{
+    return fix16_to_int(fix16_from_int(axis->start) +
+                        fix16_mul(value - axis->min, axis->scale));
+}
+
+// log10(1) .. log10(20) and 1 / ln(10) in fix16 format
+#define LOG10_TABLE_SIZE 20
+static const fix16_t log10_table[LOG10_TABLE_SIZE] = {
+    0, 19728, 31269, 39457, 45808, 50997, 55384, 59185, 62537, 65536,
+    68249, 70725, 73003, 75113, 77076, 78913, 80639, 82266, 83804, 85264
+};
+#define INV_LN10 28462
+
+static fix16_t grid_log10(fix16_t value)
+{
+    int i = fix16_to_int(value);
+    if (fix16_from_int(i) == value && i >= 1 && i <= LOG10_TABLE_SIZE)
+        return log10_table[i - 1];
+    else
+        return fix16_mul(fix16_log(value), INV_LN10);
+}
+
+// Calls mark() with the pixel coordinate of every major (is_major = true)
+// and minor gridline on the axis. Minor lines come before the major lines,
+// so that major lines get drawn on top.
+static void grid_foreach_line(const grid_axis_t *axis,
+                              void (*mark)(void *ctx, int pixel, bool is_major),
+                              void *ctx)
+{
+    if (axis->scale == 0 || axis->major <= 0)
+        return;
+    
+    // Do not spend forever on axes with more lines than pixels.
+    if (fix16_mul(axis->major, axis->scale) < fix16_one)
+        return;
+    
+    fix16_t rem = axis->min % axis->major;
+    if (rem < 0) rem += axis->major;
+    fix16_t first = axis->min - rem;
+    
+    if (axis->minor > 1)
+    {
+        fix16_t step = axis->major / axis->minor;
+        
+        // On log axes, the minor lines are at log10(i * step) from the
+        // next major line. fix16_log() is slow and inaccurate below 1, so
+        // this is computed as log10(major) - log10(minor) + log10(i).
+        fix16_t log_step = 0;
+        if (axis->log)
+            log_step = grid_log10(axis->major) - grid_log10(fix16_from_int(axis->minor));
+        
+        for (fix16_t m = first; m < axis->max; m += axis->major)
+        {
+            for (int i = 1; i < axis->minor; i++)
+            {
+                fix16_t value;
+                if (!axis->log)
+                    value = m + step * i;
+                else
+                    value = m + axis->major + log_step + grid_log10(fix16_from_int(i));
+                
+                if (value >= axis->min && value <= axis->max)
+                    mark(ctx, grid_topixels(axis, value), false);
+            }
+        }
+    }
+    
+    if (rem != 0) first += axis->major;
+    for (fix16_t m = first; m <= axis->max; m += axis->major)
+        mark(ctx, grid_topixels(axis, m), true);
+}
+
+typedef struct {
+    cell *column;
+    int y0, height;
+    cell major, minor;
+} grid_column_t;
+
+static void mark_row(void *ctx, int pixel, bool is_major)
+{
+    grid_column_t *c = ctx;
+    int idx = pixel - c->y0;
+    if (idx >= 0 && idx < c->height)
+        c->column[idx] = is_major ? c->major : c->minor;
+}
+
+typedef struct {
+    int x;
+    int found; // 0: no line, 1: minor line, 2: major line
+} grid_find_t;
+
+static void find_column(void *ctx, int pixel, bool is_major)
+{
+    grid_find_t *f = ctx;
+    if (pixel == f->x && f->found < (is_major ? 2 : 1))
+        f->found = is_major ? 2 : 1;
+}
+
+static cell AMX_NATIVE_CALL amx_graph_grid_column(AMX *amx, const cell *params)
+{
+    // graph_grid_column(x, y0, Color: column[], height,
+    //                   const xaxis[GraphAxis], const yaxis[GraphAxis],
+    //                   gx, gy, gw, gh, Color: bg, Color: major, Color: minor);
+    grid_column_t c = {(cell*)params[3], params[2], params[4], params[12], params[13]};
+    cell bg = params[11];
+    
+    grid_axis_t xaxis, yaxis;
+    grid_axis_init(&xaxis, (cell*)params[5], params[7], params[9]);
+    grid_axis_init(&yaxis, (cell*)params[6], params[8], params[10]);
+    
+    grid_find_t find = {params[1], 0};
+    grid_foreach_line(&xaxis, find_column, &find);
+    
+    for (int i = 0; i < c.height; i++)
+        c.column[i] = (find.found == 2) ? c.major : bg;
+    
+    if (find.found == 2)
+        return 0;
+    
+    grid_foreach_line(&yaxis, mark_row, &c);
+    
+    if (find.found == 1)
+    {
+        for (int i = 0; i < c.height; i++)
+        {
+            if (c.column[i] == bg)
+                c.column[i] = c.minor;
+        }
+    }
+    
+    return 0;
+}
+
 static cell AMX_NATIVE_CALL amx_save_bitmap(AMX *amx, const cell *params)
 {
     char *fname;
@@ -180,28 +339,34 @@ static cell AMX_NATIVE_CALL amx_save_bitmap(AMX *amx, const cell *params)
     for (int i = 0; i < params[3]; i++)
         palette[15 - i] = ((cell*)params[2])[i];
     
-    return write_bitmap(fname, palette);
-}
-
-int amxinit_display(AMX *amx)
-{
-    static const AMX_NATIVE_INFO funcs[] = {
-        {"draw_text", amx_draw_text},
-        {"draw_flowtext", amx_draw_flowtext},
-        {"lcd_type", amx_lcd_type},
-        {"fill_rectangle", amx_fill_rectangle},
-        {"putpixel", amx_putpixel},
-        {"getpixel", amx_getpixel},
-        {"blend", amx_blend},
-        {"putcolumn", amx_putcolumn},
-        {"getcolumn", amx_getcolumn},
-        {"drawline_aa", amx_drawline_aa},
-        {"drawline", amx_drawline},
-        {"draw_rectangle", amx_draw_rectangle},
-        {"draw_bitmap", amx_draw_bitmap},
-        {"save_bitmap", amx_save_bitmap},
-        {0, 0}
-    };
+    // Programs compiled before the compress parameter was added pass
+    // only 3 parameters.
+    bool compress = (params[0] >= 4 * sizeof(cell)) && params[4];
     
-    return amx_Register(amx, funcs, -1);
+    return write_bitmap(fname, palette, compress);
 }
+
+const AMX_NATIVE_INFO display_natives[] = {
+    {"draw_text", amx_draw_text},
+    {"draw_flowtext", amx_draw_flowtext},
+    {"lcd_type", amx_lcd_type},
+    {"fill_rectangle", amx_fill_rectangle},
+    {"putpixel", amx_putpixel},
+    {"getpixel", amx_getpixel},
+    {"blend", amx_blend},
+    {"putcolumn", amx_putcolumn},
+    {"getcolumn", amx_getcolumn},
+    {"putcolumn16", amx_putcolumn16},
+    {"getcolumn16", amx_getcolumn16},
+    {"putarea16", amx_putarea16},
+    {"getarea16", amx_getarea16},
+    {"drawline_aa", amx_drawline_aa},
+    {"drawpolyline_aa", amx_drawpolyline_aa},
+    {"drawline", amx_drawline},
+    {"draw_rectangle", amx_draw_rectangle},
+    {"draw_bitmap", amx_draw_bitmap},
+    {"draw_bitmap16", amx_draw_bitmap16},
+    {"graph_grid_column", amx_graph_grid_column},
+    {"save_bitmap", amx_save_bitmap},
+    {0, 0}
+};
@@ -4,6 +4,7 @@
 #include "amx.h"
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include "ds203_io.h"
 
 #define FILE_COUNT 4
@@ -15,6 +16,21 @@ typedef struct {
 
 static file_t files[FILE_COUNT];
 
+// Hash index of ini file options, see inifile_index(). It is kept in RAM
+// owned by the runtime rather than in a script array, which could go out
+// of scope while the file is still open. Only one file at a time has an
+// index.
+#define INI_INDEX_SLOTS 32
+static file_t *ini_index_owner;
+static cell ini_index[INI_INDEX_SLOTS * 2];
+
+// Discard the index of the file, if it has one.
+static void drop_ini_index(file_t *file)
+{
+    if (ini_index_owner == file)
+        ini_index_owner = NULL;
+}
+
 static cell AMX_NATIVE_CALL amx_f_open(AMX *amx, const cell *params)
 {
     file_t *file = 0;
@@ -49,10 +65,208 @@ static cell AMX_NATIVE_CALL amx_f_open(AMX *amx, const cell *params)
     if (status != 0 && file->error == 0) file->error = status; \
     } while(0)
 
+// Buffer for collecting small writes into full sectors, or for reading
+// ahead when reading text line by line. There is not enough RAM for a
+// buffer per handle, so the buffer belongs to whichever file used it last
+// and is released when another file or another kind of access takes it
+// over.
+#define IOBUF_SIZE 512
+static file_t *iobuf_owner;
+static bool iobuf_reading;
+static unsigned iobuf_pos;   // Read position when reading
+static unsigned iobuf_len;   // Bytes in buffer
+static unsigned iobuf_limit; // Flush threshold when writing
+static uint32_t iobuf[IOBUF_SIZE / 4];
+
+// Write out any data buffered for the file, or rewind over any data that
+// was read ahead but not used. Safe to call for any file.
+static bool release_iobuf(file_t *file)
+{
+    if (iobuf_owner != file)
+        return true;
+    
+    FRESULT result = FR_OK;
+    if (iobuf_reading)
+    {
+        unsigned unread = iobuf_len - iobuf_pos;
+        if (unread > 0)
+            result = f_lseek(&file->f, f_tell(&file->f) - unread);
+    }
+    else if (iobuf_len > 0)
+    {
+        unsigned bytes;
+        result = f_write(&file->f, iobuf, iobuf_len, &bytes);
+        if (result == FR_OK && bytes != iobuf_len)
+            result = FR_DENIED; // Disk full
+    }
+    SETERROR(result);
+    
+    iobuf_owner = NULL;
+    iobuf_len = 0;
+    return (result == FR_OK);
+}
+
+// Take over the buffer for reading or writing the given file.
+static void claim_iobuf(file_t *file, bool reading)
+{
+    if (iobuf_owner == file && iobuf_reading == reading)
+        return;
+    
+    if (iobuf_owner)
+        release_iobuf(iobuf_owner);
+    
+    iobuf_owner = file;
+    iobuf_reading = reading;
+    iobuf_pos = 0;
+    iobuf_len = 0;
+    iobuf_limit = IOBUF_SIZE - f_tell(&file->f) % IOBUF_SIZE;
+}
+
+// Position of the file as seen by the Pawn script.
+static unsigned buffered_tell(file_t *file)
+{
+    unsigned pos = f_tell(&file->f);
+    
+    if (iobuf_owner == file)
+    {
+        if (iobuf_reading)
+            pos -= iobuf_len - iobuf_pos;
+        else
+            pos += iobuf_len;
+    }
+    
+    return pos;
+}
+
+// Make room in the buffer for the given file and return the number of
+// bytes that can be appended before the next flush. The first fill is cut
+// short so that the following flushes start on a sector boundary.
+static unsigned writebuf_space(file_t *file)
+{
+    claim_iobuf(file, false);
+    drop_ini_index(file);
+    
+    if (iobuf_len == iobuf_limit)
+    {
+        if (!release_iobuf(file))
+            return 0;
+        
+        claim_iobuf(file, false);
+    }
+    
+    return iobuf_limit - iobuf_len;
+}
+
+// Return the number of bytes available in the read-ahead buffer, reading
+// more from the file if it is empty. Reads are aligned to sectors.
+static unsigned readbuf_fill(file_t *file)
+{
+    claim_iobuf(file, true);
+    
+    if (iobuf_pos == iobuf_len)
+    {
+        unsigned size = IOBUF_SIZE - f_tell(&file->f) % IOBUF_SIZE;
+        unsigned bytes = 0;
+        SETERROR(f_read(&file->f, iobuf, size, &bytes));
+        iobuf_pos = 0;
+        iobuf_len = bytes;
+    }
+    
+    return iobuf_len - iobuf_pos;
+}
+
+// Read one byte through the read-ahead buffer, or -1 at end of file.
+static int buffered_getc(file_t *file)
+{
+    if (readbuf_fill(file) == 0)
+        return -1;
+    
+    return ((const uint8_t*)iobuf)[iobuf_pos++];
+}
+
+// Move to a position in the file. Seeks inside the read-ahead buffer are
+// handled without calling FatFs.
+static void buffered_seek(file_t *file, unsigned pos)
+{
+    if (iobuf_owner == file && iobuf_reading)
+    {
+        unsigned end = f_tell(&file->f);
+        unsigned start = end - iobuf_len;
+        if (pos >= start && pos <= end)
+        {
+            iobuf_pos = pos - start;
+            return;
+        }
+        
+        // No need to rewind over the unread data as we seek anyway.
+        iobuf_owner = NULL;
+    }
+    
+    release_iobuf(file);
+    SETERROR(f_lseek(&file->f, pos));
+}
+
+// Append raw bytes to the file through the write buffer.
+static bool buffered_write(file_t *file, const char *data, unsigned size)
+{
+    while (size > 0)
+    {
+        unsigned n = writebuf_space(file);
+        if (n == 0) return false;
+        if (n > size) n = size;
+        
+        memcpy((char*)iobuf + iobuf_len, data, n);
+        iobuf_len += n;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Append bytes from a Pawn packed array, swapping the byte order of each
+// cell while copying it into the buffer.
+static bool buffered_write_cells(file_t *file, const cell *src, unsigned size)
+{
+    unsigned pos = 0;
+    while (pos < size)
+    {
+        unsigned n = writebuf_space(file);
+        if (n == 0) return false;
+        if (n > size - pos) n = size - pos;
+        
+        uint8_t *dest = (uint8_t*)iobuf + iobuf_len;
+        const uint8_t *bytes = (const uint8_t*)src;
+        unsigned end = pos + n;
+        
+        if (((iobuf_len | pos) & 3) == 0)
+        {
+            // Both sides aligned, swap whole cells.
+            uint32_t *d = (uint32_t*)dest;
+            while (pos + 4 <= end)
+            {
+                *d++ = __builtin_bswap32(src[pos / 4]);
+                pos += 4;
+            }
+            dest = (uint8_t*)d;
+        }
+        
+        while (pos < end)
+        {
+            *dest++ = bytes[pos ^ 3];
+            pos++;
+        }
+        
+        iobuf_len += n;
+    }
+    return true;
+}
+
 static cell AMX_NATIVE_CALL amx_f_close(AMX *amx, const cell *params)
 {
     GETPARAM();
     
+    release_iobuf(file);
+    drop_ini_index(file);
     SETERROR(f_close(&file->f));
     file->valid = false;
     
@@ -62,13 +276,14 @@ static cell AMX_NATIVE_CALL amx_f_close(AMX *amx, const cell *params)
 static cell AMX_NATIVE_CALL amx_f_read(AMX *amx, const cell *params)
 {
     GETPARAM();
+    release_iobuf(file);
     
     unsigned bytes;
     SETERROR(f_read(&file->f, (char*)params[2], params[3], &bytes));
     
     // Swap the bytes in each cell to convert into Pawn packed string
     cell* p = (cell*)params[2];
-    for (int i = 0; i <= params[3] / 4; i++, p++)
+    for (int i = 0; i < (bytes + 3) / 4; i++, p++)
     {
         *p = __builtin_bswap32(*p);
     }
@@ -76,6 +291,48 @@ static cell AMX_NATIVE_CALL amx_f_read(AMX *amx, const cell *params)
     return bytes;
 }
 
+static cell AMX_NATIVE_CALL amx_f_readcells(AMX *amx, const cell *params)
+{
+    GETPARAM();
+    release_iobuf(file);
+    
+    // Cells are stored in native byte order, so no swapping is needed.
+    unsigned bytes;
+    SETERROR(f_read(&file->f, (char*)params[2], params[3] * sizeof(cell), &bytes));
+    return bytes / sizeof(cell);
+}
+
+static cell AMX_NATIVE_CALL amx_f_readline(AMX *amx, const cell *params)
+{
+    GETPARAM();
+    
+    // f_readline(file, dest{}, destsize)
+    // Pawn packed strings store the first character in the most
+    // significant byte, hence the i ^ 3.
+    uint8_t *dest = (uint8_t*)params[2];
+    unsigned max = params[3] * 4 - 1;
+    unsigned i = 0;
+    
+    while (i < max)
+    {
+        int c = buffered_getc(file);
+        if (c < 0) break;
+        
+        if (c == '\r') continue;
+        if (c == '\n')
+        {
+            dest[i ^ 3] = 0;
+            return true;
+        }
+        
+        dest[i ^ 3] = c;
+        i++;
+    }
+    
+    dest[i ^ 3] = 0;
+    return i != 0;
+}
+
 static cell AMX_NATIVE_CALL amx_f_write(AMX *amx, const cell *params)
 {
     GETPARAM();
@@ -87,56 +344,53 @@ static cell AMX_NATIVE_CALL amx_f_write(AMX *amx, const cell *params)
     {
         char *text;
         amx_StrParam(amx, src, text);
-        unsigned bytes;
-        unsigned size = strlen(text);
-        if (size == 0) return true;
-        
-        SETERROR(f_write(&file->f, text, size, &bytes));
-        
-        return (bytes == size);
+        return buffered_write(file, text, strlen(text));
     }
     else
     {
-        while (count > 0)
-        {
-            uint32_t tmp = __builtin_bswap32(*src++);
-            unsigned bytes;
-            unsigned size = 4;
-            if (count < size) size = count;
-            
-            SETERROR(f_write(&file->f, &tmp, size, &bytes));
-            
-            if (bytes != size)
-                return false;
-            
-            count -= 4;
-        }
-        return true;
+        return buffered_write_cells(file, src, count);
     }
 }
 
+static cell AMX_NATIVE_CALL amx_f_writecells(AMX *amx, const cell *params)
+{
+    GETPARAM();
+    return buffered_write(file, (const char*)params[2], params[3] * sizeof(cell));
+}
+
+static cell AMX_NATIVE_CALL amx_f_flush(AMX *amx, const cell *params)
+{
+    GETPARAM();
+    release_iobuf(file);
+    SETERROR(f_sync(&file->f));
+    return (file->error == FR_OK);
+}
+
 static cell AMX_NATIVE_CALL amx_f_lseek(AMX *amx, const cell *params)
 {
     GETPARAM();
-    SETERROR(f_lseek(&file->f, params[2]));
+    buffered_seek(file, params[2]);
     return 0;
 }
 
 static cell AMX_NATIVE_CALL amx_f_tell(AMX *amx, const cell *params)
 {
     GETPARAM();
-    return f_tell(&file->f);
+    return buffered_tell(file);
 }
 
 static cell AMX_NATIVE_CALL amx_f_size(AMX *amx, const cell *params)
 {
     GETPARAM();
+    release_iobuf(file);
     return f_size(&file->f);
 }
 
 static cell AMX_NATIVE_CALL amx_f_truncate(AMX *amx, const cell *params)
 {
     GETPARAM();
+    release_iobuf(file);
+    drop_ini_index(file);
     return f_truncate(&file->f) == FR_OK;
 }
 
@@ -187,6 +441,368 @@ static cell AMX_NATIVE_CALL amx_f_exists(AMX *amx, const cell *params)
     return f_exists(fname);
 }
 
+/* Ini file support. Instead of storing the options in RAM, the index
+ * stores the file position of each option line, hashed by option name.
+ * Each slot takes two cells: the hash and the position + 1.
+ */
+
+#define INI_KEYLEN 64
+#define INI_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\r')
+
+static uint32_t ini_hash(const char *key)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    while (*key)
+    {
+        hash ^= (uint8_t)*key++;
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+// Read the option name at the current position, without surrounding
+// whitespace. Returns the character that ended the name: '=', '\n' or
+// -1 for end of file.
+static int ini_readkey(file_t *file, char *key)
+{
+    int c, len = 0, end = 0;
+    while ((c = buffered_getc(file)) >= 0 && c != '=' && c != '\n')
+    {
+        if (INI_SPACE(c) && len == 0) continue;
+        if (len == INI_KEYLEN - 1) continue;
+        
+        key[len++] = c;
+        if (!INI_SPACE(c)) end = len;
+    }
+    key[end] = 0;
+    return c;
+}
+
+// Read the rest of the line into a packed Pawn string, without
+// surrounding whitespace.
+static void ini_readvalue(file_t *file, cell *dest, unsigned maxlength)
+{
+    uint8_t *d = (uint8_t*)dest;
+    unsigned max = maxlength * 4 - 1;
+    unsigned len = 0, end = 0;
+    int c;
+    while ((c = buffered_getc(file)) >= 0 && c != '\n')
+    {
+        if (INI_SPACE(c) && len == 0) continue;
+        if (len == max) continue;
+        
+        d[len++ ^ 3] = c;
+        if (!INI_SPACE(c)) end = len;
+    }
+    d[end ^ 3] = 0;
+}
+
+static void ini_skipline(file_t *file, int c)
+{
+    while (c >= 0 && c != '\n')
+        c = buffered_getc(file);
+}
+
+static cell AMX_NATIVE_CALL amx_inifile_index(AMX *amx, const cell *params)
+{
+    // inifile_index(file)
+    GETPARAM();
+    cell *index = ini_index;
+    unsigned slots = INI_INDEX_SLOTS;
+    unsigned count = 0;
+    
+    ini_index_owner = NULL;
+    memset(index, 0, sizeof(ini_index));
+    
+    buffered_seek(file, 0);
+    int c;
+    do
+    {
+        char key[INI_KEYLEN];
+        unsigned pos = buffered_tell(file);
+        c = ini_readkey(file, key);
+        
+        if (c == '=' && key[0] != 0)
+        {
+            if (count == slots)
+                return false; // Index is too small, fall back to scanning.
+            
+            uint32_t hash = ini_hash(key);
+            unsigned i = hash % slots;
+            while (index[2 * i + 1] != 0)
+                i = (i + 1) % slots;
+            
+            index[2 * i] = hash;
+            index[2 * i + 1] = pos + 1;
+            count++;
+        }
+        
+        ini_skipline(file, c);
+    } while (c >= 0);
+    
+    ini_index_owner = file;
+    return true;
+}
+
+static cell AMX_NATIVE_CALL amx_inifile_get(AMX *amx, const cell *params)
+{
+    // inifile_get(file, const optname{}, value{}, maxlength)
+    GETPARAM();
+    char *optname;
+    amx_StrParam(amx, params[2], optname);
+    char key[INI_KEYLEN];
+    int c;
+    
+    if (ini_index_owner == file)
+    {
+        const cell *index = ini_index;
+        unsigned slots = INI_INDEX_SLOTS;
+        uint32_t hash = ini_hash(optname);
+        
+        for (unsigned i = hash % slots, n = 0;
+             n < slots && index[2 * i + 1] != 0;
+             i = (i + 1) % slots, n++)
+        {
+            if (index[2 * i] != (cell)hash)
+                continue;
+            
+            buffered_seek(file, index[2 * i + 1] - 1);
+            if (ini_readkey(file, key) == '=' && strcmp(key, optname) == 0)
+            {
+                ini_readvalue(file, (cell*)params[3], params[4]);
+                return true;
+            }
+        }
+        
+        return false;
+    }
+    
+    // No index, scan the whole file.
+    buffered_seek(file, 0);
+    do
+    {
+        c = ini_readkey(file, key);
+        if (c == '=' && strcmp(key, optname) == 0)
+        {
+            ini_readvalue(file, (cell*)params[3], params[4]);
+            return true;
+        }
+        
+        ini_skipline(file, c);
+    } while (c >= 0);
+    
+    return false;
+}
+
+static cell AMX_NATIVE_CALL amx_inifile_write(AMX *amx, const cell *params)
+{
+    // inifile_write(file, const optname{}, const value{})
+    GETPARAM();
+    char *optname, *value;
+    amx_StrParam(amx, params[2], optname);
+    amx_StrParam(amx, params[3], value);
+    
+    static const char padding[] = "                    ";
+    unsigned len = strlen(optname);
+    unsigned pad = (len < sizeof(padding) - 1) ? sizeof(padding) - 1 - len : 0;
+    
+    return buffered_write(file, optname, len)
+        && buffered_write(file, padding, pad)
+        && buffered_write(file, " = ", 3)
+        && buffered_write(file, value, strlen(value))
+        && buffered_write(file, "\r\n", 2);
+}
+
+/* Binary capture logs. The format is described in caplog.inc and
+ * converted to VCD or CSV on a PC by Tools/logconv.c. Blocks of
+ * variable length are encoded twice: first only to count the bytes for the
+ * block header and then to actually write them.
+ */
+
+enum { LOG_ANALOG = 1, LOG_DIGITAL = 2, LOG_EVENTS = 3 };
+enum { LOG_RAW = 0, LOG_RLE = 1 };
+
+typedef struct {
+    file_t *file; // NULL when only counting bytes
+    unsigned length;
+    unsigned pos;
+    uint8_t buf[32];
+} log_out_t;
+
+static void log_put(log_out_t *out, uint8_t byte)
+{
+    out->length++;
+    if (!out->file) return;
+    
+    out->buf[out->pos++] = byte;
+    if (out->pos == sizeof(out->buf))
+    {
+        buffered_write(out->file, (const char*)out->buf, out->pos);
+        out->pos = 0;
+    }
+}
+
+static void log_put_u32(log_out_t *out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++, value >>= 8)
+        log_put(out, value & 0xFF);
+}
+
+// Unsigned LEB128, 7 bits per byte
+static void log_put_varint(log_out_t *out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        log_put(out, (value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    log_put(out, value);
+}
+
+static bool log_finish(log_out_t *out)
+{
+    return buffered_write(out->file, (const char*)out->buf, out->pos)
+        && out->file->error == FR_OK;
+}
+
+// Most of the log natives have parameters (file, data[], count, channels,
+// timestamp_low, timestamp_high), which go into the block header as is.
+static void log_block_header(log_out_t *out, const cell *params, int type,
+                             int encoding, unsigned length, uint32_t interval)
+{
+    log_put(out, type);
+    log_put(out, encoding);
+    log_put(out, params[4]);
+    log_put(out, 0);
+    log_put_u32(out, params[3]);
+    log_put_u32(out, length);
+    log_put_u32(out, params[5]);
+    log_put_u32(out, params[6]);
+    log_put_u32(out, interval);
+}
+
+static uint32_t log_mask(cell channels)
+{
+    if (channels >= 8) return 0xFF;
+    if (channels <= 0) return 0;
+    return (1 << channels) - 1;
+}
+
+static void log_encode_rle(log_out_t *out, const cell *levels, unsigned count, uint32_t mask)
+{
+    unsigned i = 0;
+    while (i < count)
+    {
+        uint32_t value = levels[i] & mask;
+        unsigned run = 1;
+        while (i + run < count && (levels[i + run] & mask) == value)
+            run++;
+        
+        log_put(out, value);
+        log_put_varint(out, run);
+        i += run;
+    }
+}
+
+static void log_encode_events(log_out_t *out, const cell *deltas, const cell *levels,
+                              unsigned count, uint32_t mask)
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        log_put_varint(out, deltas[i]);
+        log_put(out, levels[i] & mask);
+    }
+}
+
+static cell AMX_NATIVE_CALL amx_log_header(AMX *amx, const cell *params)
+{
+    // log_header(file, analog_channels, digital_channels, timescale_ps)
+    GETPARAM();
+    log_out_t out = {file};
+    log_put(&out, 'Q');
+    log_put(&out, 'L');
+    log_put(&out, 'O');
+    log_put(&out, 'G');
+    log_put(&out, 1); // Version
+    log_put(&out, params[2]);
+    log_put(&out, params[3]);
+    log_put(&out, 0);
+    log_put_u32(&out, params[4]);
+    log_put_u32(&out, 0);
+    return log_finish(&out);
+}
+
+static cell AMX_NATIVE_CALL amx_log_analog(AMX *amx, const cell *params)
+{
+    // log_analog(file, const samples{}, count, channels, timestamp_low,
+    //            timestamp_high, interval)
+    GETPARAM();
+    unsigned bytes = params[3] * params[4];
+    log_out_t out = {file};
+    log_block_header(&out, params, LOG_ANALOG, LOG_RAW, bytes, params[7]);
+    
+    return log_finish(&out)
+        && buffered_write_cells(file, (const cell*)params[2], bytes);
+}
+
+static cell AMX_NATIVE_CALL amx_log_digital(AMX *amx, const cell *params)
+{
+    // log_digital(file, const levels[], count, channels, timestamp_low,
+    //             timestamp_high, interval, encoding)
+    GETPARAM();
+    const cell *levels = (const cell*)params[2];
+    unsigned count = params[3];
+    unsigned channels = params[4];
+    uint32_t mask = log_mask(channels);
+    log_out_t out = {file};
+    
+    if (params[8] == LOG_RLE)
+    {
+        log_out_t counter = {NULL};
+        log_encode_rle(&counter, levels, count, mask);
+        log_block_header(&out, params, LOG_DIGITAL, LOG_RLE, counter.length, params[7]);
+        log_encode_rle(&out, levels, count, mask);
+    }
+    else
+    {
+        // One bit plane per channel, first sample in the lowest bit.
+        log_block_header(&out, params, LOG_DIGITAL, LOG_RAW,
+                         channels * ((count + 7) / 8), params[7]);
+        for (unsigned c = 0; c < channels; c++)
+        {
+            for (unsigned i = 0; i < count; i += 8)
+            {
+                uint8_t bits = 0;
+                for (unsigned j = 0; j < 8 && i + j < count; j++)
+                    bits |= ((levels[i + j] >> c) & 1) << j;
+                log_put(&out, bits);
+            }
+        }
+    }
+    
+    return log_finish(&out);
+}
+
+static cell AMX_NATIVE_CALL amx_log_events(AMX *amx, const cell *params)
+{
+    // log_events(file, const deltas[], count, channels, timestamp_low,
+    //            timestamp_high, const levels[])
+    GETPARAM();
+    const cell *deltas = (const cell*)params[2];
+    const cell *levels = (const cell*)params[7];
+    unsigned count = params[3];
+    uint32_t mask = log_mask(params[4]);
+    
+    log_out_t counter = {NULL};
+    log_encode_events(&counter, deltas, levels, count, mask);
+    
+    log_out_t out = {file};
+    log_block_header(&out, params, LOG_EVENTS, LOG_RAW, counter.length, 0);
+    log_encode_events(&out, deltas, levels, count, mask);
+    return log_finish(&out);
+}
+
 static cell AMX_NATIVE_CALL amx_select_filename(AMX *amx, const cell *params)
 {
     char *format;
@@ -195,33 +811,47 @@ static cell AMX_NATIVE_CALL amx_select_filename(AMX *amx, const cell *params)
     return 0;
 }
 
+const AMX_NATIVE_INFO file_natives[] = {
+    {"f_open", amx_f_open},
+    {"f_close", amx_f_close},
+    {"f_read", amx_f_read},
+    {"f_readcells", amx_f_readcells},
+    {"f_readline", amx_f_readline},
+    {"f_write", amx_f_write},
+    {"f_writecells", amx_f_writecells},
+    {"f_flush", amx_f_flush},
+    {"f_lseek", amx_f_lseek},
+    {"f_tell", amx_f_tell},
+    {"f_size", amx_f_size},
+    {"f_truncate", amx_f_truncate},
+    {"f_getfree", amx_f_getfree},
+    {"f_opendir", amx_f_opendir},
+    {"f_readdir", amx_f_readdir},
+    {"f_error", amx_f_error},
+    {"f_exists", amx_f_exists},
+    {"inifile_index", amx_inifile_index},
+    {"inifile_get", amx_inifile_get},
+    {"inifile_write", amx_inifile_write},
+    {"log_header", amx_log_header},
+    {"log_analog", amx_log_analog},
+    {"log_digital", amx_log_digital},
+    {"log_events", amx_log_events},
+    {"select_filename", amx_select_filename},
+    {0, 0}
+};
+
 int amxinit_file(AMX *amx)
 {
-    static const AMX_NATIVE_INFO funcs[] = {
-        {"f_open", amx_f_open},
-        {"f_close", amx_f_close},
-        {"f_read", amx_f_read},
-        {"f_write", amx_f_write},
-        {"f_lseek", amx_f_lseek},
-        {"f_tell", amx_f_tell},
-        {"f_size", amx_f_size},
-        {"f_truncate", amx_f_truncate},
-        {"f_getfree", amx_f_getfree},
-        {"f_opendir", amx_f_opendir},
-        {"f_readdir", amx_f_readdir},
-        {"f_error", amx_f_error},
-        {"f_exists", amx_f_exists},
-        {"select_filename", amx_select_filename},
-        {0, 0}
-    };
-    
     // Clear the file table
     for (int i = 0; i < FILE_COUNT; i++)
     {
         files[i].valid = false;
     }
+    iobuf_owner = NULL;
+    iobuf_len = 0;
+    ini_index_owner = NULL;
     
-    return amx_Register(amx, funcs, -1);
+    return 0;
 }
 
 int amxcleanup_file(AMX *amx)
@@ -230,6 +860,7 @@ int amxcleanup_file(AMX *amx)
     {
         if (files[i].valid)
         {
+            release_iobuf(&files[i]);
             f_close(&files[i].f);
             files[i].valid = false;
         }
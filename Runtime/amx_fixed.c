@@ -58,22 +58,17 @@ static cell AMX_NATIVE_CALL amx_atan2(AMX *amx, const cell *params)
     return fix16_atan2(params[1], params[2]);
 }
 
-int amxinit_fixed(AMX *amx)
-{
-    static const AMX_NATIVE_INFO funcs[] = {
-        {"fadd", amx_fadd},
-        {"fsub", amx_fsub},
-        {"fmul", amx_fmul},
-        {"fdiv", amx_fdiv},
-        {"fixed", amx_fixed},
-        {"fround", amx_fround},
-        {"exp", amx_exp},
-        {"log", amx_log},
-        {"sqrt", amx_sqrt},
-        {"sin", amx_sin},
-        {"atan2", amx_atan2},
-        {0, 0}
-    };
-    
-    return amx_Register(amx, funcs, -1);
-}
+const AMX_NATIVE_INFO fixed_natives[] = {
+    {"fadd", amx_fadd},
+    {"fsub", amx_fsub},
+    {"fmul", amx_fmul},
+    {"fdiv", amx_fdiv},
+    {"fixed", amx_fixed},
+    {"fround", amx_fround},
+    {"exp", amx_exp},
+    {"log", amx_log},
+    {"sqrt", amx_sqrt},
+    {"sin", amx_sin},
+    {"atan2", amx_atan2},
+    {0, 0}
+};
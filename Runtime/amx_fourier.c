@@ -85,13 +85,8 @@ static cell AMX_NATIVE_CALL amx_fft(AMX *amx, const cell *params)
     return 0;
 }
 
-int amxinit_fourier(AMX *amx)
-{
-    static const AMX_NATIVE_INFO funcs[] = {
-        {"dft", amx_dft},
-        {"fft", amx_fft},
-        {0, 0}
-    };
-    
-    return amx_Register(amx, funcs, -1);
-}
\ No newline at end of file
+const AMX_NATIVE_INFO fourier_natives[] = {
+    {"dft", amx_dft},
+    {"fft", amx_fft},
+    {0, 0}
+};
\ No newline at end of file
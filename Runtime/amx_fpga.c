@@ -144,18 +144,18 @@ static cell AMX_NATIVE_CALL amx_fpga_write(AMX *amx, const cell *params)
     return 0;
 }
 
+const AMX_NATIVE_INFO fpga_natives[] = {
+    {"fpga_load", amx_fpga_load},
+    {"fpga_config_outputs", amx_fpga_config_outputs},
+    {"fpga_read_pins", amx_fpga_read_pins},
+    {"fpga_write_pins", amx_fpga_write_pins},
+    {"fpga_read", amx_fpga_read},
+    {"fpga_write", amx_fpga_write},
+    {0, 0}
+};
+
 int amxinit_fpga(AMX *amx)
 {
-    static const AMX_NATIVE_INFO funcs[] = {
-        {"fpga_load", amx_fpga_load},
-        {"fpga_config_outputs", amx_fpga_config_outputs},
-        {"fpga_read_pins", amx_fpga_read_pins},
-        {"fpga_write_pins", amx_fpga_write_pins},
-        {"fpga_read", amx_fpga_read},
-        {"fpga_write", amx_fpga_write},
-        {0, 0}
-    };
-    
     if (have_custom_image)
     {
         have_custom_image = false;
@@ -164,6 +164,6 @@ int amxinit_fpga(AMX *amx)
     
     set_port_directions(default_pins);
     
-    return amx_Register(amx, funcs, -1);
+    return 0;
 }
 
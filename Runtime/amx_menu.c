@@ -23,79 +23,83 @@ static cell AMX_NATIVE_CALL amx_draw_menubar(AMX *amx, const cell *params)
     return 0;
 }
 
-int amx_menu_doevents(AMX *amx)
+// Call the handler of a button, if the program has one and hasn't already
+// read the key press with get_keys().
+static int call_button(AMX *amx, int func, uint32_t key, uint32_t seq)
 {
-    if (!peek_keys(ANY_KEY))
+    cell retval;
+    
+    if (func == -1 || !get_event_keys(key, seq))
         return 0;
+    
+    return amx_Exec(amx, &retval, func);
+}
 
-    int status;
+// Call the handler of a scroller with the total movement of the event.
+static int call_scroll(AMX *amx, int func, uint32_t keys, int count,
+                       uint32_t seq, uint32_t press, uint32_t left,
+                       uint32_t right)
+{
+    int param;
     cell retval;
     
-    if (b1_func != -1 && get_keys(BUTTON1))
-    {
-        status = amx_Exec(amx, &retval, b1_func);
-        if (status != 0) return status;
-    }
-    
-    if (b2_func != -1 && get_keys(BUTTON2))
-    {
-        status = amx_Exec(amx, &retval, b2_func);
-        if (status != 0) return status;
-    }
+    if (func == -1)
+        return 0;
     
-    if (b3_func != -1 && get_keys(BUTTON3))
-    {
-        status = amx_Exec(amx, &retval, b3_func);
-        if (status != 0) return status;
-    }
+    if (get_event_keys(keys & press, seq))
+        param = 0;
+    else if (get_event_keys(keys & left, seq))
+        param = -scroller_speed() * count;
+    else if (get_event_keys(keys & right, seq))
+        param = scroller_speed() * count;
+    else
+        return 0;
     
-    if (b4_func != -1 && get_keys(BUTTON4))
-    {
-        status = amx_Exec(amx, &retval, b4_func);
-        if (status != 0) return status;
-    }
+    amx_Push(amx, param);
+    return amx_Exec(amx, &retval, func);
+}
+
+int amx_menu_doevents(AMX *amx)
+{
+    uint32_t keys, seq;
+    int count;
     
-    if (s1_func != -1 && peek_keys(SCROLL1_PRESS | SCROLL1_LEFT | SCROLL1_RIGHT))
+    while ((keys = get_key_event(&count, &seq)) != 0)
     {
-        int param = 0;
+        int status = call_button(amx, b1_func, keys & BUTTON1, seq);
         
-        if (get_keys(SCROLL1_PRESS))
-            param = 0;
-        else if (get_keys(SCROLL1_LEFT))
-            param = -scroller_speed();
-        else if (get_keys(SCROLL1_RIGHT))
-            param = scroller_speed();
+        if (status == 0)
+            status = call_button(amx, b2_func, keys & BUTTON2, seq);
         
-        amx_Push(amx, param);
-        status = amx_Exec(amx, &retval, s1_func);
-        if (status != 0) return status;
-    }
-    
-    if (s2_func != -1 && peek_keys(SCROLL2_PRESS | SCROLL2_LEFT | SCROLL2_RIGHT))
-    {
-        int param = 0;
+        if (status == 0)
+            status = call_button(amx, b3_func, keys & BUTTON3, seq);
+        
+        if (status == 0)
+            status = call_button(amx, b4_func, keys & BUTTON4, seq);
         
-        if (get_keys(SCROLL2_PRESS))
-            param = 0;
-        else if (get_keys(SCROLL2_LEFT))
-            param = -scroller_speed();
-        else if (get_keys(SCROLL2_RIGHT))
-            param = scroller_speed();
+        if (status == 0)
+            status = call_scroll(amx, s1_func, keys, count, seq,
+                                 SCROLL1_PRESS, SCROLL1_LEFT, SCROLL1_RIGHT);
         
-        amx_Push(amx, param);
-        status = amx_Exec(amx, &retval, s2_func);
-        if (status != 0) return status;
+        if (status == 0)
+            status = call_scroll(amx, s2_func, keys, count, seq,
+                                 SCROLL2_PRESS, SCROLL2_LEFT, SCROLL2_RIGHT);
+        
+        if (status != 0)
+            return status;
     }
     
     return 0;
 }
 
+const AMX_NATIVE_INFO menu_natives[] = {
+    {"draw_menubar", amx_draw_menubar},
+    {0, 0}
+};
+
 int amxinit_menu(AMX *amx)
 {
-    static const AMX_NATIVE_INFO funcs[] = {
-        {"draw_menubar", amx_draw_menubar},
-        {0, 0}
-    };
+    clear_key_events();
     
     if (amx_FindPublic(amx, "@button1", &b1_func) != 0)
         b1_func = -1;
@@ -115,5 +119,5 @@ int amxinit_menu(AMX *amx)
     if (amx_FindPublic(amx, "@scroll2", &s2_func) != 0)
         s2_func = -1;
     
-    return amx_Register(amx, funcs, -1);
+    return 0;
 }
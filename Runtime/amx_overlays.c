@@ -1,5 +1,7 @@
 /* Overlay support for AMX.
  * Includes caching for block pointers.
+ * Overlays that the compiler has grouped together are loaded as one block,
+ * with a single read.
  */
 
 #include "amx.h"
@@ -22,11 +24,155 @@ static const char *amx_filename;
 static FIL *amx_file;
 static AMX_OVERLAYINFO *overlay_tbl;
 static AMX_HEADER *amx_hdr;
+static int overlay_count;
+static AMX_OVLGROUP *group_tbl;
+static int group_count;
+
+#if defined(OVERLAY_PROFILE)
+#include <stdio.h>
+
+// Number of switches between each pair of overlays, written out for the
+// -P option of the compiler. Pairs that do not fit in the table are lost.
+typedef struct {
+    int16_t from;
+    int16_t to;
+    uint32_t count;
+} switch_t;
+
+#define PROFILESIZE 256
+static switch_t profile[PROFILESIZE];
+static int profile_prev;
+
+static void count_switch(AMX *amx, int index)
+{
+    // The callbacks from amx_Init() do not change amx->ovl_index
+    if (index == profile_prev || index != amx->ovl_index)
+        return;
+
+    if (profile_prev >= 0)
+    {
+        unsigned hash = profile_prev * 31 + index;
+        for (int i = 0; i < 8; i++)
+        {
+            switch_t *entry = &profile[(hash + i) & (PROFILESIZE - 1)];
+            if (entry->count == 0)
+            {
+                entry->from = profile_prev;
+                entry->to = index;
+            }
+
+            if (entry->from == profile_prev && entry->to == index)
+            {
+                entry->count++;
+                break;
+            }
+        }
+    }
+
+    profile_prev = index;
+}
+#endif
+
+// Find the group that holds the overlay, or -1 if it is not in a group.
+static int find_group(int index)
+{
+    int32_t offset = overlay_tbl[index].offset;
+    int low = 0, high = group_count - 1;
+    while (low <= high)
+    {
+        int mid = (low + high) / 2;
+        if (offset < group_tbl[mid].offset)
+            high = mid - 1;
+        else if (offset >= group_tbl[mid].offset + group_tbl[mid].size)
+            low = mid + 1;
+        else
+            return mid;
+    }
+    return -1;
+}
+
+// Read a block of code from the file
+static int read_code(AMX *amx, void *dest, int32_t offset, unsigned size)
+{
+    // Verify that the file has not changed
+    {
+        FILINFO newfile;
+        f_stat(amx_filename, &newfile);
+        if (newfile.fsize != amx_file->fsize)
+            return AMX_ERR_FILE_CHANGED;
+    }
+
+    AMX_HEADER *hdr = (AMX_HEADER*)amx->base;
+    unsigned count;
+    f_lseek(amx_file, hdr->cod + offset);
+    f_read(amx_file, dest, size, &count);
+    if (count != size)
+        return AMX_ERR_FORMAT;
+
+    return AMX_ERR_NONE;
+}
+
+// Load all overlays of a group with a single read. The pool block is keyed
+// by a number after the last overlay index. Returns AMX_ERR_MEMORY if the
+// group does not fit in the pool.
+static int load_group(AMX *amx, int group, unsigned char **block)
+{
+    const AMX_OVLGROUP *grp = &group_tbl[group];
+    int key = overlay_count + group;
+
+    *block = amx_poolfind(key);
+    if (*block != NULL)
+        return AMX_ERR_NONE;
+
+    if ((*block = amx_poolalloc(grp->size, key)) == NULL)
+        return AMX_ERR_MEMORY;
+
+    // poolalloc may have released some blocks.
+    memset(cache, 0, sizeof(cache));
+
+    int ret = read_code(amx, *block, grp->offset, grp->size);
+
+    // Verify and rewrite the code of every overlay in the group, once.
+    for (int i = 0; ret == AMX_ERR_NONE && i < overlay_count; i++)
+    {
+        int32_t rel = overlay_tbl[i].offset - grp->offset;
+        if (rel >= 0 && rel < grp->size)
+        {
+            amx->code = *block + rel;
+            amx->codesize = overlay_tbl[i].size;
+            ret = VerifyPcode(amx);
+        }
+    }
+
+    if (ret != AMX_ERR_NONE)
+        amx_poolfree(*block);
+
+    return ret;
+}
 
 // Inner (slow) part of overlay callback
 static int __attribute__((noinline))
 overlay_callback_full(AMX *amx, int index)
 {
+    // Overlays in a group are loaded together, unless the group does not
+    // fit in the pool.
+    int group = find_group(index);
+    if (group >= 0)
+    {
+        unsigned char *block;
+        int ret = load_group(amx, group, &block);
+        if (ret == AMX_ERR_NONE)
+        {
+            amx->code = block + (overlay_tbl[index].offset - group_tbl[group].offset);
+            amx->codesize = overlay_tbl[index].size;
+            return AMX_ERR_NONE;
+        }
+        else if (ret != AMX_ERR_MEMORY)
+        {
+            return ret;
+        }
+    }
+
     // Check the full overlay pool
     amx->codesize = overlay_tbl[index].size;
     amx->code = amx_poolfind(index);
@@ -41,26 +187,13 @@ overlay_callback_full(AMX *amx, int index)
         // have released some blocks.
         memset(cache, 0, sizeof(cache));
         
-        // Verify that the file has not changed
-        {
-            FILINFO newfile;
-            f_stat(amx_filename, &newfile);
-            if (newfile.fsize != amx_file->fsize)
-                return AMX_ERR_FILE_CHANGED;
-        }
-        
         // Read the block
-        {
-            AMX_HEADER *hdr = (AMX_HEADER*)amx->base;
-            unsigned count;
-            f_lseek(amx_file, hdr->cod + overlay_tbl[index].offset);
-            f_read(amx_file, amx->code, amx->codesize, &count);
-            if (count != amx->codesize)
-                return AMX_ERR_FORMAT;
-        }
+        int ret = read_code(amx, amx->code, overlay_tbl[index].offset, amx->codesize);
+        if (ret != AMX_ERR_NONE)
+            return ret;
             
         // Verify the loaded code and rewrite it.
-        int ret = VerifyPcode(amx);
+        ret = VerifyPcode(amx);
         if (ret != AMX_ERR_NONE)
             return ret;
     }
@@ -74,6 +207,10 @@ overlay_callback(AMX *amx, int index)
 {
     int cacheindex = index & (CACHESIZE - 1);
     cache_t *cacheentry = &cache[cacheindex];
+
+#if defined(OVERLAY_PROFILE)
+    count_switch(amx, index);
+#endif
     
     // First check our cache
     if (cacheentry->index == index
@@ -103,4 +240,55 @@ void overlay_init(AMX *amx, const char *filename, FIL *file)
     
     AMX_HEADER *hdr = (AMX_HEADER*)amx->base;
     overlay_tbl = (AMX_OVERLAYINFO*)(amx->base + hdr->overlays);
+    overlay_count = (hdr->nametable - hdr->overlays) / sizeof(AMX_OVERLAYINFO);
+
+    // The group table is optional, it ends with a trailer just before the code.
+    const AMX_OVLGROUPS *groups = (const AMX_OVLGROUPS*)(amx->base + hdr->cod - sizeof(AMX_OVLGROUPS));
+    group_count = 0;
+    if (hdr->cod - hdr->nametable >= sizeof(AMX_OVLGROUPS) &&
+        groups->magic == AMX_OVLGROUP_MAGIC && groups->count > 0 &&
+        groups->count * sizeof(AMX_OVLGROUP) <= hdr->cod - hdr->nametable - sizeof(AMX_OVLGROUPS))
+    {
+        group_count = groups->count;
+        group_tbl = (AMX_OVLGROUP*)groups - group_count;
+    }
+
+#if defined(OVERLAY_PROFILE)
+    memset(profile, 0, sizeof(profile));
+    profile_prev = -1;
+#endif
+}
+
+// Write the overlay switch counts to a file next to the program, with the
+// extension .OVP. Does nothing unless built with OVERLAY_PROFILE.
+void overlay_write_profile()
+{
+#if defined(OVERLAY_PROFILE)
+    char filename[13];
+    char line[40];
+    FIL file;
+    unsigned count;
+
+    strncpy(filename, amx_filename, 8);
+    filename[8] = '\0';
+    char *dot = strchr(filename, '.');
+    if (dot) *dot = '\0';
+    strcat(filename, ".OVP");
+
+    if (f_open(&file, filename, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+        return;
+
+    snprintf(line, sizeof(line), "overlays %d\n", overlay_count);
+    f_write(&file, line, strlen(line), &count);
+    for (int i = 0; i < PROFILESIZE; i++)
+    {
+        if (profile[i].count == 0)
+            continue;
+
+        snprintf(line, sizeof(line), "%d %d %lu\n", profile[i].from,
+                 profile[i].to, (unsigned long)profile[i].count);
+        f_write(&file, line, strlen(line), &count);
+    }
+    f_close(&file);
+#endif
 }
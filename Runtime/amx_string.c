@@ -72,14 +72,9 @@ static cell AMX_NATIVE_CALL amx_valstr(AMX *amx, const cell *params)
     return count;
 }
 
-int amxinit_string(AMX *amx)
-{
-    static const AMX_NATIVE_INFO funcs[] = {
-        {"strlen", amx_strlen},
-        {"strval", amx_strval},
-        {"valstr", amx_valstr},
-        {0, 0}
-    };
-    
-    return amx_Register(amx, funcs, -1);
-}
+const AMX_NATIVE_INFO string_natives[] = {
+    {"strlen", amx_strlen},
+    {"strval", amx_strval},
+    {"valstr", amx_valstr},
+    {0, 0}
+};
@@ -1,5 +1,6 @@
 /* Time functions based on the 1ms tick. */
 
+#include <stdbool.h>
 #include "buttons.h"
 #include "amx.h"
 
@@ -14,43 +15,126 @@ static cell AMX_NATIVE_CALL amx_delay_ms(AMX *amx, const cell *params)
     return 0;
 }
 
-static uint32_t timer_period = 0;
-static uint32_t timer_last_tick;
+// Timers that call a public function periodically. The @timertick timer
+// set with set_timer() is one of them.
+#define TIMER_COUNT 4
+typedef struct {
+    int func; // -1 if not in use
+    uint32_t period;
+    uint32_t due;
+} amx_timer_t;
+
+static amx_timer_t timers[TIMER_COUNT];
 static int timer_func = -1;
 
+static bool start_timer(int func, uint32_t period)
+{
+    amx_timer_t *timer = NULL;
+    
+    for (int i = 0; i < TIMER_COUNT; i++)
+    {
+        if (timers[i].func == func)
+            timer = &timers[i];
+    }
+    
+    if (period == 0)
+    {
+        if (timer) timer->func = -1;
+        return true;
+    }
+    
+    for (int i = 0; i < TIMER_COUNT && !timer; i++)
+    {
+        if (timers[i].func == -1)
+            timer = &timers[i];
+    }
+    
+    if (!timer)
+        return false;
+    
+    timer->func = func;
+    timer->period = period;
+    timer->due = get_time() + period;
+    return true;
+}
+
 static cell AMX_NATIVE_CALL amx_set_timer(AMX *amx, const cell *params)
 {
-    timer_period = params[1];
-    timer_last_tick = get_time();
+    if (timer_func != -1)
+        start_timer(timer_func, params[1]);
     return 0;
 }
 
+static cell AMX_NATIVE_CALL amx_set_timer_func(AMX *amx, const cell *params)
+{
+    char *name;
+    int func;
+    amx_StrParam(amx, params[1], name);
+    
+    if (amx_FindPublic(amx, name, &func) != 0)
+        return false;
+    
+    return start_timer(func, params[2]);
+}
+
+// Returns the timer that has been due for the longest, or NULL.
+static amx_timer_t *due_timer(uint32_t now)
+{
+    amx_timer_t *result = NULL;
+    
+    for (int i = 0; i < TIMER_COUNT; i++)
+    {
+        amx_timer_t *timer = &timers[i];
+        if (timer->func != -1 && (int32_t)(now - timer->due) >= 0 &&
+            (!result || (int32_t)(timer->due - result->due) < 0))
+            result = timer;
+    }
+    
+    return result;
+}
+
+bool amx_timer_pending()
+{
+    return due_timer(get_time()) != NULL;
+}
+
 int amx_timer_doevents(AMX *amx)
 {
-    int status;
-    cell retval;
+    uint32_t now = get_time();
+    amx_timer_t *timer;
     
-    if (timer_func != -1 && timer_period != 0 &&
-        get_time() - timer_last_tick >= timer_period)
+    while ((timer = due_timer(now)) != NULL)
     {
-        status = amx_Exec(amx, &retval, timer_func);
-        return status;
+        // Keep the timer in phase, unless the program has fallen behind
+        // by a whole period.
+        timer->due += timer->period;
+        if ((int32_t)(now - timer->due) >= 0)
+            timer->due = now + timer->period;
+        
+        cell retval;
+        int status = amx_Exec(amx, &retval, timer->func);
+        if (status != 0)
+            return status;
     }
     
     return 0;
 }
 
+const AMX_NATIVE_INFO time_natives[] = {
+    {"get_time", amx_get_time},
+    {"delay_ms", amx_delay_ms},
+    {"set_timer", amx_set_timer},
+    {"set_timer_func", amx_set_timer_func},
+    {0, 0}
+};
+
 int amxinit_time(AMX *amx)
 {
-    static const AMX_NATIVE_INFO funcs[] = {
-        {"get_time", amx_get_time},
-        {"delay_ms", amx_delay_ms},
-        {"set_timer", amx_set_timer},
-        {0, 0}
-    };
+    for (int i = 0; i < TIMER_COUNT; i++)
+        timers[i].func = -1;
     
     if (amx_FindPublic(amx, "@timertick", &timer_func) != 0)
         timer_func = -1;
     
-    return amx_Register(amx, funcs, -1);
+    return 0;
 }
\ No newline at end of file
@@ -268,23 +268,18 @@ static cell AMX_NATIVE_CALL amx_wavein_read(AMX *amx, const cell *params)
     return 0;
 }
 
-int amxinit_wavein(AMX *amx)
-{
-    static const AMX_NATIVE_INFO funcs[] = {
-        {"config_chA", amx_config_chA},
-        {"config_chB", amx_config_chB},
-        {"getconfig_chA", amx_getconfig_chA},
-        {"getconfig_chB", amx_getconfig_chB},
-        {"wavein_samplerate", amx_wavein_samplerate},
-        {"wavein_settrigger", amx_wavein_settrigger},
-        {"wavein_start", amx_wavein_start},
-        {"wavein_istriggered", amx_wavein_istriggered},
-        {"wavein_read", amx_wavein_read},
-        {0, 0}
-    };
-    
-    return amx_Register(amx, funcs, -1);
-}
+const AMX_NATIVE_INFO wavein_natives[] = {
+    {"config_chA", amx_config_chA},
+    {"config_chB", amx_config_chB},
+    {"getconfig_chA", amx_getconfig_chA},
+    {"getconfig_chB", amx_getconfig_chB},
+    {"wavein_samplerate", amx_wavein_samplerate},
+    {"wavein_settrigger", amx_wavein_settrigger},
+    {"wavein_start", amx_wavein_start},
+    {"wavein_istriggered", amx_wavein_istriggered},
+    {"wavein_read", amx_wavein_read},
+    {0, 0}
+};
 
 int amxcleanup_wavein(AMX *amx)
 {
@@ -49,14 +49,8 @@ static cell AMX_NATIVE_CALL amx_waveout_digital(AMX *amx, const cell *params)
     return div_round(CPUFREQ / (prescale + 1), arr + 1);
 }
 
-int amxinit_waveout(AMX *amx)
-{
-    static const AMX_NATIVE_INFO funcs[] = {
-        {"waveout_analog", amx_waveout_analog},
-        {"waveout_digital", amx_waveout_digital},
-        {0, 0}
-    };
-    
-    return amx_Register(amx, funcs, -1);
-    
-}
\ No newline at end of file
+const AMX_NATIVE_INFO waveout_natives[] = {
+    {"waveout_analog", amx_waveout_analog},
+    {"waveout_digital", amx_waveout_digital},
+    {0, 0}
+};
\ No newline at end of file
@@ -22,6 +22,26 @@ static volatile uint32_t KEYS_LAST_CHANGED = 0;
 
 static volatile int BEEP_TIME = 0;
 
+// Sequence number of the last key press. For each key, the sequence number
+// of its last press and of the last press that has been read, either with
+// get_keys() or by taking a queued event. A queued event is still unread
+// for a key when its sequence number is newer than the read one.
+static volatile uint32_t PRESS_SEQ = 0;
+static volatile uint32_t KEY_PRESS_SEQ[16];
+static volatile uint32_t KEY_READ_SEQ[16];
+
+// Queue of key presses for the event callbacks. Scroller repeats that
+// have not been handled yet are merged into one event with a count.
+#define KEY_QUEUE_SIZE 16
+typedef struct {
+    uint16_t keys;
+    uint16_t count;
+    uint32_t seq;
+} key_event_t;
+static volatile key_event_t KEY_QUEUE[KEY_QUEUE_SIZE];
+static volatile uint8_t KEY_QUEUE_HEAD = 0; // Written by interrupt
+static volatile uint8_t KEY_QUEUE_TAIL = 0; // Written by get_key_event()
+
 // Debounce time for keys, in milliseconds
 #define DEBOUNCE 10
 
@@ -30,6 +50,30 @@ static volatile int BEEP_TIME = 0;
 #define REPEAT_PERIOD 100
 #define REPEAT_KEYS (SCROLL1_LEFT | SCROLL1_RIGHT | SCROLL2_LEFT | SCROLL2_RIGHT)
 
+static void queue_key_event(uint32_t keys, uint32_t seq)
+{
+    uint8_t head = KEY_QUEUE_HEAD;
+    
+    if (head != KEY_QUEUE_TAIL)
+    {
+        volatile key_event_t *last = &KEY_QUEUE[(uint8_t)(head - 1) % KEY_QUEUE_SIZE];
+        if (last->keys == keys && !(keys & ~REPEAT_KEYS))
+        {
+            last->count++;
+            last->seq = seq;
+            return;
+        }
+    }
+    
+    if ((uint8_t)(head - KEY_QUEUE_TAIL) >= KEY_QUEUE_SIZE)
+        return; // Full, the press is still recorded in KEYS_PRESSED
+    
+    KEY_QUEUE[head % KEY_QUEUE_SIZE].keys = keys;
+    KEY_QUEUE[head % KEY_QUEUE_SIZE].count = 1;
+    KEY_QUEUE[head % KEY_QUEUE_SIZE].seq = seq;
+    KEY_QUEUE_HEAD = head + 1;
+}
+
 void __irq__ TIM3_IRQHandler(void)
 { 
     TIM3->SR = 0; // Clear interrupt flag
@@ -37,10 +81,11 @@ void __irq__ TIM3_IRQHandler(void)
     TICKCOUNT++;
     
     uint32_t keys = (~__Get(KEY_STATUS)) & ALL_KEYS;
+    uint32_t pressed = 0;
     
     // Only record keypresses the first time the key goes down
     if (keys && TICKCOUNT - KEYS_LAST_DOWN > DEBOUNCE)
-        KEYS_PRESSED |= keys;
+        pressed |= keys;
     
     if (keys) KEYS_LAST_DOWN = TICKCOUNT;
     
@@ -54,7 +99,17 @@ void __irq__ TIM3_IRQHandler(void)
     if (time_down > REPEAT_DELAY && (keys & REPEAT_KEYS))
     {
         if ((time_down - REPEAT_DELAY) % REPEAT_PERIOD == 0)
-            KEYS_PRESSED |= (keys & REPEAT_KEYS);
+            pressed |= (keys & REPEAT_KEYS);
+    }
+    
+    if (pressed)
+    {
+        uint32_t seq = ++PRESS_SEQ;
+        for (uint32_t bits = pressed; bits; bits &= bits - 1)
+            KEY_PRESS_SEQ[__builtin_ctz(bits)] = seq;
+        
+        KEYS_PRESSED |= pressed;
+        queue_key_event(pressed, seq);
     }
     
     if (BEEP_TIME > 0)
@@ -77,9 +132,76 @@ uint32_t peek_keys(uint32_t mask)
 }
 
 // Check if some keys have been pressed, and clear the status for them.
+// This also marks all their queued presses as read.
 uint32_t get_keys(uint32_t mask)
 {
-    return __sync_fetch_and_and(&KEYS_PRESSED, ~mask) & mask;
+    __disable_irq();
+    uint32_t keys = KEYS_PRESSED & mask;
+    KEYS_PRESSED &= ~mask;
+    for (uint32_t bits = keys; bits; bits &= bits - 1)
+    {
+        int key = __builtin_ctz(bits);
+        KEY_READ_SEQ[key] = KEY_PRESS_SEQ[key];
+    }
+    __enable_irq();
+    
+    return keys;
+}
+
+// Get the next key press from the event queue.
+uint32_t get_key_event(int *count, uint32_t *seq)
+{
+    uint32_t keys = 0;
+    
+    // The interrupt may be adding to the count of the last event
+    __disable_irq();
+    uint8_t tail = KEY_QUEUE_TAIL;
+    if (tail != KEY_QUEUE_HEAD)
+    {
+        keys = KEY_QUEUE[tail % KEY_QUEUE_SIZE].keys;
+        *count = KEY_QUEUE[tail % KEY_QUEUE_SIZE].count;
+        *seq = KEY_QUEUE[tail % KEY_QUEUE_SIZE].seq;
+        KEY_QUEUE_TAIL = tail + 1;
+    }
+    __enable_irq();
+    
+    return keys;
+}
+
+// Take the keys of a queued event that have not been read yet.
+uint32_t get_event_keys(uint32_t keys, uint32_t seq)
+{
+    uint32_t unread = 0;
+    
+    __disable_irq();
+    for (uint32_t bits = keys; bits; bits &= bits - 1)
+    {
+        int key = __builtin_ctz(bits);
+        if ((int32_t)(seq - KEY_READ_SEQ[key]) > 0)
+        {
+            unread |= 1 << key;
+            KEY_READ_SEQ[key] = seq;
+            
+            // Leave the key pressed if it has been pressed again since
+            if (KEY_PRESS_SEQ[key] == seq)
+                KEYS_PRESSED &= ~(1 << key);
+        }
+    }
+    __enable_irq();
+    
+    return unread;
+}
+
+// Check if there are events in the queue.
+bool key_events_pending()
+{
+    return KEY_QUEUE_TAIL != KEY_QUEUE_HEAD;
+}
+
+// Discard all events in the queue.
+void clear_key_events()
+{
+    KEY_QUEUE_TAIL = KEY_QUEUE_HEAD;
 }
 
 // Check if some keys are being held down
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "irq.h"
 
 /* Functions for accessing the button status and timer ticks, which are
@@ -17,6 +18,23 @@ uint32_t peek_keys(uint32_t mask);
 // Check if some keys have been pressed, and clear the status for them.
 uint32_t get_keys(uint32_t mask);
 
+// Get the next key press from the event queue, in the order they happened.
+// Returns the keys or 0 if the queue is empty. Repeated scroller events
+// that were not read in time are merged, count tells how many there were.
+// The keys still have to be taken with get_event_keys().
+uint32_t get_key_event(int *count, uint32_t *seq);
+
+// Take the keys of a queued event that have not been read yet, with
+// get_keys() or by an earlier call, and mark them as read. Clears their
+// status if there has been no newer press of them.
+uint32_t get_event_keys(uint32_t keys, uint32_t seq);
+
+// Check if there are events in the queue.
+bool key_events_pending();
+
+// Discard all events in the queue.
+void clear_key_events();
+
 // Check if some keys are being held down
 // Returns the keys that are still down and the number of milliseconds they've
 // been down.
@@ -0,0 +1,191 @@
+/* Cache of program metadata for the file selector, see catalog.h.
+ * The file has a small header followed by fixed size entries in the same
+ * order as the .AMX files in the root directory, so that any page of the
+ * selector can be read with a single seek.
+ */
+
+#include "catalog.h"
+#include "metadata.h"
+#include "ff.h"
+#include <string.h>
+
+#define CATALOG_FILE "PAWNCAT.BIN"
+#define CATALOG_TMP "PAWNCAT.TMP"
+#define CATALOG_MAGIC 0x31544350 // "PCT1"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t count;
+} catalog_header_t;
+
+bool is_a_script(const char *filename)
+{
+    while (*filename && *filename != '.') filename++;
+    
+    return filename[0] == '.' && (filename[1] | 0x20) == 'a' &&
+           (filename[2] | 0x20) == 'm' && (filename[3] | 0x20) == 'x';
+}
+
+// Returns the number of entries, or 0 if the file is not a valid catalog.
+static int read_header(FIL *file)
+{
+    catalog_header_t hdr;
+    unsigned bytes;
+    
+    f_lseek(file, 0);
+    if (f_read(file, &hdr, sizeof(hdr), &bytes) != FR_OK ||
+        bytes != sizeof(hdr) || hdr.magic != CATALOG_MAGIC)
+        return 0;
+    
+    if (f_size(file) < sizeof(hdr) + hdr.count * sizeof(catalog_entry_t))
+        return 0;
+    
+    return hdr.count;
+}
+
+bool catalog_open(FIL *file)
+{
+    return f_open(file, CATALOG_FILE, FA_READ) == FR_OK;
+}
+
+bool catalog_read(FIL *file, int index, catalog_entry_t *entry)
+{
+    unsigned bytes;
+    f_lseek(file, sizeof(catalog_header_t) + index * sizeof(catalog_entry_t));
+    return f_read(file, entry, sizeof(*entry), &bytes) == FR_OK &&
+           bytes == sizeof(*entry);
+}
+
+static bool entry_matches(const catalog_entry_t *entry, const FILINFO *info)
+{
+    return strcmp(entry->fname, info->fname) == 0 &&
+           entry->fsize == info->fsize &&
+           entry->fdate == info->fdate &&
+           entry->ftime == info->ftime;
+}
+
+// Check if the catalog lists exactly the scripts in the directory, in the
+// same order.
+static bool is_current(FIL *file, int count)
+{
+    DIR dir;
+    FILINFO info;
+    catalog_entry_t entry;
+    int i = 0;
+    
+    if (f_opendir(&dir, "/") != FR_OK)
+        return false;
+    
+    while (f_readdir(&dir, &info) == FR_OK && info.fname[0] != 0)
+    {
+        if (!is_a_script(info.fname))
+            continue;
+        
+        if (i >= count || !catalog_read(file, i, &entry) ||
+            !entry_matches(&entry, &info))
+            return false;
+        
+        i++;
+    }
+    
+    return i == count;
+}
+
+// Look for an up to date entry in the old catalog. Files usually stay in
+// the same order, so try the same position first.
+static bool find_entry(FIL *file, int count, int hint,
+                       const FILINFO *info, catalog_entry_t *entry)
+{
+    if (hint < count && catalog_read(file, hint, entry) &&
+        entry_matches(entry, info))
+        return true;
+    
+    for (int i = 0; i < count; i++)
+    {
+        if (i != hint && catalog_read(file, i, entry) &&
+            entry_matches(entry, info))
+            return true;
+    }
+    
+    return false;
+}
+
+static void parse_entry(const FILINFO *info, catalog_entry_t *entry)
+{
+    memset(entry, 0, sizeof(*entry));
+    memcpy(entry->fname, info->fname, sizeof(entry->fname));
+    entry->fsize = info->fsize;
+    entry->fdate = info->fdate;
+    entry->ftime = info->ftime;
+    
+    int icon_size = 0;
+    get_program_metadata(info->fname, entry->icon, &icon_size,
+                         entry->name, sizeof(entry->name));
+    entry->icon_size = icon_size;
+}
+
+int catalog_update()
+{
+    FIL old, new;
+    int old_count = 0;
+    bool have_old = catalog_open(&old);
+    
+    if (have_old)
+    {
+        old_count = read_header(&old);
+        if (is_current(&old, old_count))
+        {
+            f_close(&old);
+            return old_count;
+        }
+    }
+    
+    // Write the new catalog into a temporary file, so that an interrupted
+    // update does not leave a broken catalog behind.
+    if (f_open(&new, CATALOG_TMP, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+    {
+        if (have_old) f_close(&old);
+        return -1;
+    }
+    
+    catalog_header_t hdr = {CATALOG_MAGIC, 0};
+    unsigned bytes;
+    bool ok = (f_write(&new, &hdr, sizeof(hdr), &bytes) == FR_OK);
+    
+    DIR dir;
+    FILINFO info;
+    catalog_entry_t entry;
+    ok = ok && (f_opendir(&dir, "/") == FR_OK);
+    while (ok && f_readdir(&dir, &info) == FR_OK && info.fname[0] != 0)
+    {
+        if (!is_a_script(info.fname))
+            continue;
+        
+        if (!have_old || !find_entry(&old, old_count, hdr.count, &info, &entry))
+            parse_entry(&info, &entry);
+        
+        ok = (f_write(&new, &entry, sizeof(entry), &bytes) == FR_OK &&
+              bytes == sizeof(entry));
+        hdr.count++;
+    }
+    
+    if (have_old) f_close(&old);
+    
+    ok = ok && (f_lseek(&new, 0) == FR_OK);
+    ok = ok && (f_write(&new, &hdr, sizeof(hdr), &bytes) == FR_OK);
+    ok = (f_close(&new) == FR_OK) && ok;
+    
+    if (!ok)
+    {
+        f_unlink(CATALOG_TMP);
+        return -1;
+    }
+    
+    f_unlink(CATALOG_FILE);
+    if (f_rename(CATALOG_TMP, CATALOG_FILE) != FR_OK)
+        return -1;
+    
+    // Keep the file out of the way on the USB drive
+    f_chmod(CATALOG_FILE, AM_HID, AM_HID);
+    return hdr.count;
+}
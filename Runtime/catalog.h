@@ -0,0 +1,33 @@
+/* Cache of the program names and icons shown by the file selector.
+ * Stored in PAWNCAT.BIN, so that the selector does not have to parse every
+ * .AMX file each time it is opened.
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "ff.h"
+
+typedef struct {
+    char fname[13];
+    uint8_t icon_size; // 0 if the program has no icon
+    char name[20];     // Empty if the program has no name
+    uint32_t fsize;
+    uint16_t fdate;
+    uint16_t ftime;
+    uint32_t icon[32];
+} catalog_entry_t;
+
+// Bring the catalog up to date with the .AMX files in the root directory.
+// Only files that have been added or changed since last time are parsed.
+// Returns the number of programs, or -1 if the catalog can't be written.
+int catalog_update();
+
+// Open the catalog for reading with catalog_read(). Close with f_close().
+bool catalog_open(FIL *file);
+
+// Read the entry for the program at given position in directory order.
+bool catalog_read(FIL *file, int index, catalog_entry_t *entry);
+
+// Check if the filename has the .AMX extension.
+bool is_a_script(const char *filename);
@@ -195,46 +195,109 @@ int blend(int fg, int bg, int alpha)
         return bg; // 0% blend
 }
 
-// Draws antialiased lines
-// Xiaolin Wu's algorithm, using x/256 fixed point values
-void drawline_aa(fix16_t fx1, fix16_t fy1, fix16_t fx2, fix16_t fy2, int color)
+// Pixels of antialiased lines are collected into a batch, which is then
+// sorted by column. Each column is read from the screen with one DMA
+// transfer, blended in RAM and written back, instead of accessing the LCD
+// separately for every pixel.
+#define AA_BATCH 64
+#define AA_SPAN 64
+
+typedef struct {
+    int color;
+    int count;
+    uint32_t pixels[AA_BATCH];
+} aa_batch_t;
+
+// Pixels are packed so that sorting the words orders them by column,
+// then by row and finally by drawing order.
+#define AA_PACK(x, y, seq, alpha) (((uint32_t)(x) << 23) | ((y) << 15) | ((seq) << 8) | (alpha))
+#define AA_X(p) ((p) >> 23)
+#define AA_Y(p) (((p) >> 15) & 0xFF)
+#define AA_ALPHA(p) ((p) & 0xFF)
+
+static void aa_flush(aa_batch_t *batch)
 {
-    bool reverse_xy = false;
+    uint32_t *p = batch->pixels;
     
-    void swap(int *x, int *y) {
-        int temp = *x;
-        *x = *y;
-        *y = temp;
+    // Lines are usually drawn in column order, so insertion sort is fast.
+    for (int i = 1; i < batch->count; i++)
+    {
+        uint32_t tmp = p[i];
+        int j;
+        for (j = i; j > 0 && p[j - 1] > tmp; j--)
+            p[j] = p[j - 1];
+        p[j] = tmp;
     }
     
-    // plot the pixel at (x, y) with brightness c
-    void plot(int x, int y, int c) {
-        if (reverse_xy)
-            swap(&x, &y);
+    int i = 0;
+    while (i < batch->count)
+    {
+        int x = AA_X(p[i]);
+        int y0 = AA_Y(p[i]);
+        
+        int end = i;
+        while (end < batch->count && AA_X(p[end]) == x && AA_Y(p[end]) < y0 + AA_SPAN)
+            end++;
+        
+        uint16_t span[AA_SPAN];
+        int height = AA_Y(p[end - 1]) - y0 + 1;
+        lcd_read_column(x, y0, span, height, false);
         
-        __Point_SCR(x >> 8, y >> 8);
-        u16 oldcolor = __LCD_GetPixl();
-        __LCD_SetPixl(blend(color, oldcolor, c));
+        for (int j = i; j < end; j++)
+        {
+            uint16_t *pixel = &span[AA_Y(p[j]) - y0];
+            *pixel = blend(batch->color, *pixel, AA_ALPHA(p[j]));
+        }
+        
+        __Point_SCR(x, y0);
+        __LCD_Copy(span, height);
+        __LCD_DMA_Ready();
+        
+        i = end;
     }
     
-    // Integer part of x
-    int ipart(int x) {
-        return x & (~0xFF);
-    }
+    batch->count = 0;
+}
+
+// Plot the pixel at (x, y) with brightness alpha 0 to 256.
+static void aa_plot(aa_batch_t *batch, int x, int y, int alpha)
+{
+    if (x < 0 || x >= LCD_WIDTH || y < 0 || y >= LCD_HEIGHT || alpha <= 0)
+        return;
     
-    int round(int x) {
-        return ipart(x + 128);
-    }
+    if (alpha > 255)
+        alpha = 255;
     
-    // Fractional part of x
-    int fpart(int x) {
-        return x & 0xFF;
-    }
+    if (batch->count == AA_BATCH)
+        aa_flush(batch);
     
-    // Remaining fractional part of x
-    int rfpart(int x) {
-        return 256 - fpart(x);
-    }
+    batch->pixels[batch->count] = AA_PACK(x, y, batch->count, alpha);
+    batch->count++;
+}
+
+static void swap(int *x, int *y)
+{
+    int temp = *x;
+    *x = *y;
+    *y = temp;
+}
+
+// Helpers for x/256 fixed point values
+#define IPART(x) ((x) & (~0xFF))
+#define ROUND(x) IPART((x) + 128)
+#define FPART(x) ((x) & 0xFF)
+#define RFPART(x) (256 - FPART(x))
+
+// Xiaolin Wu's algorithm, using x/256 fixed point values
+static void aa_line(aa_batch_t *batch, fix16_t fx1, fix16_t fy1, fix16_t fx2, fix16_t fy2)
+{
+    bool reverse_xy = false;
+    
+    // plot the pixel at (x, y) with brightness c
+    #define PLOT(x, y, c) do { \
+        if (reverse_xy) aa_plot(batch, (y) >> 8, (x) >> 8, (c)); \
+        else aa_plot(batch, (x) >> 8, (y) >> 8, (c)); \
+    } while (0)
     
     int x1 = fx1 >> 8;
     int x2 = fx2 >> 8;
@@ -251,6 +314,9 @@ void drawline_aa(fix16_t fx1, fix16_t fy1, fix16_t fx2, fix16_t fy2, int color)
         reverse_xy = true;
     }
     
+    if (dx == 0)
+        return; // Zero-length line
+    
     if (x2 < x1)
     {
         swap(&x1, &x2);
@@ -260,31 +326,52 @@ void drawline_aa(fix16_t fx1, fix16_t fy1, fix16_t fx2, fix16_t fy2, int color)
     int gradient = dy * 256 / dx;
     
     // handle first endpoint
-    int xend = round(x1);
+    int xend = ROUND(x1);
     int yend = y1 + gradient * (xend - x1) / 256;
-    int xgap = rfpart(x1 + 128);
+    int xgap = RFPART(x1 + 128);
     int xpxl1 = xend;  // this will be used in the main loop
-    int ypxl1 = ipart(yend);
-    plot(xpxl1, ypxl1, rfpart(yend) * xgap / 256);
-    plot(xpxl1, ypxl1 + 256, fpart(yend) * xgap / 256);
+    int ypxl1 = IPART(yend);
+    PLOT(xpxl1, ypxl1, RFPART(yend) * xgap / 256);
+    PLOT(xpxl1, ypxl1 + 256, FPART(yend) * xgap / 256);
     int intery = yend + gradient; // first y-intersection for the main loop
     
     // handle second endpoint
-    xend = round(x2);
+    xend = ROUND(x2);
     yend = y2 + gradient * (xend - x2) / 256;
-    xgap = fpart(x2 + 128);
+    xgap = FPART(x2 + 128);
     int xpxl2 = xend;  // this will be used in the main loop
-    int ypxl2 = ipart(yend);
-    plot(xpxl2, ypxl2, rfpart(yend) * xgap / 256);
-    plot(xpxl2, ypxl2 + 256, fpart(yend) * xgap / 256);
+    int ypxl2 = IPART(yend);
+    PLOT(xpxl2, ypxl2, RFPART(yend) * xgap / 256);
+    PLOT(xpxl2, ypxl2 + 256, FPART(yend) * xgap / 256);
     
     // main loop
     for (int x = xpxl1 + 1; x <= xpxl2 - 1; x += 256)
     {
-        plot(x, ipart(intery), rfpart(intery));
-        plot(x, ipart(intery) + 256, fpart(intery));
+        PLOT(x, IPART(intery), RFPART(intery));
+        PLOT(x, IPART(intery) + 256, FPART(intery));
         intery = intery + gradient;
     }
+    
+    #undef PLOT
+}
+
+// Draws antialiased lines
+void drawline_aa(fix16_t fx1, fix16_t fy1, fix16_t fx2, fix16_t fy2, int color)
+{
+    aa_batch_t batch = {color, 0};
+    aa_line(&batch, fx1, fy1, fx2, fy2);
+    aa_flush(&batch);
+}
+
+// Draws a connected series of antialiased lines
+void drawpolyline_aa(const fix16_t *xpoints, const fix16_t *ypoints, int count, int color)
+{
+    aa_batch_t batch = {color, 0};
+    for (int i = 1; i < count; i++)
+    {
+        aa_line(&batch, xpoints[i - 1], ypoints[i - 1], xpoints[i], ypoints[i]);
+    }
+    aa_flush(&batch);
 }
 
 /* Non-antialiased line drawing */
@@ -346,11 +433,86 @@ void draw_rectangle(int x, int y, int w, int h, int color, int dots)
     drawline(x    , y + h, x,     y,     color, dots);
 }
 
+/* Reading pixels back from the screen */
+
+// Reading the LCD type takes several bus transactions, so remember it.
+static uint32_t lcd_type()
+{
+    static uint32_t type = 0;
+    if (type == 0)
+        type = LCD_RD_Type();
+    return type;
+}
+
+void lcd_read_column(int x, int y, void *pixels, int count, bool wide)
+{
+    // Seems like DSO Quad may use two different kinds of LCD's, with
+    // slightly different command sets..
+    if (lcd_type() == LCD_TYPE_ILI9327)
+    {
+        __Point_SCR(x, y);
+        LCD_WR_Ctrl(0x2E);
+        
+        // Dummy read
+        always_read(LCD_PORT);
+        
+        // Use DMA to do the transfer, memory size is either 32 or 16 bits.
+        uint32_t ccr = wide ? 0x5980 : 0x5580;
+        DMA2_Channel1->CCR = ccr;
+        DMA2_Channel1->CMAR = (uint32_t)pixels;
+        DMA2_Channel1->CNDTR = count;
+        DMA2_Channel1->CCR = ccr | 1;
+        
+        __LCD_DMA_Ready();
+    
+        LCD_WR_Ctrl(0x2C);
+    }
+    else
+    {
+        // I haven't been able to test this code path.
+        __LCD_DMA_Ready();
+        // The R61509V doesn't automatically increment the address
+        // when reading, which slows this down a bit...
+        LCD_WR_REG(0x0201, x);
+
+        for (int i = 0; i < count; i++)
+        {
+            LCD_WR_REG(0x0200, y++);
+            LCD_WR_Ctrl(0x0202);
+            always_read(LCD_PORT);
+            
+            if (wide)
+                ((uint32_t*)pixels)[i] = LCD_PORT;
+            else
+                ((uint16_t*)pixels)[i] = LCD_PORT;
+        }
+    }
+}
+
+void lcd_write_column(int x, int y, const void *pixels, int count, bool wide, bool wait)
+{
+    __Point_SCR(x, y);
+    
+    // Routine copied from SYS1.50 source and modified to do
+    // 32 -> 16 bit mapping on the fly when needed.
+    uint32_t ccr = wide ? 0x5990 : 0x5590;
+    DMA2_Channel1->CCR = ccr;
+    DMA2_Channel1->CMAR = (uint32_t)pixels;
+    DMA2_Channel1->CNDTR = count;
+    DMA2_Channel1->CCR = ccr | 1;
+    
+    if (wait)
+    {
+        __LCD_DMA_Ready();
+    }
+}
+
 /* Small bitmaps */
 
 // Draw a small monochrome bitmap image to screen
 // The bitmap is defined as a constant array, where each entry is a
-// 32 pixels wide row
+// 32 pixels wide row. Each vertical run of set pixels is drawn with a
+// single fill.
 void draw_bitmap(const uint32_t *bitmap, int x, int y, int color, int bitmap_size, bool center)
 {
     // Find out the width of the bitmap and align it properly
@@ -358,6 +520,9 @@ void draw_bitmap(const uint32_t *bitmap, int x, int y, int color, int bitmap_siz
     for (int i = 0; i < bitmap_size; i++)
         bits |= bitmap[i];
     
+    if (bits == 0)
+        return;
+    
     int width;
     
     if (center)
@@ -368,13 +533,61 @@ void draw_bitmap(const uint32_t *bitmap, int x, int y, int color, int bitmap_siz
     uint32_t mask = 1;
     for (int i = width - 1; i >= 0; i--, mask <<= 1)
     {
-        for (int j = 0; j < bitmap_size; j++)
+        int j = 0;
+        while (j < bitmap_size)
         {
-            if (bitmap[j] & mask)
+            if (!(bitmap[j] & mask))
             {
-                __Point_SCR(x + i, y + bitmap_size - j);
-                __LCD_SetPixl(color);
+                j++;
+                continue;
             }
+            
+            int start = j;
+            while (j < bitmap_size && (bitmap[j] & mask))
+                j++;
+            
+            // Rows are stored top first, the screen y axis points up.
+            __Point_SCR(x + i, y + bitmap_size - (j - 1));
+            __LCD_Fill((uint16_t*)&color, j - start);
         }
     }
-}
\ No newline at end of file
+    
+    __LCD_DMA_Ready();
+}
+
+// Draw a 16-color bitmap. Each row starts at a new entry and stores
+// 8 pixels per entry, most significant nibble first. Color index 0 is
+// transparent.
+void draw_bitmap16(const uint32_t *bitmap, int x, int y, int width, int height,
+                   const uint32_t *palette, bool center)
+{
+    int stride = (width + 7) / 8;
+    
+    if (center)
+        x -= width / 2;
+    
+    for (int i = 0; i < width; i++)
+    {
+        const uint32_t *p = bitmap + i / 8;
+        int shift = 28 - (i % 8) * 4;
+        
+        int j = 0;
+        while (j < height)
+        {
+            int index = (p[j * stride] >> shift) & 0x0F;
+            int start = j;
+            
+            do {
+                j++;
+            } while (j < height && ((p[j * stride] >> shift) & 0x0F) == index);
+            
+            if (index == 0)
+                continue;
+            
+            uint16_t color = palette[index];
+            __Point_SCR(x + i, y + height - j);
+            __LCD_Fill(&color, j - start);
+            __LCD_DMA_Ready();
+        }
+    }
+}
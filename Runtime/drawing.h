@@ -12,6 +12,10 @@
 #define RGB565_G(color) (int)((color & 0x07E0) >> 3)
 #define RGB565_B(color) (int)((color & 0xF800) >> 8)
 
+// Size of the screen in pixels
+#define LCD_WIDTH 400
+#define LCD_HEIGHT 240
+
 // You can pass -1 as bg to have transparent background.
 void draw_text(const char *text, int x, int y, int fg, int bg, bool center);
 
@@ -22,10 +26,24 @@ int blend(int fg, int bg, int alpha);
 
 void drawline_aa(fix16_t fx1, fix16_t fy1, fix16_t fx2, fix16_t fy2, int color);
 
+// Draw antialiased lines between count consecutive points.
+void drawpolyline_aa(const fix16_t *xpoints, const fix16_t *ypoints, int count, int color);
+
 void drawline(int x1, int y1, int x2, int y2, int color, int dots);
 
 void fill_rectangle(int x, int y, int w, int h, int color);
 
 void draw_rectangle(int x, int y, int w, int h, int color, int dots);
 
+// Read a vertical column of pixels from the screen, using DMA when possible.
+// If wide is true, each pixel is stored in a 32-bit word, otherwise 16 bits.
+void lcd_read_column(int x, int y, void *pixels, int count, bool wide);
+
+// Write a vertical column of pixels to the screen using DMA. If wait is
+// false, the transfer may still be running when the function returns.
+void lcd_write_column(int x, int y, const void *pixels, int count, bool wide, bool wait);
+
 void draw_bitmap(const uint32_t *bitmap, int x, int y, int color, int bitmap_size, bool center);
+
+void draw_bitmap16(const uint32_t *bitmap, int x, int y, int width, int height,
+                   const uint32_t *palette, bool center);
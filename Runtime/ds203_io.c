@@ -85,6 +85,149 @@ static int quantize(uint16_t color, const uint32_t *palette)
     return closest;
 }
 
+// Screens usually contain only a handful of distinct colors, so a small
+// direct-mapped cache avoids running the full search for every pixel.
+#define QCACHE_SIZE 64
+static uint16_t qcache_color[QCACHE_SIZE];
+static uint8_t qcache_index[QCACHE_SIZE];
+
+static int quantize_cached(uint16_t color, const uint32_t *palette)
+{
+    unsigned slot = ((color * 0x9E37u) >> 10) & (QCACHE_SIZE - 1);
+    if (qcache_index[slot] == 0xFF || qcache_color[slot] != color)
+    {
+        qcache_color[slot] = color;
+        qcache_index[slot] = quantize(color, palette);
+    }
+    return qcache_index[slot];
+}
+
+#define BMP_WIDTH 400
+#define BMP_HEIGHT 240
+
+// The LCD can only be read efficiently in vertical columns, while the
+// bitmap is stored in rows. Therefore the screen is read in bands of a few
+// rows, one DMA transfer per column, and stored as 4-bit palette indexes.
+#define BAND_ROWS 4
+static uint8_t band[BAND_ROWS][BMP_WIDTH / 2];
+
+static void read_band(int y, const uint32_t *palette)
+{
+    uint16_t column[BAND_ROWS];
+    for (int x = 0; x < BMP_WIDTH; x++)
+    {
+        lcd_read_column(x, y, column, BAND_ROWS, false);
+        
+        for (int i = 0; i < BAND_ROWS; i++)
+        {
+            int index = quantize_cached(column[i], palette);
+            if (x & 1)
+                band[i][x / 2] |= index;
+            else
+                band[i][x / 2] = index << 4;
+        }
+    }
+}
+
+#define PIXEL(row, x) (((x) & 1) ? ((row)[(x) / 2] & 0x0F) : ((row)[(x) / 2] >> 4))
+
+// Output buffer for the RLE encoder, written out whenever it fills up.
+typedef struct {
+    FIL *file;
+    bool ok;
+    unsigned count;
+    unsigned total;
+    uint8_t data[64];
+} rle_out_t;
+
+static void rle_flush(rle_out_t *out)
+{
+    unsigned bytes;
+    if (out->count == 0) return;
+    
+    f_write(out->file, out->data, out->count, &bytes);
+    if (bytes != out->count)
+        out->ok = false;
+    
+    out->total += out->count;
+    out->count = 0;
+}
+
+static void rle_put(rle_out_t *out, uint8_t a, uint8_t b)
+{
+    if (out->count + 2 > sizeof(out->data))
+        rle_flush(out);
+    
+    out->data[out->count++] = a;
+    out->data[out->count++] = b;
+}
+
+// Number of identical pixels starting at x, at most max.
+static int run_length(const uint8_t *row, int x, int max)
+{
+    int count = 1;
+    while (x + count < BMP_WIDTH && count < max &&
+           PIXEL(row, x + count) == PIXEL(row, x))
+    {
+        count++;
+    }
+    return count;
+}
+
+// Encode one row in BI_RLE4 format. Runs of 3 or more identical pixels are
+// stored in encoded mode, anything between them in absolute mode.
+static void rle4_encode_row(rle_out_t *out, const uint8_t *row)
+{
+    int x = 0;
+    while (x < BMP_WIDTH)
+    {
+        int run = run_length(row, x, 255);
+        if (run >= 3)
+        {
+            int c = PIXEL(row, x);
+            rle_put(out, run, (c << 4) | c);
+            x += run;
+            continue;
+        }
+        
+        // Gather pixels until the next run that is worth encoding.
+        int start = x;
+        while (x < BMP_WIDTH && x - start < 254)
+        {
+            run = run_length(row, x, 3);
+            if (run >= 3) break;
+            x += run;
+        }
+        if (x - start > 254) x = start + 254;
+        
+        int count = x - start;
+        if (count < 3)
+        {
+            // Absolute mode needs at least 3 pixels, but encoded mode can
+            // store two different colors.
+            int c1 = PIXEL(row, start);
+            int c2 = (count == 2) ? PIXEL(row, start + 1) : 0;
+            rle_put(out, count, (c1 << 4) | c2);
+        }
+        else
+        {
+            rle_put(out, 0, count);
+            
+            // Data must be padded to a 16-bit boundary.
+            for (int i = 0; i < count; i += 4)
+            {
+                uint8_t b[4] = {0};
+                for (int j = 0; j < 4 && i + j < count; j++)
+                    b[j / 2] |= PIXEL(row, start + i + j) << ((j & 1) ? 0 : 4);
+                
+                rle_put(out, b[0], b[1]);
+            }
+        }
+    }
+    
+    rle_put(out, 0, 0); // End of line
+}
+
 // We know the LCD size in advance, so the file header can be written out
 // by hand.
 // The main header is 14 bytes, bitmap info header is 40 bytes and the palette
@@ -107,48 +250,88 @@ const uint8_t BMP_HEADER[54] = {
     0x00, 0x00, 0x00, 0x00  // Important colors
 };
 
-bool write_bitmap(const char *filename, const uint32_t *palette)
+static void put_u32(uint8_t *p, uint32_t value)
 {
-    FIL file;
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+static bool write_header(FIL *file, const uint32_t *palette, bool compress, unsigned datasize)
+{
+    uint8_t header[sizeof(BMP_HEADER) + 64];
+    memcpy(header, BMP_HEADER, sizeof(BMP_HEADER));
     
-    if (f_open(&file, filename, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
-        return false;
+    if (compress)
+    {
+        put_u32(header + 2, sizeof(header) + datasize);
+        put_u32(header + 30, 2); // BI_RLE4
+        put_u32(header + 34, datasize);
+    }
+    
+    for (int i = 0; i < 16; i++)
+    {
+        uint8_t *entry = header + sizeof(BMP_HEADER) + i * 4;
+        entry[0] = RGB565_B(palette[i]);
+        entry[1] = RGB565_G(palette[i]);
+        entry[2] = RGB565_R(palette[i]);
+        entry[3] = 0;
+    }
     
-    // Write header
     unsigned bytes;
-    f_write(&file, BMP_HEADER, sizeof(BMP_HEADER), &bytes);
-    if (bytes != sizeof(BMP_HEADER))
+    f_write(file, header, sizeof(header), &bytes);
+    return bytes == sizeof(header);
+}
+
+bool write_bitmap(const char *filename, const uint32_t *palette, bool compress)
+{
+    FIL file;
+    
+    if (f_open(&file, filename, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
         return false;
     
-    // Write palette
-    for (int i = 0; i < 16; i++)
+    // Write header, the data size is updated later for compressed files.
+    if (!write_header(&file, palette, compress, 0))
     {
-        char entry[4] = {
-            RGB565_B(palette[i]),
-            RGB565_G(palette[i]),
-            RGB565_R(palette[i]),
-            0
-        };
-        f_write(&file, entry, sizeof(entry), &bytes);
+        f_close(&file);
+        return false;
     }
     
-    // Write bitmap data
-    for (int y = 0; y < 240; y++)
+    memset(qcache_index, 0xFF, sizeof(qcache_index));
+    
+    rle_out_t out = {&file, true, 0, 0};
+    
+    // Write bitmap data, a full row per f_write call
+    for (int y = 0; y < BMP_HEIGHT; y += BAND_ROWS)
     {
-        for (int x = 0; x < 400; x += 2)
+        read_band(y, palette);
+        
+        for (int i = 0; i < BAND_ROWS; i++)
         {
-            __Point_SCR(x, y);
-            int colorH = quantize(__LCD_GetPixl(), palette);
-            __Point_SCR(x + 1, y);
-            int colorL = quantize(__LCD_GetPixl(), palette);
-            
-            char byte = (colorH << 4) | colorL;
-            f_write(&file, &byte, 1, &bytes);
+            if (compress)
+            {
+                rle4_encode_row(&out, band[i]);
+            }
+            else
+            {
+                unsigned bytes;
+                f_write(&file, band[i], sizeof(band[i]), &bytes);
+                if (bytes != sizeof(band[i]))
+                    out.ok = false;
+            }
         }
     }
     
-    return f_close(&file) == FR_OK;
+    if (compress)
+    {
+        rle_put(&out, 0, 1); // End of bitmap
+        rle_flush(&out);
+        
+        f_lseek(&file, 0);
+        if (!write_header(&file, palette, compress, out.total))
+            out.ok = false;
+    }
+    
+    return (f_close(&file) == FR_OK) && out.ok;
 }
-
-
-
@@ -37,5 +37,6 @@ char *select_filename(const char *format);
 
 extern const uint32_t bmp_default_palette[16];
 
-// Write current LCD contents as a bitmap into file.
-bool write_bitmap(const char *filename, const uint32_t *palette);
+// Write current LCD contents as a 16-color bitmap into file.
+// If compress is true, the bitmap is stored in RLE4 format.
+bool write_bitmap(const char *filename, const uint32_t *palette, bool compress);
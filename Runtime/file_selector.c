@@ -11,6 +11,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include "msgbox.h"
+#include "catalog.h"
 #include "metadata.h"
 
 static const uint32_t default_icon[] = {
@@ -60,14 +61,8 @@ static void draw_item(int index, const uint32_t *icon, int icon_height,
     draw_flowtext(line1, x, y + 2, SLOT_W, 28, RGB(255,255,255), 0, true);
 }
 
-static bool is_a_script(const char *filename)
-{
-    while (*filename && *filename != '.') filename++;
-    
-    return filename[0] == '.' && (filename[1] | 0x20) == 'a' &&
-           (filename[2] | 0x20) == 'm' && (filename[3] | 0x20) == 'x';
-}
-
+// Find the first script of the given page. Used when the scripts are listed
+// straight from the directory, because the catalog could not be written.
 static bool seek_dir(int page, DIR *dir, FILINFO *file)
 {
     while (page--)
@@ -84,19 +79,17 @@ static bool seek_dir(int page, DIR *dir, FILINFO *file)
     return true;
 }
 
-static void render_screen(int page, int *maxindex)
+// Draw a page from the directory, parsing each script on it.
+static int render_dir(int page)
 {
     DIR dir;
     FILINFO file;
     
-    __Clear_Screen(0);
-    draw_menubar("Run", "Refresh", "", "About");
-    
     f_opendir(&dir, "/");
     if (!seek_dir(page, &dir, &file))
     {
         debugf("Directory seek failed");
-        return;
+        return 0;
     }
     
     int i;
@@ -131,10 +124,63 @@ static void render_screen(int page, int *maxindex)
         }
     }
     
+    // Allow scrolling to the next page
     if (f_readdir(&dir, &file) == 0 && file.fname[0] != 0)
         i++;
     
-    *maxindex = i;
+    return i;
+}
+
+// Draw a page from the catalog.
+static int render_catalog(int page, int count)
+{
+    FIL catalog;
+    catalog_entry_t entry;
+    int first = page * ICONS_ON_SCREEN;
+    int i = 0;
+    
+    if (count > first && catalog_open(&catalog))
+    {
+        for (i = 0; i < ICONS_ON_SCREEN && first + i < count; i++)
+        {
+            if (!catalog_read(&catalog, first + i, &entry))
+                break;
+            
+            const uint32_t *icon = entry.icon;
+            int icon_size = entry.icon_size;
+            if (icon_size == 0)
+            {
+                icon = default_icon;
+                icon_size = DEFAULT_ICON_HEIGHT;
+            }
+            
+            if (entry.name[0] == 0)
+                memcpy(entry.name, entry.fname, 13);
+            
+            draw_item(i, icon, icon_size, entry.name, "");
+        }
+        
+        f_close(&catalog);
+    }
+    
+    // Allow scrolling to the next page
+    if (first + i < count)
+        i++;
+    
+    return i;
+}
+
+// Count is the number of scripts in the catalog, or -1 if the catalog
+// could not be written (drive full or write protected).
+static void render_screen(int page, int count, int *maxindex)
+{
+    __Clear_Screen(0);
+    draw_menubar("Run", "Refresh", "", "About");
+    
+    if (count < 0)
+        *maxindex = render_dir(page);
+    else
+        *maxindex = render_catalog(page, count);
     
     if (*maxindex == 0)
     {
@@ -144,7 +190,7 @@ static void render_screen(int page, int *maxindex)
 
 #include <stdio.h>
 
-static bool get_name(char dest[13], int page, int index)
+static bool get_dir_name(char dest[13], int page, int index)
 {
     DIR dir;
     FILINFO file;
@@ -170,6 +216,28 @@ static bool get_name(char dest[13], int page, int index)
     return true;
 }
 
+static bool get_name(char dest[13], int page, int index, int count)
+{
+    FIL catalog;
+    catalog_entry_t entry;
+    
+    if (count < 0)
+        return get_dir_name(dest, page, index);
+    
+    if (!catalog_open(&catalog))
+        return false;
+    
+    bool ok = catalog_read(&catalog, page * ICONS_ON_SCREEN + index, &entry);
+    f_close(&catalog);
+    
+    if (!ok || !f_exists(entry.fname))
+        return false;
+    
+    printf("Selected %s\n", entry.fname);
+    memcpy(dest, entry.fname, 13);
+    return true;
+}
+
 static void show_cursor(int index, int color)
 {
     if (index < 0) return;
@@ -185,25 +253,27 @@ void select_file(char result[13])
     static int page = 0; // Remember selections while the program runs
     static int index = 0;
     int maxindex = 0;
+    int count = 0;
     
     bool rerender = true;
+    bool rescan = true;
     
     for(;;)
     {
         if (get_keys(BUTTON1) && index >= 0)
         {
             // File selected, get the name and return
-            if (get_name(result, page, index))
+            if (get_name(result, page, index, count))
                 return;
             else
-                rerender = true; // Couldn't find file, maybe fs has changed?
+                rescan = true; // Couldn't find file, maybe fs has changed?
         }
         
         if (get_keys(BUTTON2))
         {
             // Refresh
             //f_flush(&fatfs);
-            rerender = true;
+            rescan = true;
         }
         
         if (get_keys(BUTTON4))
@@ -235,7 +305,7 @@ void select_file(char result[13])
                 if (page > 0)
                 {
                     page--;
-                    render_screen(page, &maxindex);
+                    render_screen(page, count, &maxindex);
                     index += ICONS_ON_SCREEN;
                 }
                 else
@@ -262,9 +332,18 @@ void select_file(char result[13])
             show_cursor(index, RGB(128, 128, 255));
         }
         
+        if (rescan)
+        {
+            count = catalog_update();
+            if (count >= 0 && page * ICONS_ON_SCREEN >= count)
+                page = 0;
+            rerender = true;
+            rescan = false;
+        }
+        
         if (rerender)
         {
-            render_screen(page, &maxindex);
+            render_screen(page, count, &maxindex);
             show_cursor(index, RGB(128, 128, 255));
             rerender = false;
             
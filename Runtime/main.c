@@ -25,6 +25,10 @@
 #define FSMC_BTR1   (*((vu32 *)(0xA0000000+0x04)))
 #define FSMC_BTR2   (*((vu32 *)(0xA0000008+0x04)))
 
+// Cycle counter of the Cortex-M3, used for timing the program loading
+#define DWT_CTRL    (*((vu32 *)0xE0001000))
+#define DWT_CYCCNT  (*((vu32 *)0xE0001004))
+
 AMX amx;
 FIL amx_file;
 char amx_filename[20];
@@ -32,22 +36,19 @@ char amx_filename[20];
 // Data block allocated for the virtual machine
 uint8_t vm_data[32768] __attribute__((aligned(4)));
 
-int amxinit_display(AMX *amx);
-int amx_CoreInit(AMX *amx);
-int amxinit_string(AMX *amx);
-int amxinit_fixed(AMX *amx);
-int amxinit_wavein(AMX *amx);
+// The hash index of public functions is kept at the end of vm_data
+#define PUBLIC_INDEX_SIZE 128
+#define PUBLIC_INDEX (vm_data + sizeof(vm_data) - PUBLIC_INDEX_SIZE)
+
 int amxcleanup_wavein(AMX *amx);
-int amxinit_waveout(AMX *amx);
 int amxinit_file(AMX *amx);
 int amxcleanup_file(AMX *amx);
-int amxinit_buttons(AMX *amx);
-int amxinit_fourier(AMX *amx);
 int amxinit_time(AMX *amx);
-int amxinit_device(AMX *amx);
 int amxinit_fpga(AMX *amx);
 int amx_timer_doevents(AMX *amx);
+bool amx_timer_pending();
 void overlay_init(AMX *amx, const char *filename, FIL *file);
+void overlay_write_profile();
 
 #define AMX_ERR_ABORT 100
 #define AMX_ERR_FILE_CHANGED 101
@@ -81,7 +82,7 @@ void TimerTick()
             // It's quite ugly to do such a long task in an
             // interrupt handler. Furthermore, it may access
             // the filesystem at the wrong time.
-            write_bitmap(select_filename("SSHOT%03d.BMP"), bmp_default_palette);
+            write_bitmap(select_filename("SSHOT%03d.BMP"), bmp_default_palette, true);
             
             __Set(BEEP_VOLUME, 20);
             while ((~__Get(KEY_STATUS)) & BUTTON4);
@@ -101,8 +102,86 @@ void TimerTick()
 // Propagate any errors to caller
 #define AMXERRORS(x) do {int a = (x); if (a != 0) return a;} while(0)
 
+extern const AMX_NATIVE_INFO core_natives[], display_natives[],
+    string_natives[], fixed_natives[], wavein_natives[], waveout_natives[],
+    menu_natives[], file_natives[], buttons_natives[], fourier_natives[],
+    time_natives[], device_natives[], fpga_natives[];
+
+// All the native functions available to programs
+static const AMX_NATIVE_INFO *const native_tables[] = {
+    core_natives, display_natives, string_natives, fixed_natives,
+    wavein_natives, waveout_natives, menu_natives, file_natives,
+    buttons_natives, fourier_natives, time_natives, device_natives,
+    fpga_natives
+};
+
+#define NATIVE_TABLE_COUNT (sizeof(native_tables) / sizeof(native_tables[0]))
+
+// Bind all the native functions imported by the program in a single pass,
+// using a hash table of the runtime natives built in the scratch memory.
+static int bind_natives(AMX *amx, void *scratch, unsigned scratch_size,
+                        char *error, size_t error_size)
+{
+    AMX_NATIVE_REGISTRY registry;
+    int status;
+    
+    if (amx_RegistryInit(&registry, native_tables, NATIVE_TABLE_COUNT,
+                         scratch, scratch_size) == AMX_ERR_NONE)
+    {
+        status = amx_RegisterAll(amx, &registry);
+    }
+    else
+    {
+        // Not enough scratch memory, do it the slow way
+        for (int t = 0; t < NATIVE_TABLE_COUNT; t++)
+            amx_Register(amx, native_tables[t], -1);
+        status = amx_Register(amx, NULL, -1);
+    }
+    
+    if (status != 0)
+    {
+        // Find out what is missing
+        AMX_HEADER *hdr = (AMX_HEADER*)amx->base;
+        for (int i = 0; i < NUMENTRIES(hdr,natives,libraries); i++)
+        {
+            AMX_FUNCSTUB *func = GETENTRY(hdr,natives,i);
+            if (func->address == 0)
+            {
+                snprintf(error, error_size, "Native function not found: %s",
+                         GETENTRYNAME(hdr,func));
+                break;
+            }
+        }
+    }
+    
+    return status;
+}
+
+static bool valid_header(const AMX_HEADER *hdr, unsigned file_size)
+{
+    return hdr->magic == AMX_MAGIC &&
+           hdr->defsize == sizeof(AMX_FUNCSTUB) &&
+           hdr->cod >= sizeof(AMX_HEADER) &&
+           hdr->cod <= hdr->dat && hdr->dat <= hdr->hea &&
+           hdr->hea <= hdr->stp && hdr->size == hdr->hea &&
+           hdr->size <= file_size;
+}
+
+// Time since previous call, for printing the load times
+static uint32_t phase_start;
+static uint32_t phase_us()
+{
+    uint32_t now = DWT_CYCCNT;
+    uint32_t us = (now - phase_start) / (CPUFREQ / 1000000);
+    phase_start = now;
+    return us;
+}
+
 int loadprogram(const char *filename, char *error, size_t error_size)
 {
+    uint32_t t_open, t_read, t_init, t_bind, t_modules;
+    phase_us();
+    
     FIL *file = &amx_file;
     FRESULT status = f_open(file, filename, FA_READ);
     if (status != FR_OK)
@@ -110,30 +189,44 @@ int loadprogram(const char *filename, char *error, size_t error_size)
         snprintf(error, error_size, "Could not open file %s: %d", filename, status);
         return AMX_ERR_NOTFOUND;
     }
+    t_open = phase_us();
     
-    /* Read file header */
+    /* Read the first sector, which includes the file header. The rest of
+     * the file is then read with whole sector transfers directly into
+     * vm_data, without seeking back to the start. */
     memset(&amx, 0, sizeof(amx));
     AMX_HEADER hdr;
-    UINT read_count;
-    f_read(file, &hdr, sizeof hdr, &read_count);
-    if (read_count != sizeof hdr || hdr.magic != AMX_MAGIC)
+    UINT read_count, loaded;
+    f_read(file, vm_data, 512, &loaded);
+    if (loaded < sizeof hdr)
+        return AMX_ERR_FORMAT;
+    
+    memcpy(&hdr, vm_data, sizeof hdr);
+    if (!valid_header(&hdr, f_size(file)))
         return AMX_ERR_FORMAT;
     
     if (hdr.flags & AMX_FLAG_OVERLAY)
     {
-        // Read the header
-        f_lseek(file, 0);
-        f_read(file, vm_data, hdr.cod, &read_count);
+        unsigned static_size = (hdr.stp - hdr.dat) + hdr.cod;
+        if (static_size > sizeof(vm_data) - PUBLIC_INDEX_SIZE)
+            return AMX_ERR_MEMORY;
+        
+        // Read the rest of the header
+        if (loaded < hdr.cod)
+        {
+            f_read(file, vm_data + loaded, hdr.cod - loaded, &read_count);
+            if (read_count != hdr.cod - loaded)
+                return AMX_ERR_FORMAT;
+        }
         
-        // Read the data block
+        // Read the data block, the code is loaded later by the overlay manager
         f_lseek(file, hdr.dat);
         unsigned dat_size = hdr.hea - hdr.dat;
         f_read(file, vm_data + hdr.cod, dat_size, &read_count);
         if (read_count != dat_size)
             return AMX_ERR_FORMAT;
         
-        unsigned static_size = (hdr.stp - hdr.dat) + hdr.cod;
-        amx_poolinit(vm_data + static_size, sizeof(vm_data) - static_size);
+        amx_poolinit(vm_data + static_size, PUBLIC_INDEX - (vm_data + static_size));
         
         amx.base = vm_data;
         amx.data = vm_data + hdr.cod;
@@ -144,48 +237,37 @@ int loadprogram(const char *filename, char *error, size_t error_size)
         if (hdr.stp > sizeof(vm_data))
             return AMX_ERR_MEMORY;
         
-        /* Read the actual file, including the header (again) */
-        f_lseek(file, 0);
-        f_read(file, vm_data, hdr.size, &read_count);
-        if (read_count != hdr.size)
-            return AMX_ERR_FORMAT;
+        if (loaded < hdr.size)
+        {
+            f_read(file, vm_data + loaded, hdr.size - loaded, &read_count);
+            if (read_count != hdr.size - loaded)
+                return AMX_ERR_FORMAT;
+        }
     }
+    t_read = phase_us();
     
     AMXERRORS(amx_Init(&amx, vm_data));
+    t_init = phase_us();
+    
+    // The heap and stack are not in use before the program starts, so they
+    // can hold the native registry. The topmost cell is the string sentinel.
+    uint8_t *heap = (amx.data ? amx.data : vm_data + hdr.dat) + (hdr.hea - hdr.dat);
+    unsigned scratch = hdr.stp - hdr.hea - sizeof(cell);
+    AMXERRORS(bind_natives(&amx, heap, scratch, error, error_size));
+    
+    // If the index doesn't fit, amx_FindPublic() uses binary search
+    if ((hdr.flags & AMX_FLAG_OVERLAY) || hdr.stp <= sizeof(vm_data) - PUBLIC_INDEX_SIZE)
+        amx_IndexPublics(&amx, PUBLIC_INDEX, PUBLIC_INDEX_SIZE);
+    t_bind = phase_us();
     
-    amxinit_display(&amx);
-    amx_CoreInit(&amx);
-    amxinit_string(&amx);
-    amxinit_fixed(&amx);
-    amxinit_wavein(&amx);
-    amxinit_waveout(&amx);
     amxinit_menu(&amx);
     amxinit_file(&amx);
-    amxinit_buttons(&amx);
-    amxinit_fourier(&amx);
     amxinit_time(&amx);
-    amxinit_device(&amx);
     amxinit_fpga(&amx);
+    t_modules = phase_us();
     
-    // Check that everything has been registered
-    int regstat = amx_Register(&amx, NULL, -1);
-    if (regstat != 0)
-    {
-        // Find out what is missing
-        for (int i = 0; i < NUMENTRIES((AMX_HEADER*)amx.base,natives,libraries); i++)
-        {
-            AMX_FUNCSTUB *func = GETENTRY((AMX_HEADER*)amx.base,natives,i);
-            if (func->address == 0)
-            {
-                snprintf(error, error_size, "Native function not found: %s",
-                         GETENTRYNAME((AMX_HEADER*)amx.base,func));
-                return AMX_ERR_NOTFOUND;
-            }
-        }
-        
-        snprintf(error, error_size, "Error registering native functions");
-        return regstat;
-    }
+    printf("Loaded %s: open %lu, read %lu, init %lu, bind %lu, modules %lu us\n",
+           filename, t_open, t_read, t_init, t_bind, t_modules);
     
     return 0;
 }
@@ -200,6 +282,12 @@ int doevents(AMX *amx)
     return status;
 }
 
+// Check if doevents() has something to do right away
+static bool events_pending()
+{
+    return key_events_pending() || amx_timer_pending();
+}
+
 #define REMAINING ((p < end) ? (end - p) : 0)
 
 const char *my_aux_StrError(int status)
@@ -327,6 +415,10 @@ int main(void)
     gpio_usart1_rx_mode(GPIO_HIGHZ_INPUT);
     printf("\nBoot!\n");
     
+    // Enable the cycle counter
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA;
+    DWT_CTRL |= 1;
+    
     // Reduce the wait states of the FPGA & LCD interface
     // It works for me, hopefully it works for you too :)
     FSMC_BTR1 = 0x10100110;
@@ -381,6 +473,11 @@ int main(void)
                 uint32_t end = get_time() + amx.pri;
                 do {
                     status = doevents(&nested_amx);
+                    
+                    // Sleep until the next interrupt, at most until the
+                    // next 1ms tick.
+                    if (status == 0 && !events_pending())
+                        __WFI();
                 } while (get_time() < end && status == 0);
                 
                 if (status == 0)
@@ -403,6 +500,9 @@ int main(void)
             amxcleanup_wavein(&amx);
             amxcleanup_file(&amx);
             
+            if (amx.overlay != NULL)
+                overlay_write_profile();
+            
             if (status == AMX_ERR_EXIT && ret == 0)
                 status = 0; // Ignore exit(0), but inform about e.g. exit(1)
             
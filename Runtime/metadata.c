@@ -87,6 +87,22 @@ static bool get_data_array(AMX_HEADER *hdr, FIL *file, const char *function,
     return true;
 }
 
+// Newer compilers append an AMX_METADATA block at the end of the file.
+static bool read_metadata_block(FIL *file, AMX_METADATA *meta)
+{
+    unsigned bytes;
+    
+    if (f_size(file) < sizeof(AMX_HEADER) + sizeof(AMX_METADATA))
+        return false;
+    
+    f_lseek(file, f_size(file) - sizeof(AMX_METADATA));
+    if (f_read(file, meta, sizeof(AMX_METADATA), &bytes) != FR_OK ||
+        bytes != sizeof(AMX_METADATA))
+        return false;
+    
+    return meta->magic == AMX_META_MAGIC && meta->size == sizeof(AMX_METADATA);
+}
+
 bool get_program_metadata(const char *filename, uint32_t icon[32], int *icon_size, char *name, int name_size)
 {
     AMX_HEADER hdr;
@@ -104,6 +120,22 @@ bool get_program_metadata(const char *filename, uint32_t icon[32], int *icon_siz
         return false;
     }
     
+    AMX_METADATA meta;
+    if (read_metadata_block(&file, &meta))
+    {
+        *icon_size = meta.icon_rows;
+        if (*icon_size < 0) *icon_size = 0;
+        if (*icon_size > 32) *icon_size = 32;
+        memcpy(icon, meta.icon, *icon_size * 4);
+        
+        strncpy(name, meta.name, name_size);
+        name[name_size - 1] = 0;
+        
+        f_close(&file);
+        return true;
+    }
+    
+    // Older files: find the arrays through the metadata.inc functions
     int bytecount;
     int icon_dataptr;
     if (get_data_array(&hdr, &file, "get_program_icon", &icon_dataptr, &bytecount))
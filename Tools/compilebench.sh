@@ -0,0 +1,42 @@
+#!/bin/sh
+# Benchmark for the compiler. Compiles all programs in Programs/ and a file
+# that includes every header in Compiler/include, and reports the total
+# compile time and the time spent in the peephole optimizer.
+#
+# Usage: compilebench.sh [pawncc] [rounds]
+
+cd "$(dirname "$0")/.."
+PAWNCC=${1:-Compiler/bin/pawncc}
+ROUNDS=${2:-5}
+TMPDIR=$(mktemp -d)
+trap 'rm -rf "$TMPDIR"' EXIT
+
+# program_icon and program_name are needed by metadata.inc
+ALLINC=$TMPDIR/allinc.pawn
+echo "new const program_icon[] = [0];" > $ALLINC
+echo "new const program_name{} = \"bench\";" >> $ALLINC
+for f in Compiler/include/*.inc; do
+    echo "#include <$(basename $f .inc)>" >> $ALLINC
+done
+echo "main() {}" >> $ALLINC
+
+total=0
+optimizer=0
+round=0
+while [ $round -lt $ROUNDS ]; do
+    for f in Programs/*.pawn $ALLINC; do
+        out=$("$PAWNCC" -d2 -v3 -V1 -iCompiler/include -o$TMPDIR/bench.amx $f 2>&1 | grep "^Compile time:")
+        ms=$(echo "$out" | sed 's/^Compile time: *\([0-9]*\) ms.*/\1/')
+        opt=$(echo "$out" | sed 's/.*optimizer=\([0-9]*\) ms.*/\1/')
+        if [ -z "$ms" ]; then
+            echo "Failed to compile $f"
+            exit 1
+        fi
+        total=$((total + ms))
+        optimizer=$((optimizer + opt))
+    done
+    round=$((round + 1))
+done
+
+echo "Compile time:      $((total / ROUNDS)) ms per round ($ROUNDS rounds)"
+echo "Peephole optimizer: $((optimizer / ROUNDS)) ms per round"
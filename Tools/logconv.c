@@ -0,0 +1,337 @@
+/* Converter for the binary capture logs written by caplog.inc.
+ * Produces either a VCD file for waveform viewers such as GTKWave, or a
+ * CSV file for spreadsheets.
+ *
+ * Compile with: gcc -O2 -o logconv logconv.c
+ * Usage:        logconv [-v | -c] WAVES000.LOG > output
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+enum { LOG_ANALOG = 1, LOG_DIGITAL = 2, LOG_EVENTS = 3 };
+enum { LOG_RAW = 0, LOG_RLE = 1 };
+
+// One decoded sample. Digital samples have analog == false and the
+// levels in value, analog samples have one value per channel.
+typedef struct {
+    uint64_t time;
+    size_t seq;
+    bool analog;
+    uint8_t channels;
+    uint8_t value[8];
+} sample_t;
+
+static sample_t *samples;
+static size_t sample_count, sample_alloc;
+
+static int analog_channels, digital_channels;
+static uint32_t timescale_ps;
+
+static sample_t *add_sample(uint64_t time, bool analog, int channels)
+{
+    if (sample_count == sample_alloc)
+    {
+        sample_alloc = sample_alloc ? sample_alloc * 2 : 1024;
+        samples = realloc(samples, sample_alloc * sizeof(sample_t));
+        if (!samples)
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+    
+    sample_t *s = &samples[sample_count++];
+    memset(s, 0, sizeof(sample_t));
+    s->time = time;
+    s->seq = sample_count;
+    s->analog = analog;
+    s->channels = channels;
+    return s;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t get_varint(const uint8_t **p, const uint8_t *end)
+{
+    uint32_t value = 0;
+    int shift = 0;
+    while (*p < end)
+    {
+        uint8_t b = *(*p)++;
+        value |= (uint32_t)(b & 0x7F) << shift;
+        shift += 7;
+        if (!(b & 0x80)) break;
+    }
+    return value;
+}
+
+static void decode_block(const uint8_t *hdr, const uint8_t *data, uint32_t length)
+{
+    int type = hdr[0];
+    int encoding = hdr[1];
+    int channels = hdr[2];
+    uint32_t count = get_u32(hdr + 4);
+    uint64_t time = get_u32(hdr + 12) | ((uint64_t)get_u32(hdr + 16) << 32);
+    uint32_t interval = get_u32(hdr + 20);
+    const uint8_t *end = data + length;
+    
+    if (channels > 8)
+        channels = 8;
+    
+    if (type == LOG_ANALOG)
+    {
+        for (uint32_t i = 0; i < count && data + channels <= end; i++)
+        {
+            sample_t *s = add_sample(time + (uint64_t)i * interval, true, channels);
+            memcpy(s->value, data, channels);
+            data += hdr[2];
+        }
+    }
+    else if (type == LOG_DIGITAL && encoding == LOG_RAW)
+    {
+        uint32_t plane = (count + 7) / 8;
+        if ((uint64_t)plane * channels > length)
+            return;
+        
+        for (uint32_t i = 0; i < count; i++)
+        {
+            sample_t *s = add_sample(time + (uint64_t)i * interval, false, channels);
+            for (int c = 0; c < channels; c++)
+            {
+                if (data[c * plane + i / 8] & (1 << (i % 8)))
+                    s->value[0] |= 1 << c;
+            }
+        }
+    }
+    else if (type == LOG_DIGITAL && encoding == LOG_RLE)
+    {
+        uint32_t i = 0;
+        while (i < count && data < end)
+        {
+            uint8_t levels = *data++;
+            uint32_t run = get_varint(&data, end);
+            
+            // Only the start of each run matters for VCD, but CSV output
+            // wants every sample.
+            for (uint32_t j = 0; j < run && i < count; j++, i++)
+            {
+                sample_t *s = add_sample(time + (uint64_t)i * interval, false, channels);
+                s->value[0] = levels;
+            }
+        }
+    }
+    else if (type == LOG_EVENTS)
+    {
+        for (uint32_t i = 0; i < count && data < end; i++)
+        {
+            time += get_varint(&data, end);
+            if (data >= end) break;
+            
+            sample_t *s = add_sample(time, false, channels);
+            s->value[0] = *data++;
+        }
+    }
+    else
+    {
+        fprintf(stderr, "Skipping unknown block type %d/%d\n", type, encoding);
+    }
+}
+
+static bool read_log(FILE *f)
+{
+    uint8_t hdr[24];
+    if (fread(hdr, 1, 16, f) != 16 || memcmp(hdr, "QLOG", 4) != 0)
+    {
+        fprintf(stderr, "Not a capture log file\n");
+        return false;
+    }
+    
+    if (hdr[4] != 1)
+    {
+        fprintf(stderr, "Unsupported log version %d\n", hdr[4]);
+        return false;
+    }
+    
+    analog_channels = hdr[5];
+    digital_channels = hdr[6];
+    timescale_ps = get_u32(hdr + 8);
+    
+    while (fread(hdr, 1, 24, f) == 24)
+    {
+        uint32_t length = get_u32(hdr + 8);
+        uint8_t *data = malloc(length ? length : 1);
+        if (!data || fread(data, 1, length, f) != length)
+        {
+            fprintf(stderr, "Truncated block at end of file\n");
+            free(data);
+            break;
+        }
+        
+        decode_block(hdr, data, length);
+        free(data);
+    }
+    
+    return true;
+}
+
+// Keep blocks of different types in time order, but otherwise in the order
+// they were written.
+static int compare_samples(const void *a, const void *b)
+{
+    const sample_t *x = a, *y = b;
+    if (x->time != y->time)
+        return (x->time < y->time) ? -1 : 1;
+    return (x->seq < y->seq) ? -1 : (x->seq > y->seq);
+}
+
+static void write_vcd(FILE *out)
+{
+    fprintf(out, "$version DSO Quad Logic Capture $end\n");
+    fprintf(out, "$timescale 1ps $end\n");
+    fprintf(out, "$scope module logic $end\n");
+    for (int i = 0; i < digital_channels; i++)
+        fprintf(out, "$var wire 1 %c Channel%c $end\n", 'A' + i, 'A' + i);
+    for (int i = 0; i < analog_channels; i++)
+        fprintf(out, "$var wire 8 %c Analog%d $end\n", 'a' + i, i);
+    fprintf(out, "$upscope $end\n");
+    fprintf(out, "$enddefinitions $end\n");
+    
+    int levels = -1;
+    int analog[8];
+    for (int i = 0; i < 8; i++) analog[i] = -1;
+    
+    uint64_t prev_time = UINT64_MAX;
+    for (size_t i = 0; i < sample_count; i++)
+    {
+        const sample_t *s = &samples[i];
+        bool changed = false;
+        if (s->analog)
+        {
+            for (int c = 0; c < s->channels; c++)
+                changed |= (analog[c] != s->value[c]);
+        }
+        else
+        {
+            changed = (s->value[0] != levels);
+        }
+        
+        if (!changed)
+            continue;
+        
+        if (s->time != prev_time)
+        {
+            fprintf(out, "#%llu\n", (unsigned long long)(s->time * timescale_ps));
+            prev_time = s->time;
+        }
+        
+        if (s->analog)
+        {
+            for (int c = 0; c < s->channels; c++)
+            {
+                if (analog[c] == s->value[c]) continue;
+                
+                fprintf(out, "b");
+                for (int bit = 7; bit >= 0; bit--)
+                    fputc((s->value[c] & (1 << bit)) ? '1' : '0', out);
+                fprintf(out, " %c\n", 'a' + c);
+                analog[c] = s->value[c];
+            }
+        }
+        else
+        {
+            for (int c = 0; c < s->channels; c++)
+            {
+                int bit = (s->value[0] >> c) & 1;
+                if (levels < 0 || ((levels >> c) & 1) != bit)
+                    fprintf(out, "%d%c\n", bit, 'A' + c);
+            }
+            levels = s->value[0];
+        }
+    }
+}
+
+static void write_csv(FILE *out)
+{
+    fprintf(out, "time_ps");
+    for (int i = 0; i < analog_channels; i++)
+        fprintf(out, ",analog%d", i);
+    for (int i = 0; i < digital_channels; i++)
+        fprintf(out, ",%c", 'A' + i);
+    fprintf(out, "\n");
+    
+    for (size_t i = 0; i < sample_count; i++)
+    {
+        const sample_t *s = &samples[i];
+        fprintf(out, "%llu", (unsigned long long)(s->time * timescale_ps));
+        
+        for (int c = 0; c < analog_channels; c++)
+        {
+            if (s->analog && c < s->channels)
+                fprintf(out, ",%d", s->value[c]);
+            else
+                fprintf(out, ",");
+        }
+        
+        for (int c = 0; c < digital_channels; c++)
+        {
+            if (!s->analog && c < s->channels)
+                fprintf(out, ",%d", (s->value[0] >> c) & 1);
+            else
+                fprintf(out, ",");
+        }
+        
+        fprintf(out, "\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool csv = false;
+    const char *filename = NULL;
+    
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-c") == 0)
+            csv = true;
+        else if (strcmp(argv[i], "-v") == 0)
+            csv = false;
+        else
+            filename = argv[i];
+    }
+    
+    if (!filename)
+    {
+        fprintf(stderr, "Usage: %s [-v | -c] logfile > output\n", argv[0]);
+        fprintf(stderr, "  -v   Write VCD (default)\n");
+        fprintf(stderr, "  -c   Write CSV\n");
+        return 1;
+    }
+    
+    FILE *f = fopen(filename, "rb");
+    if (!f)
+    {
+        perror(filename);
+        return 1;
+    }
+    
+    bool ok = read_log(f);
+    fclose(f);
+    if (!ok) return 1;
+    
+    qsort(samples, sample_count, sizeof(sample_t), compare_samples);
+    
+    if (csv)
+        write_csv(stdout);
+    else
+        write_vcd(stdout);
+    
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,132 @@
+/* Benchmark for binding native functions with amx_Register() versus
+ * amx_RegistryInit() + amx_RegisterAll(). A synthetic program header that
+ * imports 500 natives is built in memory, and the natives are provided in
+ * several lists like the runtime modules do.
+ *
+ * Compile with: gcc -O2 -DAMX_ANSIONLY -DPAWN_CELL_SIZE=64 -DHAVE_I64
+ *                   -I../Runtime/amx -I../Compiler/source/linux
+ *                   -o natbench natbench.c ../Runtime/amx/amx.c
+ *               (64-bit cells are needed on 64-bit hosts so that function
+ *               pointers fit in the native table)
+ * Usage:        natbench [rounds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "amx.h"
+
+#define NATIVE_COUNT 500
+#define LIST_COUNT 13
+
+static cell AMX_NATIVE_CALL dummy(AMX *amx, const cell *params)
+{
+    return 0;
+}
+
+static char names[NATIVE_COUNT][16];
+static AMX_NATIVE_INFO lists[LIST_COUNT][NATIVE_COUNT / LIST_COUNT + 2];
+static const AMX_NATIVE_INFO *list_ptrs[LIST_COUNT];
+
+static unsigned char *make_program()
+{
+    unsigned size = sizeof(AMX_HEADER) + NATIVE_COUNT * (sizeof(AMX_FUNCSTUB) + 16);
+    unsigned char *base = calloc(1, size);
+    AMX_HEADER *hdr = (AMX_HEADER*)base;
+    
+    hdr->magic = AMX_MAGIC;
+    hdr->defsize = sizeof(AMX_FUNCSTUB);
+    hdr->publics = hdr->natives = sizeof(AMX_HEADER);
+    hdr->libraries = hdr->natives + NATIVE_COUNT * sizeof(AMX_FUNCSTUB);
+    hdr->pubvars = hdr->tags = hdr->nametable = hdr->overlays = hdr->libraries;
+    
+    // Import the natives in a different order than they are listed
+    AMX_FUNCSTUB *stubs = (AMX_FUNCSTUB*)(base + hdr->natives);
+    char *nametable = (char*)(base + hdr->libraries);
+    for (int i = 0; i < NATIVE_COUNT; i++)
+    {
+        int n = (i * 7919) % NATIVE_COUNT;
+        stubs[i].nameofs = (char*)nametable - (char*)base;
+        strcpy(nametable, names[n]);
+        nametable += 16;
+    }
+    
+    return base;
+}
+
+static void clear_bindings(AMX *amx)
+{
+    AMX_HEADER *hdr = (AMX_HEADER*)amx->base;
+    AMX_FUNCSTUB *stubs = (AMX_FUNCSTUB*)(amx->base + hdr->natives);
+    for (int i = 0; i < NATIVE_COUNT; i++)
+        stubs[i].address = 0;
+    amx->flags = 0;
+}
+
+static double seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = (argc > 1) ? atoi(argv[1]) : 1000;
+    
+    for (int i = 0; i < NATIVE_COUNT; i++)
+    {
+        int list = i % LIST_COUNT;
+        int pos = i / LIST_COUNT;
+        snprintf(names[i], sizeof(names[i]), "native_%03d", i);
+        lists[list][pos].name = names[i];
+        lists[list][pos].func = dummy;
+    }
+    for (int i = 0; i < LIST_COUNT; i++)
+        list_ptrs[i] = lists[i];
+    
+    AMX amx;
+    memset(&amx, 0, sizeof(amx));
+    amx.base = make_program();
+    
+    double start = seconds();
+    int status = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+        clear_bindings(&amx);
+        for (int i = 0; i < LIST_COUNT; i++)
+            amx_Register(&amx, list_ptrs[i], -1);
+        status |= amx_Register(&amx, NULL, -1);
+    }
+    double linear = (seconds() - start) / rounds;
+    
+    static const AMX_NATIVE_INFO *slots[2 * NATIVE_COUNT];
+    AMX_NATIVE_REGISTRY registry;
+    start = seconds();
+    for (int r = 0; r < rounds; r++)
+        status |= amx_RegistryInit(&registry, list_ptrs, LIST_COUNT, slots, sizeof(slots));
+    double build = (seconds() - start) / rounds;
+    
+    start = seconds();
+    for (int r = 0; r < rounds; r++)
+    {
+        clear_bindings(&amx);
+        status |= amx_RegisterAll(&amx, &registry);
+    }
+    double hashed = (seconds() - start) / rounds;
+    
+    if (status != AMX_ERR_NONE || !(amx.flags & AMX_FLAG_NTVREG))
+    {
+        fprintf(stderr, "Binding failed: %d\n", status);
+        return 1;
+    }
+    
+    printf("%d natives in %d lists, %d rounds\n", NATIVE_COUNT, LIST_COUNT, rounds);
+    printf("amx_Register:     %8.1f us\n", linear * 1e6);
+    printf("amx_RegistryInit: %8.1f us\n", build * 1e6);
+    printf("amx_RegisterAll:  %8.1f us\n", hashed * 1e6);
+    
+    free(amx.base);
+    return 0;
+}